@@ -25,9 +25,8 @@ static int reg_a, reg_x, reg_y, reg_s, reg_p;
 static int flag_nz, flag_c;
 
 /* clock and interrupt services */
-static void (*callback[CB_MAX])(void);
-static int callback_time[CB_MAX];
-static int next_callback[CB_MAX];
+/* time_left counts down to 'deadline', the time of the next event */
+static cycle_t deadline = 0;
 static int time_left = 0;
 
 #ifdef WATCHPOINT
@@ -43,14 +42,10 @@ int instr_count[256];
 unsigned char ram_64k[0x10000];
 unsigned char readable[0x10000];
 unsigned char io_ram[0x1000];
-unsigned char character_rom[0x1000];
 unsigned char color_ram[0x0400];
 
 unsigned char *stack;
-unsigned char *character_base;
-unsigned char *video_matrix;
-unsigned char *bitmap_base;
-unsigned char *video_bank;
+vic_memory mem_vic;
 int mem_video_matrix, mem_bitmap_base;
 int mem_videoptr, mem_videobank;
 
@@ -62,75 +57,22 @@ int mem_flags;
 /**** Utility functions ****/
 /***************************/
 
-int cpu6510_clock (void) {
-	return callback_time[next_callback[0]] - time_left;
+cycle_t cpu6510_clock (void) {
+	return deadline - time_left;
 }
 
-void cpu6510_callback (int source, void (*cb)(void), int time) {
-	int now, i;
-	int before, after;
-	
-	//printf("source %i registered callback for time %i\n", source, time);
-	
-	/* only 16 slots */
-	if (source >= CB_MAX) return;
-	
-	/* figure out current time */
-	now = callback_time[next_callback[0]] - time_left;
-
-	/* unregister old callback if we are overwriting one */
-	if (callback[source] != NULL) {
-		for (i=0; i<CB_MAX; i++) {
-			if (next_callback[i] == source) {
-				next_callback[i] = next_callback[source];
-				break;
-			}
-		}
-	}
-	
-	/* put the new callback in the table */
-	callback[source] = cb;
-	callback_time[source] = time;
-	
-	/* place the new callback in the list */
-	if (cb != NULL) {
-		before = 0;
-		while (1) {
-			after = next_callback[before];
-			//printf("callback_time[%i] = %i\n", after, callback_time[after]);
-			if (time < callback_time[after] || after == 0) {
-				next_callback[before] = source;
-				next_callback[source] = after;
-				break;
-			}
-			before = after;
-		}
-	}
-	
-	/* calculate new time_left value */
-	time_left = callback_time[next_callback[0]] - now;
-	//printf("clock = %i, next = %i, time_left = %i\n", now, next_callback[0], time_left);
+/* longest stretch the cpu runs without looking at the scheduler */
+#define MAX_SLICE (1 << 30)
+
+/* called by the scheduler whenever the earliest event changes */
+void cpu6510_set_deadline (cycle_t when) {
+	cycle_t now = deadline - time_left;
+
+	if (when - now > MAX_SLICE) when = now + MAX_SLICE;
+	deadline = when;
+	time_left = (int) (when - now);
 }
 
-static void handle_callbacks() {
-	int old, new;
-	void (*cb)(void);
-	
-	/* get current callback function */
-	old = next_callback[0];
-	new = next_callback[old];
-	cb = callback[old];
-
-	//printf ("clock = %i, handling callback for %i\n", callback_time[old] - time_left, old);
-
-	/* unregister current callback function */
-	next_callback[0] = new;
-	callback[old] = NULL;
-	time_left += callback_time[new] - callback_time[old];
-	//printf ("new time_left = %i\n", time_left);
-	/* call the callback */
-	if (cb != NULL) cb();
-}	
   /*
     types of interrupts to take care of :
     60 Hz clock interrupt
@@ -147,6 +89,11 @@ void cpu6510_bad_line() {
 	time_left -= 40;
 }
 
+/* halt the cpu while another chip (e.g. REU DMA) owns the bus */
+void cpu6510_steal_cycles(int cycles) {
+	time_left -= cycles;
+}
+
 inline static void clock_advance (int ticks) {
 	time_left -= ticks;
 }
@@ -193,6 +140,12 @@ void cpu6510_reset() {
 	reg_pc = mem_read_16(0xfffc);
 }
 
+/* start running at 'address' with an empty stack, as a reset would */
+void cpu6510_jump(int address) {
+	reg_pc = address & 0xffff;
+	reg_s = 0xff;
+}
+
 void cpu6510_irq() {
 #ifndef VICELOG
 	/* check to see if interrupts are enabled */
@@ -354,7 +307,7 @@ void cpu6510_main ()
 	//time_left += cycles;
 
 	while (1) {
-		while (time_left <= 0) handle_callbacks();
+		while (time_left <= 0) event_dispatch();
 
 #ifdef WATCHPOINT
 		if (reg_pc == WATCHPOINT) VERBOSE = 1;
@@ -379,7 +332,7 @@ void cpu6510_main ()
 #endif
 
 		/* dispatch next instruction */
-		opcode = mem_read(reg_pc++);
+		opcode = mem_fetch(reg_pc++);
 		switch (opcode) {
 
 		case 0x00:  cpu6510_BRK();            clock_advance(7);  break;
@@ -662,7 +615,8 @@ void print_state() {
 
 	/* print stack contents */
 
-	for (i=0xff; i>reg_s; i--) fprintf(stdout, " %02x", mem_read(0x100 + i));
+	/* (straight from 'readable', so stack watchpoints don't fire) */
+	for (i=0xff; i>reg_s; i--) fprintf(stdout, " %02x", readable[0x100 + i]);
 
 	fprintf(stdout, "\n");
 
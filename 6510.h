@@ -1,10 +1,13 @@
 /* 6510.h - processor emulation for C64 emulator */
 /* by Brian Huffman 11-29-00 */
 
+#include "event.h"
+
 //void cpu6510_main (int cycles);
 void cpu6510_main (void);
 
 void cpu6510_reset (void);
+void cpu6510_jump (int address);
 void cpu6510_irq (void);
 void cpu6510_nmi (void);
 void cpu6510_brk (void);
@@ -12,20 +15,10 @@ void cpu6510_brk (void);
 void print_state (void);
 
 void cpu6510_bad_line (void);
+void cpu6510_steal_cycles (int cycles);
 
-void cpu6510_callback (int source, void (*callback)(void), int time);
-int cpu6510_clock (void);
-
-enum {
-	CB_NONE,
-	CB_MAIN,
-	CB_RASTER,
-	CB_REDRAW,
-	CB_FRAME,
-	CB_TIMER1A,
-	CB_TIMER1B,
-	CB_MAX
-};
+cycle_t cpu6510_clock (void);
+void cpu6510_set_deadline (cycle_t when);
 /*
 typedef struct CPUState {
 
@@ -2,6 +2,7 @@
 /* this file should be included directly into 6510.c */
 
 #include "serial.h"
+#include "tape.h"
 
 inline static void update_nz(int result) {
 	flag_nz = result;
@@ -80,10 +81,22 @@ fd86:  BEQ $fd6c  	;f0e4    ;loop to check all pages
 /* TKSA */
 /* CIOUT */
 inline void kernal_ed40() {
+/*
+	ed40:  SEI      	;78
+	ed41:  JSR $ee97	;2097ee  ;DATA high
+*/
 	int atn, error;
 	
 	atn = mem_read(0xdd00) & 0x08;
 
+	/* a byte for the true drive goes out on the bus */
+	if (serial_on_bus (atn, mem_read(0x95))) {
+		cpu6510_SEI();
+		reg_pc = 0xed41;
+		clock_advance(2);
+		return;
+	}
+
 	/* $95 = BSOUT, buffered serial char */
 	error = serial_write (atn, mem_read(0x95));
 
@@ -95,7 +108,21 @@ inline void kernal_ed40() {
 
 /* ACPTR */
 inline void kernal_ee13() {
-	int result = serial_read ();
+/*
+	ee13:  SEI      	;78
+	ee14:  LDA #$00 	;a900
+*/
+	int result;
+
+	/* the true drive is read from the bus */
+	if (serial_on_bus (0, 0)) {
+		cpu6510_SEI();
+		reg_pc = 0xee14;
+		clock_advance(2);
+		return;
+	}
+
+	result = serial_read ();
 	if (result & SERIAL_END_OF_FILE) mem_write (0x90, mem_read(0x90) | 0x40);
 	if (result == SERIAL_TIME_OUT) mem_write (0x90, mem_read(0x90) | 0x02);
 	
@@ -105,10 +132,106 @@ inline void kernal_ee13() {
 	cpu6510_RTS();
 }
 
+/* LOAD, after the file is open and the load address is read */
+inline void kernal_f4f3() {
+/*
+	f4f3:  LDA #$fd  	;a9fd    ;clear time out read
+	...
+	f501:  JSR $ee13  	;2013ee  ;ACPTR, into ($ae),y
+	...
+	f524:  BIT $90  	;2490
+	f526:  BVC $f4f3  	;50cb    ;until end of file
+	f528:  JSR $edef  	;20efed  ;UNTALK, close, CLC and end address in X/Y
+*/
+	const unsigned char *data;
+	int address, status, size = 0;
+
+	status = mem_read(0x90);
+	/* verifying, the true drive, or a driver that can only give a byte at
+	   a time */
+	if (mem_read(0x93) != 0 || serial_on_bus (0, 0) ||
+		(!(status & 0x40) && (size = serial_read_block (&data)) < 0)) {
+		reg_a = 0xfd;
+		update_nz(reg_a);
+		reg_pc = 0xf4f5;
+		clock_advance(2);
+		return;
+	}
+
+	address = mem_read_16(0xae);
+	if (!(status & 0x40)) {
+		while (size > 0) {
+			mem_write_block (address, data, size);
+			address = (address + size) & 0xffff;
+			size = serial_read_block (&data);
+		}
+	}
+	mem_write(0xae, address & 0xff);
+	mem_write(0xaf, address >> 8);
+	mem_write(0x90, (status & ~0x02) | 0x40);
+
+	reg_y = 0;
+	reg_pc = 0xf528;
+	clock_advance(2);
+}
+
+/*****************************************/
+/**** tape emulation kernal patches ******/
+/*****************************************/
+
+/* LOAD from tape, once the device is known to be the datassette */
+inline void kernal_f539() {
+/*
+	f539:  JSR $f7d0  	;20d0f7  ;tape buffer address
+	...				;PRESS PLAY, find the header, read the file
+	f5ae:  CLC 		;18
+	...				;end address in X/Y
+*/
+	unsigned char name[256];
+	const unsigned char *data;
+	int start, size, len, status = 0, i;
+
+	len = mem_read(0xb7);
+	mem_read_block(mem_read_16(0xbb), name, len);
+	size = tape_find(name, len, &start, &data);
+
+	/* a TAP, or nothing, is read by the kernal */
+	if (size == TAPE_NO_T64) {
+		cpu6510_JSR(addr_abs());
+		clock_advance(6);
+		return;
+	}
+	if (size == TAPE_NOT_FOUND) {
+		/* f704:  LDA #$04, FILE NOT FOUND */
+		reg_pc = 0xf704;
+		clock_advance(6);
+		return;
+	}
+
+	/* secondary address 0: where LOAD was asked to put it */
+	if (mem_read(0xb9) == 0) start = mem_read_16(0xc3);
+	if (mem_read(0x93) != 0) {
+		for (i = 0; i < size; i++)
+			if (mem_read((start + i) & 0xffff) != data[i]) status = 0x10;
+	} else mem_write_block(start, data, size);
+
+	start = (start + size) & 0xffff;
+	mem_write(0xae, start & 0xff);
+	mem_write(0xaf, start >> 8);
+	mem_write(0x90, status);
+	reg_x = start & 0xff;
+	reg_y = start >> 8;
+	cpu6510_CLC();
+	cpu6510_RTS();
+	clock_advance(6);
+}
+
 inline void do_highlevel() {
 	if (reg_pc == 0xe5cd + 1) kernal_e5cd();
 	else if (reg_pc == 0xe9d4 + 1) kernal_e9d4();
 	else if (reg_pc == 0xed40 + 1) kernal_ed40();
 	else if (reg_pc == 0xee13 + 1) kernal_ee13();
+	else if (reg_pc == 0xf4f3 + 1) kernal_f4f3();
+	else if (reg_pc == 0xf539 + 1) kernal_f539();
 	else cpu6510_JAM();
 }
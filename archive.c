@@ -0,0 +1,297 @@
+/* archive.c - compressed files and their cache for c64 emulator */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <sys/stat.h>
+#include <zlib.h>
+#include "archive.h"
+#include "log.h"
+
+typedef struct cache_entry_s {
+	char *path, *member;
+	time_t mtime;
+	off_t file_size;
+	unsigned char *data;
+	size_t size;
+	int users;
+	unsigned long used;		/* when it was last asked for */
+	struct cache_entry_s *next;
+} cache_entry;
+
+static cache_entry *cache = NULL;
+static size_t cache_bytes = 0;
+static unsigned long clock_tick = 0;
+
+static int ends_with (const char *name, const char *suffix) {
+	int n = strlen (name), m = strlen (suffix), i;
+
+	if (n < m) return 0;
+	for (i = 0; i < m; i++)
+		if (tolower ((unsigned char) name[n - m + i]) != suffix[i]) return 0;
+	return 1;
+}
+
+int archive_is_compressed (const char *path) {
+	return ends_with (path, ".gz") || ends_with (path, ".zip");
+}
+
+static void *allocate (size_t size) {
+	void *p = malloc (size ? size : 1);
+
+	if (p == NULL) {
+		fprintf (stderr, "couldn't allocate decoded archive\n");
+		exit (1);
+	}
+	return p;
+}
+
+/******************** GZIP *************************/
+
+static unsigned char *gunzip (const char *path, size_t *size) {
+	unsigned char trailer[4], *data;
+	size_t length, allocated;
+	gzFile gz;
+	FILE *f;
+	int n;
+
+	/* the trailer has the size, modulo 4 GB */
+	f = fopen (path, "rb");
+	if (f == NULL) return NULL;
+	allocated = 0;
+	if (fseek (f, -4, SEEK_END) == 0 && fread (trailer, 1, 4, f) == 4)
+		allocated = trailer[0] | (trailer[1] << 8) | (trailer[2] << 16) |
+			((size_t) trailer[3] << 24);
+	fclose (f);
+	if (allocated == 0 || allocated > ARCHIVE_CACHE_SIZE) allocated = 0x10000;
+
+	gz = gzopen (path, "rb");
+	if (gz == NULL) return NULL;
+	data = allocate (allocated);
+	length = 0;
+	for (;;) {
+		if (length == allocated) {
+			allocated *= 2;
+			data = realloc (data, allocated);
+			if (data == NULL) {
+				fprintf (stderr, "couldn't allocate decoded archive\n");
+				exit (1);
+			}
+		}
+		n = gzread (gz, data + length, allocated - length);
+		if (n <= 0) break;
+		length += n;
+	}
+	gzclose (gz);
+	if (n < 0) {
+		free (data);
+		return NULL;
+	}
+	*size = length;
+	return data;
+}
+
+/******************** ZIP *************************/
+
+static unsigned int le16 (const unsigned char *p) {
+	return p[0] | (p[1] << 8);
+}
+
+static unsigned long le32 (const unsigned char *p) {
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned long) p[3] << 24);
+}
+
+static int same_name (const unsigned char *name, int len, const char *member) {
+	int i;
+
+	if (member == NULL) return len > 0 && name[len - 1] != '/';
+	/* "*.d64": the first one ending like that */
+	if (member[0] == '*') {
+		member++;
+		if ((int) strlen (member) > len) return 0;
+		name += len - strlen (member);
+		len = strlen (member);
+	}
+	if ((int) strlen (member) != len) return 0;
+	for (i = 0; i < len; i++)
+		if (tolower (name[i]) != tolower ((unsigned char) member[i])) return 0;
+	return 1;
+}
+
+static unsigned char *inflate_member (const unsigned char *zip, size_t zip_size,
+	const unsigned char *entry, size_t *size) {
+	unsigned long packed = le32 (entry + 20), unpacked = le32 (entry + 24);
+	unsigned long local = le32 (entry + 42);
+	const unsigned char *p;
+	unsigned char *data;
+	z_stream z;
+	int method = le16 (entry + 10), ok;
+
+	if (local + 30 > zip_size || le32 (zip + local) != 0x04034b50) return NULL;
+	p = zip + local + 30 + le16 (zip + local + 26) + le16 (zip + local + 28);
+	if (p + packed > zip + zip_size) return NULL;
+
+	data = allocate (unpacked);
+	if (method == 0 && packed == unpacked) {
+		memcpy (data, p, unpacked);
+		*size = unpacked;
+		return data;
+	}
+	if (method != 8) {
+		free (data);
+		return NULL;
+	}
+
+	memset (&z, 0, sizeof(z));
+	if (inflateInit2 (&z, -MAX_WBITS) != Z_OK) {
+		free (data);
+		return NULL;
+	}
+	z.next_in = (unsigned char *) p;
+	z.avail_in = packed;
+	z.next_out = data;
+	z.avail_out = unpacked;
+	ok = inflate (&z, Z_FINISH) == Z_STREAM_END && z.total_out == unpacked;
+	inflateEnd (&z);
+	if (!ok) {
+		free (data);
+		return NULL;
+	}
+	*size = unpacked;
+	return data;
+}
+
+static unsigned char *unzip (const char *path, const char *member,
+	size_t *size) {
+	unsigned char *zip, *data = NULL;
+	const unsigned char *end, *entry;
+	size_t zip_size;
+	long length;
+	int entries, i;
+	FILE *f;
+
+	f = fopen (path, "rb");
+	if (f == NULL) return NULL;
+	fseek (f, 0, SEEK_END);
+	length = ftell (f);
+	rewind (f);
+	if (length < 22) {
+		fclose (f);
+		return NULL;
+	}
+	zip = allocate (length);
+	zip_size = fread (zip, 1, length, f);
+	fclose (f);
+
+	/* the end record is followed by a comment of up to 64k */
+	for (end = zip + zip_size - 22; end >= zip; end--)
+		if (le32 (end) == 0x06054b50) break;
+	if (end < zip) goto done;
+
+	entries = le16 (end + 10);
+	entry = zip + le32 (end + 16);
+	for (i = 0; i < entries; i++) {
+		if (entry + 46 > zip + zip_size || le32 (entry) != 0x02014b50) break;
+		if (entry + 46 + le16 (entry + 28) > zip + zip_size) break;
+		if (same_name (entry + 46, le16 (entry + 28), member)) {
+			data = inflate_member (zip, zip_size, entry, size);
+			break;
+		}
+		entry += 46 + le16 (entry + 28) + le16 (entry + 30) + le16 (entry + 32);
+	}
+done:
+	free (zip);
+	return data;
+}
+
+/******************** CACHE *************************/
+
+/* drop what nobody uses, oldest first, until the cache fits */
+static void trim (void) {
+	cache_entry **e, **oldest, *gone;
+
+	while (cache_bytes > ARCHIVE_CACHE_SIZE) {
+		oldest = NULL;
+		for (e = &cache; *e != NULL; e = &(*e)->next)
+			if ((*e)->users == 0 &&
+				(oldest == NULL || (*e)->used < (*oldest)->used)) oldest = e;
+		if (oldest == NULL) return;
+		gone = *oldest;
+		*oldest = gone->next;
+		cache_bytes -= gone->size;
+		log_msg (LOG_HOST, LOG_DEBUG, "archive: dropped %s", gone->path);
+		free (gone->path);
+		free (gone->member);
+		free (gone->data);
+		free (gone);
+	}
+}
+
+static int same (const char *a, const char *b) {
+	return (a == NULL) ? b == NULL : (b != NULL && !strcmp (a, b));
+}
+
+const unsigned char *archive_get (const char *path, const char *member,
+	size_t *size) {
+	cache_entry *e, **prev;
+	unsigned char *data;
+	struct stat st;
+
+	if (stat (path, &st) < 0) return NULL;
+	for (prev = &cache; (e = *prev) != NULL; prev = &e->next) {
+		if (strcmp (e->path, path) || !same (e->member, member)) continue;
+		if (e->mtime == st.st_mtime && e->file_size == st.st_size) {
+			e->users++;
+			e->used = ++clock_tick;
+			*size = e->size;
+			return e->data;
+		}
+		/* changed on the host; whoever has the old one keeps it */
+		if (e->users == 0) {
+			*prev = e->next;
+			cache_bytes -= e->size;
+			free (e->path);
+			free (e->member);
+			free (e->data);
+			free (e);
+		}
+		break;
+	}
+
+	data = ends_with (path, ".zip") ? unzip (path, member, size) :
+		gunzip (path, size);
+	if (data == NULL) return NULL;
+	log_msg (LOG_HOST, LOG_DEBUG, "archive: %s decoded, %lu bytes", path,
+		(unsigned long) *size);
+
+	e = allocate (sizeof(cache_entry));
+	e->path = strdup (path);
+	e->member = member ? strdup (member) : NULL;
+	if (e->path == NULL || (member != NULL && e->member == NULL)) {
+		fprintf (stderr, "couldn't allocate file name\n");
+		exit (1);
+	}
+	e->mtime = st.st_mtime;
+	e->file_size = st.st_size;
+	e->data = data;
+	e->size = *size;
+	e->users = 1;
+	e->used = ++clock_tick;
+	e->next = cache;
+	cache = e;
+	cache_bytes += e->size;
+	trim ();
+	return data;
+}
+
+void archive_release (const unsigned char *data) {
+	cache_entry *e;
+
+	for (e = cache; e != NULL; e = e->next)
+		if (e->data == data && e->users > 0) {
+			e->users--;
+			break;
+		}
+	trim ();
+}
@@ -0,0 +1,36 @@
+/* archive.h - compressed files and their cache for c64 emulator */
+
+#ifndef __ARCHIVE_H
+#define __ARCHIVE_H
+
+#include <stddef.h>
+
+/* how much decoded data is kept around once nobody uses it */
+#define ARCHIVE_CACHE_SIZE (64 << 20)
+
+/* true for the names archive_get decodes: .gz and .zip */
+int archive_is_compressed (const char *path);
+
+/* the decoded contents of a .gz file, or of a .zip member ('member'
+   NULL: the first one; "*.ext": the first ending in .ext), or NULL;
+   it stays put until released */
+const unsigned char *archive_get (const char *path, const char *member,
+	size_t *size);
+void archive_release (const unsigned char *data);
+
+/*
+  An archive is decoded once per process. The result goes into a cache
+  shared by everything that opens files, the disk images on every
+  device and the host-file drive alike, and is handed out in place, so
+  a compressed disk image is read like a mapped one. Decoded files stay
+  cached after their last user lets go, until the cache grows past
+  ARCHIVE_CACHE_SIZE and the one used longest ago goes. An archive that
+  changes on the host is decoded again.
+
+  gzip files are streamed through zlib straight into the cache entry,
+  which is grown as needed from the size the trailer gives. Zip files
+  are read whole, and the member is found through the central directory
+  and inflated into an entry of the size it says.
+*/
+
+#endif
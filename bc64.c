@@ -10,13 +10,79 @@
 #include "video.h"
 #include "keyboard.h"
 #include "serial.h"
+#include "disk_image.h"
+#include "disk_raw.h"
+#include "drive.h"
+#include "tape.h"
+#include "log.h"
 #include "6510.h"
+#include "watch.h"
+#include "reu.h"
+#include "heatmap.h"
+#include "search.h"
+#include "vic_defer.h"
+#include "pace.h"
+#include "input.h"
+#include "sound.h"
+#include "psid.h"
 
 static int paused = 0;
 
 static FILE *open_rom_file (char *filename);
 static char *get_home_path();
 
+/* report the memory owned by one emulated machine */
+static void print_footprint (void) {
+	int mem = mem_footprint(), vic = vic_footprint();
+	int frame = video_footprint(), reu = reu_footprint();
+
+	printf ("bytes per machine:\n");
+	printf ("  memory      %7i\n", mem);
+	printf ("  vic         %7i\n", vic);
+	printf ("  frame       %7i (allocated when first drawn)\n", frame);
+	if (reu) printf ("  reu         %7i\n", reu);
+	printf ("  total       %7i\n", mem + vic + frame + reu);
+	printf ("  shared ROM  %7i (mapped read only)\n", 0x2000 + 0x2000 + 0x1000);
+}
+
+/* keys for the emulator itself, which the c64 never sees; they work
+   during a replay and aren't recorded */
+int handle_host_key (const SDL_Event *event) {
+	if (event->type != SDL_KEYDOWN && event->type != SDL_KEYUP) return 0;
+
+	switch (event->key.keysym.sym) {
+	case SDLK_F10: case SDLK_F12: case SDLK_PRINT: case SDLK_KP_PLUS:
+	case SDLK_END:
+		break;
+	default:
+		return 0;
+	}
+	if (event->type == SDL_KEYUP) return 1;
+
+	switch (event->key.keysym.sym) {
+	case SDLK_F10: // refresh key
+		print_state();
+		paused = !paused;
+		printf ("emulator %s\n", paused ? "paused" : "unpaused");
+		break;
+	case SDLK_F12: // quit key
+		exit (0);
+		break;
+	case SDLK_PRINT:
+		video_screenshot();
+		break;
+	case SDLK_KP_PLUS: // warp key
+		video_set_warp(!video_warp());
+		break;
+	case SDLK_END: // ram search step key
+		search_key();
+		break;
+	default:
+		break;
+	}
+	return 1;
+}
+
 void handle_event (const SDL_Event *event) {
 	switch (event->type) {
 	case SDL_KEYDOWN:
@@ -24,20 +90,9 @@ void handle_event (const SDL_Event *event) {
 		case SDLK_F9: // RESTORE key
 			cpu6510_nmi();
 			break;
-		case SDLK_F10: // refresh key
-			print_state();
-			paused = !paused;
-			printf ("emulator %s\n", paused ? "paused" : "unpaused");
-			break;
 		case SDLK_F11: // reset key
 			cpu6510_reset();
 			break;
-		case SDLK_F12: // quit key
-			exit (0);
-			break;
-		case SDLK_PRINT:
-			video_screenshot();
-			break;
 		case SDLK_KP8:
 			joystick_down(0x01);
 			break;
@@ -94,22 +149,39 @@ void handle_event (const SDL_Event *event) {
 	}
 }
 
-void callback_main (void) {
-	SDL_Event event;
-	static int when = 0;
+static event *main_event;
+
+void callback_main (void *data) {
+	static cycle_t when = 0;
 	
-	while (SDL_PollEvent (&event)) handle_event (&event);
+	vic_frame_end();
+	sound_frame();
 	callback_frame();
+	heat_frame();
+	search_frame();
+	input_frame();
+	drive_frame(when);
 
-	when += 63*312;
-	cpu6510_callback (CB_MAIN, callback_main, when);
+	when += CYCLES_PER_FRAME;
+	event_schedule (main_event, when);
 }
 
 int main (int argc, char **argv)
 {
 	/* file pointers for rom images */
 	FILE *fk, *fb, *fc, *cart;
-	int j;
+	char *cart_name = NULL;
+	int j, footprint = 0, defer = VIC_DEFER_OFF, slice_lines = 39;
+	int event_thread = 0;
+	int sid_model = -1, sound_device = 1;
+	char *wav_name = NULL;
+	int psid = 0, psid_seconds = 60, psid_song = 0, jobs = 0;
+	char **names;
+	int name_count = 0;
+#ifdef MEM_HEATMAP
+	char *heat_name = NULL;
+	int heat_frames = 0, heat_per_address = 0;
+#endif
 
 	fk = open_rom_file ("kernal");
 	fb = open_rom_file ("basic");
@@ -119,17 +191,163 @@ int main (int argc, char **argv)
 	fclose (fb);
 	fclose (fc);
 
-	if (argc >= 2) cart = fopen(argv[1], "r");
+	/* parse command line options */
+	names = malloc (argc * sizeof(char *));
+	if (names == NULL) {
+		fprintf(stderr, "couldn't allocate file names\n");
+		exit(1);
+	}
+	for (j=1; j<argc; j++) {
+		if (!strcmp(argv[j], "-w") && j+1 < argc) {
+			if (watch_parse(argv[++j]) < 0) {
+				fprintf(stderr, "bad watchpoint \"%s\"\n", argv[j]);
+				exit(1);
+			}
+		}
+		else if (!strcmp(argv[j], "-reu") && j+1 < argc) {
+			if (reu_init(atoi(argv[++j])) < 0) {
+				fprintf(stderr, "couldn't allocate REU memory\n");
+				exit(1);
+			}
+		}
+		else if (!strcmp(argv[j], "-footprint"))
+			footprint = 1;
+		else if (!strcmp(argv[j], "-warp"))
+			video_set_warp(1);
+		else if (!strcmp(argv[j], "-warpframes") && j+1 < argc)
+			video_warp_frames(atoi(argv[++j]));
+		else if (!strcmp(argv[j], "-warprate") && j+1 < argc)
+			video_warp_rate(atoi(argv[++j]));
+		else if (!strcmp(argv[j], "-record") && j+1 < argc) {
+			if (input_record(argv[++j]) < 0) {
+				fprintf(stderr, "couldn't write \"%s\"\n", argv[j]);
+				exit(1);
+			}
+		}
+		else if (!strcmp(argv[j], "-replay") && j+1 < argc) {
+			if (input_replay(argv[++j]) < 0) {
+				fprintf(stderr, "couldn't read \"%s\"\n", argv[j]);
+				exit(1);
+			}
+		}
+		else if (!strcmp(argv[j], "-timing") && j+1 < argc) {
+			if (timing_select(argv[++j]) < 0) {
+				fprintf(stderr, "unknown timing \"%s\"; choose from:\n",
+					argv[j]);
+				timing_list();
+				exit(1);
+			}
+		}
+		else if (!strcmp(argv[j], "-sid") && j+1 < argc)
+			sid_model = (atoi(argv[++j]) == 8580) ? SID_8580 : SID_6581;
+		else if (!strcmp(argv[j], "-wav") && j+1 < argc)
+			wav_name = argv[++j];
+		else if (!strcmp(argv[j], "-nosound"))
+			sound_device = 0;
+		else if (argv[j][0] == '-' && atoi(argv[j] + 1) >= 8 &&
+			atoi(argv[j] + 1) <= 11 && j+1 < argc) {
+			if (image_attach(atoi(argv[j] + 1), argv[j+1]) < 0) {
+				fprintf(stderr, "\"%s\" isn't a disk image\n", argv[j+1]);
+				exit(1);
+			}
+			j++;
+		}
+		else if (!strcmp(argv[j], "-truedrive")) {
+			FILE *fd = open_rom_file ("1541");
+			drive_init (fd);
+			fclose (fd);
+		}
+		else if (!strcmp(argv[j], "-tape") && j+1 < argc) {
+			if (tape_attach(argv[++j]) < 0) {
+				fprintf(stderr, "\"%s\" isn't a tape image\n", argv[j]);
+				exit(1);
+			}
+		}
+		else if (!strcmp(argv[j], "-tapewarp"))
+			tape_set_autowarp(1);
+		else if (!strcmp(argv[j], "-log") && j+1 < argc) {
+			if (log_parse(argv[++j]) < 0) {
+				fprintf(stderr, "bad log levels \"%s\"\n", argv[j]);
+				exit(1);
+			}
+		}
+		else if (!strcmp(argv[j], "-logfile") && j+1 < argc) {
+			if (log_open(argv[++j]) < 0) {
+				fprintf(stderr, "couldn't write \"%s\"\n", argv[j]);
+				exit(1);
+			}
+		}
+		else if (!strcmp(argv[j], "-dir") && j+1 < argc)
+			raw_set_directory(argv[++j]);
+		else if (!strcmp(argv[j], "-psid"))
+			psid = 1;
+		else if (!strcmp(argv[j], "-psidtime") && j+1 < argc)
+			psid_seconds = atoi(argv[++j]);
+		else if (!strcmp(argv[j], "-song") && j+1 < argc)
+			psid_song = atoi(argv[++j]);
+		else if (!strcmp(argv[j], "-jobs") && j+1 < argc)
+			jobs = atoi(argv[++j]);
+		else if (!strcmp(argv[j], "-slice") && j+1 < argc)
+			slice_lines = atoi(argv[++j]);
+		else if (!strcmp(argv[j], "-defer"))
+			defer = VIC_DEFER_FRAME;
+		else if (!strcmp(argv[j], "-deferthread"))
+			defer = VIC_DEFER_THREAD;
+		else if ((!strcmp(argv[j], "-search") ||
+			!strcmp(argv[j], "-searchframe")) && j+1 < argc) {
+			j++;
+			if (search_parse(argv[j], !strcmp(argv[j-1], "-searchframe")) < 0) {
+				fprintf(stderr, "bad ram search \"%s\"\n", argv[j]);
+				exit(1);
+			}
+		}
+#ifdef MEM_HEATMAP
+		else if (!strcmp(argv[j], "-heat") && j+1 < argc)
+			heat_name = argv[++j];
+		else if (!strcmp(argv[j], "-heatframes") && j+1 < argc)
+			heat_frames = atoi(argv[++j]);
+		else if (!strcmp(argv[j], "-heataddr"))
+			heat_per_address = 1;
+#endif
+		else names[name_count++] = argv[j];
+	}
+
+	/* render tunes without a screen, and quit */
+	if (psid)
+		psid_render_files(names, name_count, psid_seconds, psid_song,
+			sid_model, jobs);
+	if (name_count > 0) cart_name = names[name_count - 1];
+
+	log_start();
+	watch_list();
+	if (vic_defer_init(defer) < 0) {
+		fprintf(stderr, "couldn't allocate deferred video buffers\n");
+		exit(1);
+	}
+	if (footprint) print_footprint();
+
+#ifdef MEM_HEATMAP
+	if (heat_name != NULL &&
+		heat_init(heat_name, heat_frames, heat_per_address) < 0) {
+		fprintf(stderr, "couldn't allocate heatmap counters\n");
+		exit(1);
+	}
+#endif
+
+	if (cart_name != NULL) cart = fopen(cart_name, "r");
 	else cart = NULL;
 
 	if (cart != NULL) {
-		printf("opened cartridge %s.\n", argv[1]);
+		printf("opened cartridge %s.\n", cart_name);
 		mem_load_cartridge(cart);
 		fclose(cart);
 	}
 
-	/* Initialize the SDL library */
-	if ( SDL_Init (SDL_INIT_VIDEO) < 0 ) {
+	/* Initialize the SDL library; events are collected on a thread of
+	   their own where SDL can do that */
+	if ( SDL_Init (SDL_INIT_VIDEO | SDL_INIT_EVENTTHREAD) == 0 )
+		event_thread = 1;
+	else if ( SDL_Init (SDL_INIT_VIDEO) < 0 ) {
 		fprintf (stderr, "Couldn't initialize SDL: %s\n", SDL_GetError());
 		exit (1);
 	}
@@ -139,10 +357,15 @@ int main (int argc, char **argv)
 	video_init();
 	key_init();
 	serial_init();
+	sound_init(sid_model < 0 ? SID_6581 : sid_model, 44100, sound_device,
+		wav_name);
 	
 	/* setup periodic interrupts */
-	cpu6510_callback (CB_MAIN, callback_main, 0);
-	cpu6510_callback (CB_RASTER, callback_raster, 0);
+	main_event = event_new (callback_main, NULL);
+	event_schedule (main_event, 0);
+	vic_start ();
+	pace_start (slice_lines);
+	input_start (handle_event, handle_host_key, 8, event_thread);
 
 	/* start CPU loop */
 	cpu6510_main ();
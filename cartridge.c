@@ -0,0 +1,190 @@
+/* cartridge.c - expansion port cartridges for c64 emulator */
+
+/*
+  All CHIP packets are loaded once, 16K per bank (ROML in the lower
+  half, ROMH in the upper half). A bank switch only hands new bank
+  pointers to the PLA in mem_c64.c, which reads the banks where they
+  are; nothing is copied. A chip a bank doesn't have reads as $ff.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cartridge.h"
+#include "mem_c64.h"
+
+#define MAX_BANKS 128
+#define BANK_SIZE 0x4000
+
+static int hardware = -1;
+static unsigned char *bank_data[MAX_BANKS];
+static const unsigned char *roml_bank[MAX_BANKS], *romh_bank[MAX_BANKS];
+static int banks;
+
+/* current bank and EXROM/GAME lines (1 = active) */
+static int bank, exrom, game;
+
+static int be16 (const unsigned char *p) {
+	return (p[0] << 8) | p[1];
+}
+
+static long be32 (const unsigned char *p) {
+	return ((long) p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+static void update_cartridge (void) {
+	int b = bank % banks;
+	mem_set_cartridge (roml_bank[b], romh_bank[b], exrom, game);
+}
+
+void cart_remove (void) {
+	int b;
+
+	hardware = -1;
+	mem_set_cartridge (NULL, NULL, 0, 0);
+	for (b=0; b<MAX_BANKS; b++) {
+		free (bank_data[b]);
+		bank_data[b] = NULL;
+		roml_bank[b] = romh_bank[b] = NULL;
+	}
+	banks = 0;
+}
+
+/* read all CHIP packets into their banks */
+static int load_chips (FILE *file) {
+	unsigned char chip[0x10], *data;
+	long length;
+	int b, load, size, offset;
+
+	while (fread (chip, 0x10, 1, file) == 1) {
+		if (memcmp (chip, "CHIP", 4) != 0) return -1;
+
+		length = be32 (chip + 0x04);
+		b = be16 (chip + 0x0a);
+		load = be16 (chip + 0x0c);
+		size = be16 (chip + 0x0e);
+
+		if (b >= MAX_BANKS || size > BANK_SIZE || length < 0x10 + size)
+			return -1;
+		if (b >= banks) banks = b + 1;
+
+		/* ROML lives at $8000; ROMH at $a000 or, for ultimax, $e000 */
+		offset = (load == 0x8000) ? 0 : (0x2000 + (load & 0x1fff));
+		if (offset + size > BANK_SIZE) return -1;
+
+		/* fill unused ROM with $ff, like an erased EPROM */
+		if (bank_data[b] == NULL) {
+			bank_data[b] = malloc (BANK_SIZE);
+			if (bank_data[b] == NULL) return -1;
+			memset (bank_data[b], 0xff, BANK_SIZE);
+		}
+		data = bank_data[b];
+
+		if (fread (data + offset, size, 1, file) != 1) return -1;
+		if (offset < 0x2000) roml_bank[b] = data;
+		if (offset + size > 0x2000) romh_bank[b] = data + 0x2000;
+
+		fseek (file, length - 0x10 - size, SEEK_CUR);
+	}
+	return (banks > 0) ? 0 : -1;
+}
+
+int cart_load_crt (FILE *file) {
+	unsigned char header[0x40];
+	int b;
+
+	if (fread (header, 0x40, 1, file) != 1) return -1;
+	if (memcmp (header, "C64 CARTRIDGE   ", 16) != 0) return -1;
+
+	cart_remove ();
+	hardware = be16 (header + 0x16);
+
+	switch (hardware) {
+	case CRT_NORMAL:
+	case CRT_OCEAN:
+	case CRT_MAGIC_DESK:
+	case CRT_EASYFLASH:
+		break;
+	default:
+		printf ("unsupported cartridge hardware type %i\n", hardware);
+		hardware = -1;
+		return -1;
+	}
+
+	fseek (file, be32 (header + 0x10), SEEK_SET);
+	if (load_chips (file) < 0) {
+		printf ("corrupt cartridge image\n");
+		cart_remove ();
+		return -1;
+	}
+
+	/* initial bank and lines */
+	bank = 0;
+	switch (hardware) {
+	case CRT_OCEAN:
+		/* banks without a ROMH chip mirror ROML at $a000 */
+		for (b=0; b<banks; b++)
+			if (romh_bank[b] == NULL) romh_bank[b] = roml_bank[b];
+		/* fall through */
+	case CRT_NORMAL:
+		exrom = !header[0x18];
+		game = !header[0x19];
+		break;
+	case CRT_MAGIC_DESK:
+		exrom = 1;
+		game = 0;
+		break;
+	case CRT_EASYFLASH:
+		/* boot jumper: start in ultimax mode */
+		exrom = 0;
+		game = 1;
+		break;
+	}
+
+	printf ("cartridge \"%.32s\": type %i, %i bank(s), %s mode\n",
+		header + 0x20, hardware, banks,
+		(exrom && game) ? "16K" : exrom ? "8K" : game ? "ultimax" : "off");
+
+	update_cartridge ();
+	return 0;
+}
+
+/******************** REGISTER MEMORY WRITE *************************/
+
+int cart_io1_write (int address, int value) {
+
+	switch (hardware) {
+	case CRT_OCEAN:
+		bank = value & 0x3f;
+		break;
+	case CRT_MAGIC_DESK:
+		/* bit 7 switches the cartridge off */
+		bank = value & 0x7f;
+		exrom = !(value & 0x80);
+		break;
+	case CRT_EASYFLASH:
+		if ((address & 0x02) == 0) {
+			/* $de00: bank register */
+			bank = value & 0x3f;
+		} else {
+			/* $de02: control register, GAME from jumper unless M is set */
+			exrom = (value & 0x02) != 0;
+			game = (value & 0x04) ? (value & 0x01) : 1;
+		}
+		break;
+	default:
+		return 0;
+	}
+	update_cartridge ();
+	return 1;
+}
+
+int cart_io2_write (int address, int value) {
+
+	/* EasyFlash has 256 bytes of RAM at $df00 */
+	if (hardware == CRT_EASYFLASH) {
+		mem_io_write (address, value);
+		return 1;
+	}
+	return 0;
+}
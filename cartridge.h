@@ -0,0 +1,43 @@
+/* cartridge.h - expansion port cartridges for c64 emulator */
+
+#ifndef __CARTRIDGE_H
+#define __CARTRIDGE_H
+
+#include <stdio.h>
+
+/* hardware types from the .CRT header */
+#define CRT_NORMAL      0
+#define CRT_OCEAN       5
+#define CRT_MAGIC_DESK  19
+#define CRT_EASYFLASH   32
+
+int cart_load_crt (FILE *file);
+void cart_remove (void);
+
+/* return non-zero if the cartridge handled the write */
+int cart_io1_write (int address, int value);
+int cart_io2_write (int address, int value);
+
+/*
+.CRT file layout (all multi-byte values are big endian):
+
+  header:
+  $00-$0f  "C64 CARTRIDGE   "
+  $10-$13  header length
+  $14-$15  version
+  $16-$17  hardware type
+  $18      EXROM line (0 = active)
+  $19      GAME line (0 = active)
+  $20-$3f  cartridge name
+
+  followed by any number of CHIP packets:
+  $00-$03  "CHIP"
+  $04-$07  packet length, including this header
+  $08-$09  chip type (0 = ROM, 1 = RAM, 2 = flash)
+  $0a-$0b  bank number
+  $0c-$0d  load address
+  $0e-$0f  image size
+  $10-     image data
+*/
+
+#endif
@@ -0,0 +1,460 @@
+/* cia.c - 6526 complex interface adapter for c64 emulator */
+
+#include <stdio.h>
+#include "cia.h"
+#include "timing.h"
+#include "6510.h"
+#include "log.h"
+
+/* control register bits */
+#define CR_START   0x01
+#define CR_ONESHOT 0x08
+#define CR_LOAD    0x10
+#define CRA_CNT    0x20   /* timer A counts CNT edges, not cycles */
+#define CRA_SPOUT  0x40
+#define CRA_TOD50  0x80
+#define CRB_INPUT  0x60   /* what timer B counts: cycles, CNT or timer A */
+#define CRB_TA     0x40
+#define CRB_ALARM  0x80   /* TOD writes set the alarm */
+
+#define TOD_DAY    864000 /* tenths of a second in 24 hours */
+
+/******************** TIMERS *************************/
+
+/* CNT is pulled up on the c64, so counting its edges never counts */
+static int counts_cycles (const cia *c, int n) {
+	int control = c->timer[n].control;
+
+	if (!(control & CR_START)) return 0;
+	return !(control & (n == 0 ? CRA_CNT : CRB_INPUT));
+}
+
+static int cascaded (const cia *c) {
+	return (c->timer[1].control & (CR_START | CRB_TA)) == (CR_START | CRB_TA);
+}
+
+static int timer_value (const cia *c, int n, cycle_t now) {
+	const cia_timer *t = &c->timer[n];
+
+	if (!counts_cycles (c, n)) return t->value;
+	return t->value - (int) (now - t->base);
+}
+
+/* timer B counts 'pulses' underflows of timer A */
+static void count_pulses (cia *c, cycle_t pulses) {
+	cia_timer *t = &c->timer[1];
+
+	if (pulses <= t->value) {
+		t->value -= (int) pulses;
+		return;
+	}
+
+	/* the pulse that finds the counter at zero reloads it */
+	pulses -= t->value + 1;
+	c->icr |= CIA_TIMER_B;
+	t->value = t->latch;
+	if (t->control & CR_ONESHOT) {
+		t->control &= ~CR_START;
+		return;
+	}
+	t->value = t->latch - (int) (pulses % (t->latch + 1));
+}
+
+/* account for the underflows of timer 'n' up to 'now' */
+static void catch_up (cia *c, int n, cycle_t now) {
+	cia_timer *t = &c->timer[n];
+	cycle_t first, count;
+
+	if (!counts_cycles (c, n)) return;
+
+	/* the counter reloads on the cycle after it reaches zero */
+	first = t->base + t->value + 1;
+	if (now < first) return;
+
+	if (t->control & CR_ONESHOT) {
+		count = 1;
+		t->control &= ~CR_START;
+	} else {
+		count = 1 + (now - first) / (t->latch + 1);
+	}
+	t->base = first + (count - 1) * (t->latch + 1);
+	t->value = t->latch;
+	c->icr |= (n == 0) ? CIA_TIMER_A : CIA_TIMER_B;
+
+	if (n == 0 && cascaded (c)) count_pulses (c, count);
+}
+
+/* the cycle timer 'n' will next underflow on, or -1 if it can't tell */
+static cycle_t next_underflow (const cia *c, int n) {
+	const cia_timer *a = &c->timer[0], *t = &c->timer[n];
+
+	if (counts_cycles (c, n))
+		return t->base + t->value + 1;
+
+	if (n == 1 && cascaded (c) && counts_cycles (c, 0)) {
+		if (!(a->control & CR_ONESHOT))
+			return next_underflow (c, 0) + (cycle_t) t->value * (a->latch + 1);
+		if (t->value == 0)
+			return next_underflow (c, 0);
+	}
+	return -1;
+}
+
+/******************** TIME OF DAY *************************/
+
+/* the TOD counts power line ticks, five or six to the tenth */
+static cycle_t tenth_cycles (const cia *c) {
+	int ticks = (c->timer[0].control & CRA_TOD50) ? 5 : 6;
+
+	return (cycle_t) ticks * machine.clock_hz / machine.power_hz;
+}
+
+static int tod_counted (const cia *c, cycle_t now) {
+	if (!c->tod_running) return 0;
+	return (int) ((now - c->tod_base) / tenth_cycles (c));
+}
+
+static int tod_now (const cia *c, cycle_t now) {
+	return (c->tod_start + tod_counted (c, now)) % TOD_DAY;
+}
+
+/* restart the count from 'now', keeping the time of day */
+static void tod_rebase (cia *c, cycle_t now) {
+	c->tod_start = tod_now (c, now);
+	c->tod_base = now;
+	c->tod_seen = 0;
+}
+
+/* tenths from 'from' until the alarm next matches */
+static int tenths_to_alarm (const cia *c, int from) {
+	int d = (c->tod_alarm - from) % TOD_DAY;
+
+	if (d <= 0) d += TOD_DAY;
+	return d;
+}
+
+static void tod_check_alarm (cia *c, cycle_t now) {
+	int counted = tod_counted (c, now);
+
+	if (counted <= c->tod_seen) return;
+	if (tenths_to_alarm (c, c->tod_start + c->tod_seen) <= counted - c->tod_seen)
+		c->icr |= CIA_ALARM;
+	c->tod_seen = counted;
+}
+
+static cycle_t next_alarm (const cia *c, cycle_t now) {
+	int counted = tod_counted (c, now);
+
+	if (!c->tod_running) return -1;
+	counted += tenths_to_alarm (c, c->tod_start + counted);
+	return c->tod_base + counted * tenth_cycles (c);
+}
+
+static int bcd (int n) {
+	return ((n / 10) << 4) | (n % 10);
+}
+
+static int from_bcd (int b) {
+	return (b >> 4) * 10 + (b & 0x0f);
+}
+
+/* the registers count 12 hour BCD time, with a PM flag */
+static int tod_register (int time, int reg) {
+	int hour;
+
+	switch (reg) {
+	case 0x08: return time % 10;
+	case 0x09: return bcd (time / 10 % 60);
+	case 0x0a: return bcd (time / 600 % 60);
+	}
+	hour = time / 36000;
+	return bcd ((hour % 12) ? hour % 12 : 12) | ((hour >= 12) ? 0x80 : 0);
+}
+
+static int tod_set_register (int time, int reg, int value) {
+	int tenths = time % 10, sec = time / 10 % 60;
+	int min = time / 600 % 60, hour = time / 36000;
+
+	switch (reg) {
+	case 0x08: tenths = (value & 0x0f) % 10; break;
+	case 0x09: sec = from_bcd (value & 0x7f) % 60; break;
+	case 0x0a: min = from_bcd (value & 0x7f) % 60; break;
+	case 0x0b:
+		hour = from_bcd (value & 0x1f) % 12 + ((value & 0x80) ? 12 : 0);
+		break;
+	}
+	return ((hour * 60 + min) * 60 + sec) * 10 + tenths;
+}
+
+static int tod_read (cia *c, int reg, cycle_t now) {
+	int time;
+
+	/* reading the hours freezes the registers until the tenths are read */
+	if (reg == 0x0b) c->tod_latched = tod_now (c, now);
+	time = (c->tod_latched >= 0) ? c->tod_latched : tod_now (c, now);
+	if (reg == 0x08) c->tod_latched = -1;
+	return tod_register (time, reg);
+}
+
+static void tod_write (cia *c, int reg, int value, cycle_t now) {
+	if (c->timer[1].control & CRB_ALARM) {
+		c->tod_alarm = tod_set_register (c->tod_alarm, reg, value);
+		return;
+	}
+
+	/* writing the hours stops the clock until the tenths are written */
+	tod_rebase (c, now);
+	c->tod_start = tod_set_register (c->tod_start, reg, value);
+	if (reg == 0x0b) c->tod_running = 0;
+	else if (reg == 0x08) c->tod_running = 1;
+}
+
+/******************** INTERRUPTS *************************/
+
+static void update (cia *c, cycle_t now) {
+	catch_up (c, 0, now);
+	catch_up (c, 1, now);
+	tod_check_alarm (c, now);
+}
+
+static void check_interrupt (cia *c) {
+	if (!c->asserted && (c->icr & c->mask)) {
+		c->asserted = 1;
+		log_msg (LOG_CIA, LOG_TRACE, "%s: interrupt, icr = %02x",
+			c->name, c->icr);
+		c->interrupt (c, 1);
+	}
+}
+
+static void arm_event (event *e, cycle_t when) {
+	if (when < 0) event_cancel (e);
+	else event_schedule (e, when);
+}
+
+/* schedule what the interrupt line is waiting for; once it is down,
+   nothing more can happen to it until the ICR is read */
+static void arm (cia *c, cycle_t now) {
+	int waiting = c->asserted ? 0 : c->mask;
+
+	arm_event (c->timer[0].underflow,
+		(waiting & CIA_TIMER_A) ? next_underflow (c, 0) : -1);
+	arm_event (c->timer[1].underflow,
+		(waiting & CIA_TIMER_B) ? next_underflow (c, 1) : -1);
+	arm_event (c->alarm, (waiting & CIA_ALARM) ? next_alarm (c, now) : -1);
+}
+
+static void callback_cia (void *data) {
+	cia *c = (cia *) data;
+	cycle_t now = cpu6510_clock ();
+
+	update (c, now);
+	check_interrupt (c);
+	arm (c, now);
+}
+
+void cia_flag (cia *c) {
+	c->icr |= CIA_FLAG;
+	check_interrupt (c);
+	arm (c, cpu6510_clock ());
+}
+
+/******************** REGISTER ACCESS *************************/
+
+int cia_port_output (const cia *c, int port) {
+	return (c->pr[port] | ~c->ddr[port]) & 0xff;
+}
+
+static void write_timer (cia *c, int n, int reg, int value) {
+	cia_timer *t = &c->timer[n];
+
+	if (reg == 0) {
+		t->latch = (t->latch & 0xff00) | value;
+		return;
+	}
+	t->latch = (t->latch & 0x00ff) | (value << 8);
+
+	/* a stopped timer loads the high byte straight away */
+	if (!(t->control & CR_START)) t->value = t->latch;
+}
+
+static void write_control (cia *c, int n, int value, cycle_t now) {
+	cia_timer *t = &c->timer[n];
+
+	/* freeze the count under the old mode */
+	t->value = timer_value (c, n, now);
+	t->base = now;
+
+	if (n == 0 && ((t->control ^ value) & CRA_TOD50)) tod_rebase (c, now);
+	if (value & CR_LOAD) t->value = t->latch;
+	t->control = value & ~CR_LOAD;
+
+	log_msg (LOG_CIA, LOG_TRACE,
+		"%s: control %c = %02x, timer = %i, latch = %i", c->name, 'A' + n, value, t->value, t->latch);
+}
+
+void cia_write (cia *c, int address, int value) {
+	cycle_t now = cpu6510_clock ();
+
+	/* address space only covers 4 bits */
+	address &= 0x0f;
+	update (c, now);
+
+	switch (address) {
+	case 0x00: /* ports */
+	case 0x01:
+		c->pr[address] = value;
+		c->port_out (c, address, cia_port_output (c, address));
+		break;
+	case 0x02: /* data direction: 1 = output */
+	case 0x03:
+		c->ddr[address & 1] = value;
+		c->port_out (c, address & 1, cia_port_output (c, address & 1));
+		break;
+	case 0x04: /* timer latches */
+	case 0x05:
+	case 0x06:
+	case 0x07:
+		write_timer (c, (address - 4) >> 1, address & 1, value);
+		break;
+	case 0x08: /* time of day */
+	case 0x09:
+	case 0x0a:
+	case 0x0b:
+		tod_write (c, address, value, now);
+		break;
+	case 0x0c: /* serial data: with nothing on the pins, it goes at once */
+		c->sdr = value;
+		if (c->timer[0].control & CRA_SPOUT) c->icr |= CIA_SERIAL;
+		break;
+	case 0x0d: /* interrupt control: bit 7 says set or clear */
+		if (value & 0x80) c->mask |= value & 0x1f;
+		else c->mask &= ~value;
+		break;
+	case 0x0e:
+	case 0x0f:
+		write_control (c, address - 0x0e, value, now);
+		break;
+	}
+
+	/* a source that is already flagged pulls the line after this instruction */
+	if (!c->asserted && (c->icr & c->mask)) event_schedule (c->raise, now);
+	arm (c, now);
+}
+
+unsigned char cia_read (cia *c, int address) {
+	cycle_t now = cpu6510_clock ();
+	int value;
+
+	address &= 0x0f;
+	update (c, now);
+
+	switch (address) {
+	case 0x00:
+	case 0x01:
+		return cia_port_output (c, address) & c->port_in (c, address);
+	case 0x02:
+	case 0x03:
+		return c->ddr[address & 1];
+	case 0x04:
+	case 0x05:
+	case 0x06:
+	case 0x07:
+		value = timer_value (c, (address - 4) >> 1, now);
+		return (address & 1) ? value >> 8 : value & 0xff;
+	case 0x08:
+	case 0x09:
+	case 0x0a:
+	case 0x0b:
+		return tod_read (c, address, now);
+	case 0x0c:
+		return c->sdr;
+	case 0x0d:
+		/* reading acknowledges everything */
+		value = c->icr | ((c->icr & c->mask) ? 0x80 : 0);
+		c->icr = 0;
+		if (c->asserted) {
+			c->asserted = 0;
+			c->interrupt (c, 0);
+		}
+		arm (c, now);
+		return value;
+	case 0x0e:
+		return c->timer[0].control;
+	default:
+		return c->timer[1].control;
+	}
+}
+
+/******************** INITIALIZATION *************************/
+
+void cia_reset (cia *c) {
+	cycle_t now = cpu6510_clock ();
+	int n;
+
+	c->pr[0] = c->pr[1] = c->ddr[0] = c->ddr[1] = 0;
+	c->sdr = 0;
+	for (n=0; n<2; n++) {
+		c->timer[n].latch = c->timer[n].value = 0xffff;
+		c->timer[n].control = 0;
+		c->timer[n].base = now;
+	}
+	c->icr = c->mask = 0;
+	if (c->asserted) {
+		c->asserted = 0;
+		c->interrupt (c, 0);
+	}
+	event_cancel (c->raise);
+
+	c->tod_running = 1;
+	c->tod_start = c->tod_alarm = 0;
+	c->tod_base = now;
+	c->tod_seen = 0;
+	c->tod_latched = -1;
+
+	arm (c, now);
+	c->port_out (c, 0, cia_port_output (c, 0));
+	c->port_out (c, 1, cia_port_output (c, 1));
+}
+
+void cia_init (cia *c, const char *name,
+	int (*port_in)(cia *c, int port),
+	void (*port_out)(cia *c, int port, int value),
+	void (*interrupt)(cia *c, int asserted)) {
+
+	c->name = name;
+	c->port_in = port_in;
+	c->port_out = port_out;
+	c->interrupt = interrupt;
+	c->asserted = 0;
+	c->timer[0].underflow = event_new (callback_cia, c);
+	c->timer[1].underflow = event_new (callback_cia, c);
+	c->alarm = event_new (callback_cia, c);
+	c->raise = event_new (callback_cia, c);
+	cia_reset (c);
+}
+
+/* CIA memory map
+                                REGISTER MAP
+  +---+---+---+---+---+----------+----------------------------------------+
+  |RS3|RS2|RS1|RS0|REG|   NAME   |                                        |
+  +---+---+---+---+---+----------+----------------------------------------+
+  | 0 | 0 | 0 | 0 | 0 | PRA      |  PERIPHERAL DATA REG A                 |
+  | 0 | 0 | 0 | 1 | 1 | PRB      |  PERIPHERAL DATA REG B                 |
+  | 0 | 0 | 1 | 0 | 2 | DDRA     |  DATA DIRECTION REG A                  |
+  | 0 | 0 | 1 | 1 | 3 | DDRB     |  DATA DIRECTION REG B                  |
+  | 0 | 1 | 0 | 0 | 4 | TA LO    |  TIMER A LOW REGISTER                  |
+  | 0 | 1 | 0 | 1 | 5 | TA HI    |  TIMER A HIGH REGISTER                 |
+  | 0 | 1 | 1 | 0 | 6 | TB LO    |  TIMER B LOW REGISTER                  |
+  | 0 | 1 | 1 | 1 | 7 | TB HI    |  TIMER B HIGH REGISTER                 |
+  | 1 | 0 | 0 | 0 | 8 | TOD 10THS|  10THS OF SECONDS REGISTER             |
+  | 1 | 0 | 0 | 1 | 9 | TOD SEC  |  SECONDS REGISTER                      |
+  | 1 | 0 | 1 | 0 | A | TOD MIN  |  MINUTES REGISTER                      |
+  | 1 | 0 | 1 | 1 | B | TOD HR   |  HOURS-AM/PM REGISTER                  |
+  | 1 | 1 | 0 | 0 | C | SDR      |  SERIAL DATA REGISTER                  |
+  | 1 | 1 | 0 | 1 | D | ICR      |  INTERRUPT CONTROL REGISTER            |
+  | 1 | 1 | 1 | 0 | E | CRA      |  CONTROL REG A                         |
+  | 1 | 1 | 1 | 1 | F | CRB      |  CONTROL REG B                         |
+  +---+---+---+---+---+----------+----------------------------------------+
+
+  from C64 PRG, pp.428
+*/
@@ -0,0 +1,75 @@
+/* cia.h - 6526 complex interface adapter for c64 emulator */
+
+#ifndef __CIA_H
+#define __CIA_H
+
+#include "event.h"
+
+/* interrupt sources, as bits of the interrupt control register */
+#define CIA_TIMER_A 0x01
+#define CIA_TIMER_B 0x02
+#define CIA_ALARM   0x04
+#define CIA_SERIAL  0x08
+#define CIA_FLAG    0x10
+
+typedef struct cia_timer_s {
+	int latch;
+	int control;       /* CRA or CRB, without the load strobe */
+	int value;         /* counter at 'base', or while not counting cycles */
+	cycle_t base;
+	event *underflow;  /* armed only when somebody waits for one */
+} cia_timer;
+
+typedef struct cia_s cia;
+
+struct cia_s {
+	const char *name;
+	unsigned char pr[2], ddr[2];
+	unsigned char sdr;
+	cia_timer timer[2];
+	int icr;           /* interrupt sources seen since the last read */
+	int mask;          /* sources that pull the interrupt line */
+	int asserted;
+	event *raise;      /* pulls the line once the cpu is between instructions */
+
+	/* time of day, in tenths of a second since midnight */
+	int tod_running;
+	int tod_start;     /* the time of day at cycle 'tod_base' */
+	cycle_t tod_base;
+	int tod_seen;      /* tenths counted when the alarm was last checked */
+	int tod_latched;   /* time read from the hours register, or -1 */
+	int tod_alarm;
+	event *alarm;
+
+	/* the machine around the chip */
+	int (*port_in)(cia *c, int port);           /* levels driven onto the pins */
+	void (*port_out)(cia *c, int port, int value);
+	void (*interrupt)(cia *c, int asserted);
+};
+
+void cia_init (cia *c, const char *name,
+	int (*port_in)(cia *c, int port),
+	void (*port_out)(cia *c, int port, int value),
+	void (*interrupt)(cia *c, int asserted));
+void cia_reset (cia *c);
+
+void cia_write (cia *c, int address, int value);
+unsigned char cia_read (cia *c, int address);
+
+/* a negative edge on the FLAG pin */
+void cia_flag (cia *c);
+
+/* the output of a port: inputs read high, as they are pulled up */
+int cia_port_output (const cia *c, int port);
+
+/*
+  Nothing in here runs per cycle. A counting timer is just the cycle it
+  was last (re)loaded at, and its value is worked out from the cpu clock
+  when it is read; underflows that happened since are counted the same
+  way, including timer B counting those of timer A. The scheduler is only
+  used for underflows and alarms that somebody waits for, i.e. the ones
+  that are unmasked in the interrupt control register; the rest is
+  caught up on the next access.
+*/
+
+#endif
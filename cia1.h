@@ -5,8 +5,10 @@
    system specific stuff goes in keyboard.c */
 
 void cia1_mem_write(int address, int data);
+unsigned char cia1_mem_read(int address);
 
 void cia1_init ();
 void cia1_set_joysticks(int joy1, int joy2);
 
-unsigned char cia1_mem_read(int address);
+/* a pulse from the cassette read line */
+void cia1_flag(void);
@@ -0,0 +1,47 @@
+/* cia2.c - serial bus and VIC bank port for c64 emulator */
+
+#include <stdio.h>
+#include "cia2.h"
+#include "cia.h"
+#include "mem_c64.h"
+#include "6510.h"
+#include "drive.h"
+
+static cia chip;
+
+/* port A bits 6 and 7 read the serial bus; nothing is on the user port */
+static int cia2_port_in(cia *c, int port) {
+	if (port == 0) return drive_bus_read(cpu6510_clock());
+	return 0xff;
+}
+
+/* port A bits 0 and 1 select the VIC bank, inverted; bits 3 to 5 pull
+   the serial bus lines */
+static void cia2_port_out(cia *c, int port, int value) {
+	if (port == 0) {
+		mem_set_video_bank(value);
+		drive_bus_write(cpu6510_clock(), value);
+	}
+}
+
+/* CIA2 drives the NMI line, which only reacts to the falling edge */
+static void cia2_interrupt(cia *c, int asserted) {
+	if (asserted) cpu6510_nmi();
+}
+
+
+/******************** REGISTER MEMORY ACCESS *************************/
+
+void cia2_mem_write(int address, int data) {
+	cia_write(&chip, address, data);
+}
+
+unsigned char cia2_mem_read(int address) {
+	return cia_read(&chip, address);
+}
+
+
+/******************** INITIALIZATION ********************/
+void cia2_init(void) {
+	cia_init(&chip, "CIA2", cia2_port_in, cia2_port_out, cia2_interrupt);
+}
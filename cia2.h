@@ -0,0 +1,11 @@
+/* cia2.h - serial bus and VIC bank port for c64 emulator */
+
+#ifndef __CIA2_H
+#define __CIA2_H
+
+void cia2_mem_write(int address, int data);
+unsigned char cia2_mem_read(int address);
+
+void cia2_init(void);
+
+#endif
@@ -0,0 +1,437 @@
+/* cpu6502.c - 6502 core for the disk drive of c64 emulator */
+
+#include <stdio.h>
+#include <string.h>
+#include "cpu6502.h"
+
+#define C_FLAG 0x01
+#define Z_FLAG 0x02
+#define I_FLAG 0x04
+#define D_FLAG 0x08
+#define B_FLAG 0x10
+#define U_FLAG 0x20
+#define V_FLAG 0x40
+#define N_FLAG 0x80
+
+/******************** MEMORY *************************/
+
+inline static int rd (cpu6502 *c, int address) {
+	const unsigned char *page = c->read_page[address >> 8];
+
+	if (page != NULL) return page[address & 0xff];
+	return c->io_read (c, address);
+}
+
+inline static void wr (cpu6502 *c, int address, int value) {
+	unsigned char *page = c->write_page[address >> 8];
+
+	if (page != NULL) page[address & 0xff] = value;
+	else if (c->read_page[address >> 8] == NULL) c->io_write (c, address, value);
+}
+
+inline static int fetch (cpu6502 *c) {
+	int value = rd (c, c->pc);
+	c->pc = (c->pc + 1) & 0xffff;
+	return value;
+}
+
+inline static int fetch16 (cpu6502 *c) {
+	int lo = fetch (c);
+	return lo | (fetch (c) << 8);
+}
+
+inline static void push (cpu6502 *c, int value) {
+	wr (c, 0x100 | c->s, value);
+	c->s = (c->s - 1) & 0xff;
+}
+
+inline static int pull (cpu6502 *c) {
+	c->s = (c->s + 1) & 0xff;
+	return rd (c, 0x100 | c->s);
+}
+
+/******************** ADDRESSING *************************/
+
+/* indexed reads take a cycle more when they cross a page; only ever
+   looked at within one cpu6502_step */
+static int extra;
+
+inline static int a_zp (cpu6502 *c) { return fetch (c); }
+inline static int a_zpx (cpu6502 *c) { return (fetch (c) + c->x) & 0xff; }
+inline static int a_zpy (cpu6502 *c) { return (fetch (c) + c->y) & 0xff; }
+inline static int a_abs (cpu6502 *c) { return fetch16 (c); }
+
+inline static int a_index (int base, int index) {
+	int address = base + index;
+	if ((address ^ base) & 0x100) extra = 1;
+	return address & 0xffff;
+}
+
+inline static int a_absx (cpu6502 *c) { return a_index (fetch16 (c), c->x); }
+inline static int a_absy (cpu6502 *c) { return a_index (fetch16 (c), c->y); }
+
+inline static int a_indx (cpu6502 *c) {
+	int z = (fetch (c) + c->x) & 0xff;
+	return rd (c, z) | (rd (c, (z + 1) & 0xff) << 8);
+}
+
+inline static int a_indy (cpu6502 *c) {
+	int z = fetch (c);
+	return a_index (rd (c, z) | (rd (c, (z + 1) & 0xff) << 8), c->y);
+}
+
+/******************** OPERATIONS *************************/
+
+inline static int nz (cpu6502 *c, int value) {
+	c->p &= ~(N_FLAG | Z_FLAG);
+	c->p |= value & N_FLAG;
+	if (value == 0) c->p |= Z_FLAG;
+	return value;
+}
+
+inline static void adc (cpu6502 *c, int value) {
+	int carry = c->p & C_FLAG, result, lo, hi;
+
+	if (c->p & D_FLAG) {
+		lo = (c->a & 0x0f) + (value & 0x0f) + carry;
+		hi = (c->a & 0xf0) + (value & 0xf0);
+		if (lo > 0x09) { lo += 0x06; hi += 0x10; }
+		c->p &= ~(N_FLAG | V_FLAG | Z_FLAG | C_FLAG);
+		if (((c->a + value + carry) & 0xff) == 0) c->p |= Z_FLAG;
+		c->p |= hi & N_FLAG;
+		if (~(c->a ^ value) & (c->a ^ hi) & 0x80) c->p |= V_FLAG;
+		if (hi > 0x90) hi += 0x60;
+		if (hi > 0xff) c->p |= C_FLAG;
+		c->a = (lo & 0x0f) | (hi & 0xf0);
+		return;
+	}
+	result = c->a + value + carry;
+	c->p &= ~(V_FLAG | C_FLAG);
+	if (~(c->a ^ value) & (c->a ^ result) & 0x80) c->p |= V_FLAG;
+	if (result > 0xff) c->p |= C_FLAG;
+	c->a = nz (c, result & 0xff);
+}
+
+inline static void sbc (cpu6502 *c, int value) {
+	int borrow = (c->p & C_FLAG) ^ C_FLAG, result, lo, hi;
+
+	result = c->a - value - borrow;
+	if (c->p & D_FLAG) {
+		lo = (c->a & 0x0f) - (value & 0x0f) - borrow;
+		hi = (c->a & 0xf0) - (value & 0xf0);
+		if (lo & 0x10) { lo -= 6; hi -= 0x10; }
+		if (hi & 0x100) hi -= 0x60;
+		c->p &= ~(V_FLAG | C_FLAG);
+		if ((c->a ^ value) & (c->a ^ result) & 0x80) c->p |= V_FLAG;
+		if (result >= 0) c->p |= C_FLAG;
+		nz (c, result & 0xff);
+		c->a = (lo & 0x0f) | (hi & 0xf0);
+		return;
+	}
+	c->p &= ~(V_FLAG | C_FLAG);
+	if ((c->a ^ value) & (c->a ^ result) & 0x80) c->p |= V_FLAG;
+	if (result >= 0) c->p |= C_FLAG;
+	c->a = nz (c, result & 0xff);
+}
+
+inline static void compare (cpu6502 *c, int reg, int value) {
+	c->p &= ~C_FLAG;
+	if (reg >= value) c->p |= C_FLAG;
+	nz (c, (reg - value) & 0xff);
+}
+
+inline static void bit (cpu6502 *c, int value) {
+	c->p &= ~(N_FLAG | V_FLAG | Z_FLAG);
+	c->p |= value & (N_FLAG | V_FLAG);
+	if ((c->a & value) == 0) c->p |= Z_FLAG;
+}
+
+inline static int asl (cpu6502 *c, int value) {
+	c->p = (c->p & ~C_FLAG) | (value >> 7);
+	return nz (c, (value << 1) & 0xff);
+}
+
+inline static int lsr (cpu6502 *c, int value) {
+	c->p = (c->p & ~C_FLAG) | (value & 1);
+	return nz (c, value >> 1);
+}
+
+inline static int rol (cpu6502 *c, int value) {
+	int result = ((value << 1) | (c->p & C_FLAG)) & 0xff;
+	c->p = (c->p & ~C_FLAG) | (value >> 7);
+	return nz (c, result);
+}
+
+inline static int ror (cpu6502 *c, int value) {
+	int result = (value >> 1) | ((c->p & C_FLAG) << 7);
+	c->p = (c->p & ~C_FLAG) | (value & 1);
+	return nz (c, result);
+}
+
+/* read-modify-write, with the dummy write of the old value */
+#define RMW(op, address) do { \
+	int a_ = (address), v_ = rd (c, a_); \
+	wr (c, a_, v_); \
+	wr (c, a_, op (c, v_)); \
+} while (0)
+
+inline static int inc (cpu6502 *c, int value) { return nz (c, (value + 1) & 0xff); }
+inline static int dec (cpu6502 *c, int value) { return nz (c, (value - 1) & 0xff); }
+
+inline static int branch (cpu6502 *c, int taken) {
+	int offset = fetch (c), target;
+
+	if (!taken) return 2;
+	target = (c->pc + (signed char) offset) & 0xffff;
+	offset = ((target ^ c->pc) & 0x100) ? 4 : 3;
+	c->pc = target;
+	return offset;
+}
+
+static void interrupt (cpu6502 *c, int vector, int brk) {
+	push (c, c->pc >> 8);
+	push (c, c->pc & 0xff);
+	push (c, c->p | U_FLAG | (brk ? B_FLAG : 0));
+	c->p |= I_FLAG;
+	c->pc = rd (c, vector) | (rd (c, vector + 1) << 8);
+}
+
+/******************** EXECUTION *************************/
+
+void cpu6502_reset (cpu6502 *c) {
+	c->a = c->x = c->y = 0;
+	c->s = 0xfd;
+	c->p = U_FLAG | I_FLAG;
+	c->irq = 0;
+	c->pc = rd (c, 0xfffc) | (rd (c, 0xfffd) << 8);
+}
+
+void cpu6502_set_overflow (cpu6502 *c) {
+	c->p |= V_FLAG;
+}
+
+int cpu6502_step (cpu6502 *c) {
+	int opcode, cycles, t;
+
+	if (c->irq && !(c->p & I_FLAG)) {
+		interrupt (c, 0xfffe, 0);
+		c->clock += 7;
+		return 7;
+	}
+
+	extra = 0;
+	opcode = fetch (c);
+	switch (opcode) {
+	/* loads and stores */
+	case 0xa9: c->a = nz (c, fetch (c)); cycles = 2; break;
+	case 0xa5: c->a = nz (c, rd (c, a_zp (c))); cycles = 3; break;
+	case 0xb5: c->a = nz (c, rd (c, a_zpx (c))); cycles = 4; break;
+	case 0xad: c->a = nz (c, rd (c, a_abs (c))); cycles = 4; break;
+	case 0xbd: c->a = nz (c, rd (c, a_absx (c))); cycles = 4; break;
+	case 0xb9: c->a = nz (c, rd (c, a_absy (c))); cycles = 4; break;
+	case 0xa1: c->a = nz (c, rd (c, a_indx (c))); cycles = 6; break;
+	case 0xb1: c->a = nz (c, rd (c, a_indy (c))); cycles = 5; break;
+	case 0xa2: c->x = nz (c, fetch (c)); cycles = 2; break;
+	case 0xa6: c->x = nz (c, rd (c, a_zp (c))); cycles = 3; break;
+	case 0xb6: c->x = nz (c, rd (c, a_zpy (c))); cycles = 4; break;
+	case 0xae: c->x = nz (c, rd (c, a_abs (c))); cycles = 4; break;
+	case 0xbe: c->x = nz (c, rd (c, a_absy (c))); cycles = 4; break;
+	case 0xa0: c->y = nz (c, fetch (c)); cycles = 2; break;
+	case 0xa4: c->y = nz (c, rd (c, a_zp (c))); cycles = 3; break;
+	case 0xb4: c->y = nz (c, rd (c, a_zpx (c))); cycles = 4; break;
+	case 0xac: c->y = nz (c, rd (c, a_abs (c))); cycles = 4; break;
+	case 0xbc: c->y = nz (c, rd (c, a_absx (c))); cycles = 4; break;
+	case 0x85: wr (c, a_zp (c), c->a); cycles = 3; break;
+	case 0x95: wr (c, a_zpx (c), c->a); cycles = 4; break;
+	case 0x8d: wr (c, a_abs (c), c->a); cycles = 4; break;
+	case 0x9d: wr (c, a_absx (c), c->a); cycles = 5; extra = 0; break;
+	case 0x99: wr (c, a_absy (c), c->a); cycles = 5; extra = 0; break;
+	case 0x81: wr (c, a_indx (c), c->a); cycles = 6; break;
+	case 0x91: wr (c, a_indy (c), c->a); cycles = 6; extra = 0; break;
+	case 0x86: wr (c, a_zp (c), c->x); cycles = 3; break;
+	case 0x96: wr (c, a_zpy (c), c->x); cycles = 4; break;
+	case 0x8e: wr (c, a_abs (c), c->x); cycles = 4; break;
+	case 0x84: wr (c, a_zp (c), c->y); cycles = 3; break;
+	case 0x94: wr (c, a_zpx (c), c->y); cycles = 4; break;
+	case 0x8c: wr (c, a_abs (c), c->y); cycles = 4; break;
+
+	/* transfers */
+	case 0xaa: c->x = nz (c, c->a); cycles = 2; break;
+	case 0xa8: c->y = nz (c, c->a); cycles = 2; break;
+	case 0x8a: c->a = nz (c, c->x); cycles = 2; break;
+	case 0x98: c->a = nz (c, c->y); cycles = 2; break;
+	case 0xba: c->x = nz (c, c->s); cycles = 2; break;
+	case 0x9a: c->s = c->x; cycles = 2; break;
+
+	/* stack */
+	case 0x48: push (c, c->a); cycles = 3; break;
+	case 0x08: push (c, c->p | U_FLAG | B_FLAG); cycles = 3; break;
+	case 0x68: c->a = nz (c, pull (c)); cycles = 4; break;
+	case 0x28: c->p = (pull (c) | U_FLAG) & ~B_FLAG; cycles = 4; break;
+
+	/* arithmetic and logic */
+	case 0x69: adc (c, fetch (c)); cycles = 2; break;
+	case 0x65: adc (c, rd (c, a_zp (c))); cycles = 3; break;
+	case 0x75: adc (c, rd (c, a_zpx (c))); cycles = 4; break;
+	case 0x6d: adc (c, rd (c, a_abs (c))); cycles = 4; break;
+	case 0x7d: adc (c, rd (c, a_absx (c))); cycles = 4; break;
+	case 0x79: adc (c, rd (c, a_absy (c))); cycles = 4; break;
+	case 0x61: adc (c, rd (c, a_indx (c))); cycles = 6; break;
+	case 0x71: adc (c, rd (c, a_indy (c))); cycles = 5; break;
+	case 0xe9: sbc (c, fetch (c)); cycles = 2; break;
+	case 0xe5: sbc (c, rd (c, a_zp (c))); cycles = 3; break;
+	case 0xf5: sbc (c, rd (c, a_zpx (c))); cycles = 4; break;
+	case 0xed: sbc (c, rd (c, a_abs (c))); cycles = 4; break;
+	case 0xfd: sbc (c, rd (c, a_absx (c))); cycles = 4; break;
+	case 0xf9: sbc (c, rd (c, a_absy (c))); cycles = 4; break;
+	case 0xe1: sbc (c, rd (c, a_indx (c))); cycles = 6; break;
+	case 0xf1: sbc (c, rd (c, a_indy (c))); cycles = 5; break;
+	case 0x29: c->a = nz (c, c->a & fetch (c)); cycles = 2; break;
+	case 0x25: c->a = nz (c, c->a & rd (c, a_zp (c))); cycles = 3; break;
+	case 0x35: c->a = nz (c, c->a & rd (c, a_zpx (c))); cycles = 4; break;
+	case 0x2d: c->a = nz (c, c->a & rd (c, a_abs (c))); cycles = 4; break;
+	case 0x3d: c->a = nz (c, c->a & rd (c, a_absx (c))); cycles = 4; break;
+	case 0x39: c->a = nz (c, c->a & rd (c, a_absy (c))); cycles = 4; break;
+	case 0x21: c->a = nz (c, c->a & rd (c, a_indx (c))); cycles = 6; break;
+	case 0x31: c->a = nz (c, c->a & rd (c, a_indy (c))); cycles = 5; break;
+	case 0x09: c->a = nz (c, c->a | fetch (c)); cycles = 2; break;
+	case 0x05: c->a = nz (c, c->a | rd (c, a_zp (c))); cycles = 3; break;
+	case 0x15: c->a = nz (c, c->a | rd (c, a_zpx (c))); cycles = 4; break;
+	case 0x0d: c->a = nz (c, c->a | rd (c, a_abs (c))); cycles = 4; break;
+	case 0x1d: c->a = nz (c, c->a | rd (c, a_absx (c))); cycles = 4; break;
+	case 0x19: c->a = nz (c, c->a | rd (c, a_absy (c))); cycles = 4; break;
+	case 0x01: c->a = nz (c, c->a | rd (c, a_indx (c))); cycles = 6; break;
+	case 0x11: c->a = nz (c, c->a | rd (c, a_indy (c))); cycles = 5; break;
+	case 0x49: c->a = nz (c, c->a ^ fetch (c)); cycles = 2; break;
+	case 0x45: c->a = nz (c, c->a ^ rd (c, a_zp (c))); cycles = 3; break;
+	case 0x55: c->a = nz (c, c->a ^ rd (c, a_zpx (c))); cycles = 4; break;
+	case 0x4d: c->a = nz (c, c->a ^ rd (c, a_abs (c))); cycles = 4; break;
+	case 0x5d: c->a = nz (c, c->a ^ rd (c, a_absx (c))); cycles = 4; break;
+	case 0x59: c->a = nz (c, c->a ^ rd (c, a_absy (c))); cycles = 4; break;
+	case 0x41: c->a = nz (c, c->a ^ rd (c, a_indx (c))); cycles = 6; break;
+	case 0x51: c->a = nz (c, c->a ^ rd (c, a_indy (c))); cycles = 5; break;
+	case 0xc9: compare (c, c->a, fetch (c)); cycles = 2; break;
+	case 0xc5: compare (c, c->a, rd (c, a_zp (c))); cycles = 3; break;
+	case 0xd5: compare (c, c->a, rd (c, a_zpx (c))); cycles = 4; break;
+	case 0xcd: compare (c, c->a, rd (c, a_abs (c))); cycles = 4; break;
+	case 0xdd: compare (c, c->a, rd (c, a_absx (c))); cycles = 4; break;
+	case 0xd9: compare (c, c->a, rd (c, a_absy (c))); cycles = 4; break;
+	case 0xc1: compare (c, c->a, rd (c, a_indx (c))); cycles = 6; break;
+	case 0xd1: compare (c, c->a, rd (c, a_indy (c))); cycles = 5; break;
+	case 0xe0: compare (c, c->x, fetch (c)); cycles = 2; break;
+	case 0xe4: compare (c, c->x, rd (c, a_zp (c))); cycles = 3; break;
+	case 0xec: compare (c, c->x, rd (c, a_abs (c))); cycles = 4; break;
+	case 0xc0: compare (c, c->y, fetch (c)); cycles = 2; break;
+	case 0xc4: compare (c, c->y, rd (c, a_zp (c))); cycles = 3; break;
+	case 0xcc: compare (c, c->y, rd (c, a_abs (c))); cycles = 4; break;
+	case 0x24: bit (c, rd (c, a_zp (c))); cycles = 3; break;
+	case 0x2c: bit (c, rd (c, a_abs (c))); cycles = 4; break;
+
+	/* increments and shifts */
+	case 0xe8: c->x = nz (c, (c->x + 1) & 0xff); cycles = 2; break;
+	case 0xc8: c->y = nz (c, (c->y + 1) & 0xff); cycles = 2; break;
+	case 0xca: c->x = nz (c, (c->x - 1) & 0xff); cycles = 2; break;
+	case 0x88: c->y = nz (c, (c->y - 1) & 0xff); cycles = 2; break;
+	case 0xe6: RMW (inc, a_zp (c)); cycles = 5; break;
+	case 0xf6: RMW (inc, a_zpx (c)); cycles = 6; break;
+	case 0xee: RMW (inc, a_abs (c)); cycles = 6; break;
+	case 0xfe: RMW (inc, a_absx (c)); cycles = 7; extra = 0; break;
+	case 0xc6: RMW (dec, a_zp (c)); cycles = 5; break;
+	case 0xd6: RMW (dec, a_zpx (c)); cycles = 6; break;
+	case 0xce: RMW (dec, a_abs (c)); cycles = 6; break;
+	case 0xde: RMW (dec, a_absx (c)); cycles = 7; extra = 0; break;
+	case 0x0a: c->a = asl (c, c->a); cycles = 2; break;
+	case 0x06: RMW (asl, a_zp (c)); cycles = 5; break;
+	case 0x16: RMW (asl, a_zpx (c)); cycles = 6; break;
+	case 0x0e: RMW (asl, a_abs (c)); cycles = 6; break;
+	case 0x1e: RMW (asl, a_absx (c)); cycles = 7; extra = 0; break;
+	case 0x4a: c->a = lsr (c, c->a); cycles = 2; break;
+	case 0x46: RMW (lsr, a_zp (c)); cycles = 5; break;
+	case 0x56: RMW (lsr, a_zpx (c)); cycles = 6; break;
+	case 0x4e: RMW (lsr, a_abs (c)); cycles = 6; break;
+	case 0x5e: RMW (lsr, a_absx (c)); cycles = 7; extra = 0; break;
+	case 0x2a: c->a = rol (c, c->a); cycles = 2; break;
+	case 0x26: RMW (rol, a_zp (c)); cycles = 5; break;
+	case 0x36: RMW (rol, a_zpx (c)); cycles = 6; break;
+	case 0x2e: RMW (rol, a_abs (c)); cycles = 6; break;
+	case 0x3e: RMW (rol, a_absx (c)); cycles = 7; extra = 0; break;
+	case 0x6a: c->a = ror (c, c->a); cycles = 2; break;
+	case 0x66: RMW (ror, a_zp (c)); cycles = 5; break;
+	case 0x76: RMW (ror, a_zpx (c)); cycles = 6; break;
+	case 0x6e: RMW (ror, a_abs (c)); cycles = 6; break;
+	case 0x7e: RMW (ror, a_absx (c)); cycles = 7; extra = 0; break;
+
+	/* jumps and branches */
+	case 0x4c: c->pc = fetch16 (c); cycles = 3; break;
+	case 0x6c:
+		/* the pointer doesn't carry into its high byte */
+		t = fetch16 (c);
+		c->pc = rd (c, t) | (rd (c, (t & 0xff00) | ((t + 1) & 0xff)) << 8);
+		cycles = 5;
+		break;
+	case 0x20:
+		t = fetch16 (c);
+		c->pc = (c->pc - 1) & 0xffff;
+		push (c, c->pc >> 8);
+		push (c, c->pc & 0xff);
+		c->pc = t;
+		cycles = 6;
+		break;
+	case 0x60:
+		t = pull (c);
+		c->pc = ((t | (pull (c) << 8)) + 1) & 0xffff;
+		cycles = 6;
+		break;
+	case 0x40:
+		c->p = (pull (c) | U_FLAG) & ~B_FLAG;
+		t = pull (c);
+		c->pc = t | (pull (c) << 8);
+		cycles = 6;
+		break;
+	case 0x00:
+		c->pc = (c->pc + 1) & 0xffff;
+		interrupt (c, 0xfffe, 1);
+		cycles = 7;
+		break;
+	case 0x10: cycles = branch (c, !(c->p & N_FLAG)); break;
+	case 0x30: cycles = branch (c, c->p & N_FLAG); break;
+	case 0x50: cycles = branch (c, !(c->p & V_FLAG)); break;
+	case 0x70: cycles = branch (c, c->p & V_FLAG); break;
+	case 0x90: cycles = branch (c, !(c->p & C_FLAG)); break;
+	case 0xb0: cycles = branch (c, c->p & C_FLAG); break;
+	case 0xd0: cycles = branch (c, !(c->p & Z_FLAG)); break;
+	case 0xf0: cycles = branch (c, c->p & Z_FLAG); break;
+
+	/* flags */
+	case 0x18: c->p &= ~C_FLAG; cycles = 2; break;
+	case 0x38: c->p |= C_FLAG; cycles = 2; break;
+	case 0x58: c->p &= ~I_FLAG; cycles = 2; break;
+	case 0x78: c->p |= I_FLAG; cycles = 2; break;
+	case 0xb8: c->p &= ~V_FLAG; cycles = 2; break;
+	case 0xd8: c->p &= ~D_FLAG; cycles = 2; break;
+	case 0xf8: c->p |= D_FLAG; cycles = 2; break;
+	case 0xea: cycles = 2; break;
+
+	/* the undocumented ones that jam: stay put */
+	case 0x02: case 0x12: case 0x22: case 0x32: case 0x42: case 0x52:
+	case 0x62: case 0x72: case 0x92: case 0xb2: case 0xd2: case 0xf2:
+		c->pc = (c->pc - 1) & 0xffff;
+		cycles = 2;
+		break;
+
+	/* the rest as NOPs, skipping their operands */
+	default:
+		t = (opcode >> 2) & 7;
+		if (t == 3 || t == 7 || (t == 6 && (opcode & 3) == 3)) {
+			fetch16 (c);
+			cycles = 4;
+		} else if (t != 6) {
+			fetch (c);
+			cycles = 3;
+		} else cycles = 2;
+	}
+
+	cycles += extra;
+	c->clock += cycles;
+	return cycles;
+}
@@ -0,0 +1,47 @@
+/* cpu6502.h - 6502 core for the disk drive of c64 emulator */
+
+#ifndef __CPU6502_H
+#define __CPU6502_H
+
+#include "event.h"
+
+typedef struct cpu6502_s cpu6502;
+
+struct cpu6502_s {
+	/* processor registers */
+	int pc, a, x, y, s, p;
+
+	/* cycles run since reset */
+	cycle_t clock;
+
+	/* the level of the IRQ line, set by the chips around it */
+	int irq;
+
+	/* pages that are plain memory; NULL ones go through io_read/io_write */
+	const unsigned char *read_page[0x100];
+	unsigned char *write_page[0x100];
+	int (*io_read)(cpu6502 *c, int address);
+	void (*io_write)(cpu6502 *c, int address, int value);
+	void *data;
+};
+
+void cpu6502_reset (cpu6502 *c);
+
+/* run one instruction (or take an interrupt); returns its cycles */
+int cpu6502_step (cpu6502 *c);
+
+/* the SO pin: sets the overflow flag */
+void cpu6502_set_overflow (cpu6502 *c);
+
+/*
+  The drive's processor is a plain 6502 with no port at $00/$01 and
+  none of the highlevel routines, so it gets a core of its own that can
+  have as many instances as there are drives. Memory is a table of
+  pages: RAM and ROM are read and written straight through it, and only
+  the pages left empty, the I/O chips, cost a call.
+
+  Undocumented opcodes run as NOPs of the right length, except for the
+  ones that jam the processor, which leave it stuck at that address.
+*/
+
+#endif
@@ -0,0 +1,529 @@
+/* disk_image.c - D64/D71/D81 disk image driver for c64 emulator */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "disk_image.h"
+#include "disk_raw.h"
+#include "archive.h"
+#include "log.h"
+
+#define FIRST_UNIT 8
+#define UNITS 4
+
+#define SECTOR_SIZE 256
+#define ENTRY_SIZE 32
+#define NAME_SIZE 16
+
+enum { D64, D71, D81 };
+
+typedef struct {
+	const unsigned char *data;	/* the part of the image being read */
+	int pos, end;			/* next byte in it, and the last one */
+	int track, sector;		/* where the chain goes next; 0: nowhere */
+	int links;			/* sectors followed, to stop at loops */
+	unsigned char *listing;		/* LOAD"$", which is the only copy */
+} image_channel;
+
+typedef struct {
+	const unsigned char *image;
+	size_t size;
+	int cached;			/* from the archive cache, not mapped */
+	int format, tracks, sectors;
+	int dir_track, dir_sector;
+	const unsigned char *header;	/* disk name and id */
+	image_channel channel[16];
+	char status[48];
+	int status_pos;
+} image_unit;
+
+/* sizes the formats come in, with and without error bytes */
+static const struct {
+	size_t size;
+	int format, tracks;
+} sizes[] = {
+	{174848, D64, 35}, {175531, D64, 35},
+	{196608, D64, 40}, {197376, D64, 40},
+	{349696, D71, 70}, {351062, D71, 70},
+	{819200, D81, 80}, {822400, D81, 80}
+};
+
+static image_unit *units[UNITS];
+
+/* first sector of each 1541 track */
+static int track_start[41];
+
+static const char *type_names[8] = {
+	"DEL", "SEQ", "PRG", "USR", "REL", "CBM", "DIR", "???"
+};
+
+static int image_open  (void *unit, int channel, const char *command);
+static int image_close (void *unit, int channel);
+static int image_read  (void *unit, int channel);
+static int image_write (void *unit, int channel, int size, const char *data);
+static int image_read_block (void *unit, int channel,
+	const unsigned char **data);
+
+/* the disk driver interface */
+const DiskDriver disk_image = {image_open, image_close, image_read, image_write,
+	image_read_block};
+
+/******************** GEOMETRY *************************/
+
+static int sectors_per_track (int track) {
+	if (track <= 17) return 21;
+	if (track <= 24) return 19;
+	if (track <= 30) return 18;
+	return 17;
+}
+
+static void init_tracks () {
+	int t;
+
+	track_start[1] = 0;
+	for (t = 1; t < 40; t++)
+		track_start[t + 1] = track_start[t] + sectors_per_track (t);
+}
+
+/* where track and sector are in the image, or NULL if they aren't */
+static const unsigned char *sector (image_unit *u, int track, int sector) {
+	int side = 0;
+	long n;
+
+	if (track < 1 || track > u->tracks || sector < 0) return NULL;
+	if (u->format == D81) {
+		if (sector >= 40) return NULL;
+		n = (track - 1) * 40L + sector;
+	} else {
+		/* the second side of a 1571 is a 1541 disk of its own */
+		if (u->format == D71 && track > 35) {
+			track -= 35;
+			side = track_start[36];
+		}
+		if (sector >= sectors_per_track (track)) return NULL;
+		n = side + track_start[track] + sector;
+	}
+	return u->image + n * SECTOR_SIZE;
+}
+
+/******************** STATUS *************************/
+
+static int condition (image_unit *u, int code, char *description,
+	int track, int block) {
+	snprintf (u->status, sizeof(u->status), "%02i, %s,%02i,%02i\r",
+		code, description, track, block);
+	u->status_pos = 0;
+	log_msg (LOG_DISK, LOG_DEBUG, "image: %02i, %s,%02i,%02i",
+		code, description, track, block);
+	return (code ? -1 : 0);
+}
+
+static int read_status (image_unit *u) {
+	int result = (unsigned char) u->status[u->status_pos++];
+
+	if (u->status[u->status_pos] == 0) {
+		condition (u, 0, "OK", 0, 0);
+		return result | SERIAL_END_OF_FILE;
+	}
+	return result;
+}
+
+static int command (image_unit *u, int size, const char *data) {
+	if (size == 0) return condition (u, 0, "OK", 0, 0);
+	switch (data[0]) {
+	case 'I': case 'U':
+		return condition (u, 0, "OK", 0, 0);
+	case 'N': case 'S': case 'R': case 'C': case 'V':
+		return condition (u, 26, "WRITE PROTECT ON", 0, 0);
+	}
+	return condition (u, 31, "SYNTAX ERROR", 0, 0);
+}
+
+/******************** CHAINS *************************/
+
+/* go to the next sector of the chain; 0 if there is nothing left */
+static int next_block (image_unit *u, image_channel *c) {
+	const unsigned char *block;
+
+	while (c->track != 0) {
+		block = sector (u, c->track, c->sector);
+		if (block == NULL || ++c->links > u->sectors) {
+			condition (u, 66, "ILLEGAL TRACK OR SECTOR",
+				c->track, c->sector);
+			c->track = 0;
+			return 0;
+		}
+		/* the last one says how much of it is used */
+		c->data = block;
+		c->track = block[0];
+		c->sector = block[1];
+		c->pos = 2;
+		c->end = c->track ? SECTOR_SIZE - 1 : block[1];
+		if (c->pos <= c->end) return 1;
+	}
+	return 0;
+}
+
+/* the directory, an entry at a time */
+typedef struct {
+	image_channel chain;
+	int index;
+} dir_cursor;
+
+static void dir_start (image_unit *u, dir_cursor *d) {
+	memset (d, 0, sizeof(*d));
+	d->chain.track = u->dir_track;
+	d->chain.sector = u->dir_sector;
+	d->index = SECTOR_SIZE / ENTRY_SIZE;
+}
+
+static const unsigned char *dir_next (image_unit *u, dir_cursor *d) {
+	const unsigned char *entry;
+
+	for (;;) {
+		if (d->index == SECTOR_SIZE / ENTRY_SIZE) {
+			/* directory sectors use all of themselves */
+			if (d->chain.track == 0) return NULL;
+			d->chain.data = NULL;
+			next_block (u, &d->chain);
+			if (d->chain.data == NULL) return NULL;
+			d->index = 0;
+		}
+		entry = d->chain.data + ENTRY_SIZE * d->index++;
+		/* the link at the front of the sector shares the first entry */
+		if (entry[2] != 0) return entry;
+	}
+}
+
+/* a name is padded with shifted spaces; '*' ends a pattern */
+static int match (const unsigned char *pat, int len, const unsigned char *name) {
+	int i;
+
+	for (i = 0; i < NAME_SIZE; i++) {
+		if (i == len) return name[i] == 0xa0;
+		if (pat[i] == '*') return 1;
+		if (name[i] == 0xa0) return 0;
+		if (pat[i] != '?' && pat[i] != name[i]) return 0;
+	}
+	return i == len || pat[i] == '*';
+}
+
+static const unsigned char *find_file (image_unit *u,
+	const unsigned char *pat, int len) {
+	const unsigned char *entry;
+	dir_cursor d;
+
+	dir_start (u, &d);
+	while ((entry = dir_next (u, &d)) != NULL)
+		if ((entry[2] & 7) != 0 && match (pat, len, entry + 5)) return entry;
+	return NULL;
+}
+
+/******************** DIRECTORY LISTING *************************/
+
+static int blocks_free (image_unit *u) {
+	const unsigned char *bam;
+	int t, free = 0;
+
+	if (u->format == D81) {
+		for (t = 1; t <= 80; t++) {
+			bam = sector (u, 40, t <= 40 ? 1 : 2);
+			if (t != 40) free += bam[0x10 + 6 * ((t - 1) % 40)];
+		}
+		return free;
+	}
+	bam = sector (u, 18, 0);
+	for (t = 1; t <= 35; t++)
+		if (t != 18) free += bam[4 * t];
+	if (u->format == D71)
+		for (t = 36; t <= 70; t++)
+			if (t != 53) free += bam[0xdd + t - 36];
+	return free;
+}
+
+static unsigned char *put_line (unsigned char *p, int number) {
+	/* the link is fixed up by BASIC after loading, as from a drive */
+	*p++ = 0x01; *p++ = 0x01;
+	*p++ = number & 0xff; *p++ = (number >> 8) & 0xff;
+	return p;
+}
+
+static unsigned char *put_name (unsigned char *p, const unsigned char *name) {
+	int i, len;
+
+	for (len = 0; len < NAME_SIZE && name[len] != 0xa0; len++);
+	*p++ = '"';
+	memcpy (p, name, len);
+	p += len;
+	*p++ = '"';
+	for (i = len; i < NAME_SIZE; i++) *p++ = ' ';
+	return p;
+}
+
+static int make_listing (image_unit *u, image_channel *c,
+	const unsigned char *pat, int len) {
+	const unsigned char *entry;
+	unsigned char *p;
+	dir_cursor d;
+	int files = 0, blocks;
+
+	dir_start (u, &d);
+	while (dir_next (u, &d) != NULL) files++;
+
+	c->listing = malloc ((files + 2) * 40 + 4);
+	if (c->listing == NULL) {
+		fprintf (stderr, "couldn't allocate directory listing\n");
+		exit (1);
+	}
+	p = c->listing;
+	*p++ = 0x01; *p++ = 0x04;
+
+	/* reversed disk name, id and dos type */
+	p = put_line (p, 0);
+	*p++ = 0x12;
+	*p++ = '"';
+	memcpy (p, u->header, NAME_SIZE);
+	p += NAME_SIZE;
+	*p++ = '"';
+	*p++ = ' ';
+	memcpy (p, u->header + 0x12, 5);
+	p += 5;
+	*p++ = 0;
+
+	dir_start (u, &d);
+	while ((entry = dir_next (u, &d)) != NULL) {
+		if (len > 0 && !match (pat, len, entry + 5)) continue;
+		blocks = entry[30] | (entry[31] << 8);
+		p = put_line (p, blocks);
+		if (blocks < 10) *p++ = ' ';
+		if (blocks < 100) *p++ = ' ';
+		if (blocks < 1000) *p++ = ' ';
+		p = put_name (p, entry + 5);
+		*p++ = (entry[2] & 0x80) ? ' ' : '*';
+		memcpy (p, type_names[entry[2] & 7], 3);
+		p += 3;
+		*p++ = (entry[2] & 0x40) ? '<' : ' ';
+		*p++ = 0;
+	}
+
+	p = put_line (p, blocks_free (u));
+	memcpy (p, "BLOCKS FREE.             ", 26);
+	p += 26;
+	*p++ = 0; *p++ = 0;
+
+	c->data = c->listing;
+	c->pos = 0;
+	c->end = p - c->listing - 1;
+	c->track = 0;
+	return condition (u, 0, "OK", 0, 0);
+}
+
+/******************** DRIVER *************************/
+
+static int image_open (void *unit, int ch, const char *cmd) {
+	image_unit *u = unit;
+	image_channel *c = &u->channel[ch];
+	const unsigned char *name = (const unsigned char *) cmd, *entry;
+	const char *colon, *comma;
+	int len;
+
+	if (ch == 15) return command (u, strlen (cmd), cmd);
+	image_close (u, ch);
+
+	/* "$0:pattern", "@0:name,p,w" */
+	if (name[0] == '$' && ch == 0) {
+		colon = strchr (cmd, ':');
+		name = colon ? (const unsigned char *) colon + 1 : name + strlen (cmd);
+		return make_listing (u, c, name, strlen ((const char *) name));
+	}
+	if (ch == 1 || name[0] == '@')
+		return condition (u, 26, "WRITE PROTECT ON", 0, 0);
+	if (name[0] == '#') return condition (u, 70, "NO CHANNEL", 0, 0);
+	colon = strchr (cmd, ':');
+	if (colon != NULL) name = (const unsigned char *) colon + 1;
+	comma = strchr ((const char *) name, ',');
+	len = comma ? comma - (const char *) name : strlen ((const char *) name);
+	if (comma != NULL && strstr (comma, ",W") != NULL)
+		return condition (u, 26, "WRITE PROTECT ON", 0, 0);
+
+	entry = find_file (u, name, len);
+	if (entry == NULL) return condition (u, 62, "FILE NOT FOUND", 0, 0);
+
+	c->track = entry[3];
+	c->sector = entry[4];
+	c->links = 0;
+	if (!next_block (u, c)) c->data = NULL;
+	log_msg (LOG_DISK, LOG_DEBUG, "image: channel %i, file at %i/%i",
+		ch, entry[3], entry[4]);
+	return condition (u, 0, "OK", 0, 0);
+}
+
+static int image_close (void *unit, int ch) {
+	image_unit *u = unit;
+	image_channel *c = &u->channel[ch];
+
+	if (c->listing != NULL) free (c->listing);
+	memset (c, 0, sizeof(*c));
+	return 0;
+}
+
+static int image_read (void *unit, int ch) {
+	image_unit *u = unit;
+	image_channel *c = &u->channel[ch];
+	int result;
+
+	if (ch == 15) return read_status (u);
+	if (c->data == NULL || c->pos > c->end) return SERIAL_TIME_OUT;
+
+	result = c->data[c->pos++];
+	if (c->pos > c->end && !next_block (u, c))
+		return result | SERIAL_END_OF_FILE;
+	return result;
+}
+
+/* the rest of the sector, straight from the image */
+static int image_read_block (void *unit, int ch, const unsigned char **data) {
+	image_unit *u = unit;
+	image_channel *c = &u->channel[ch];
+	int size;
+
+	if (ch == 15 || c->data == NULL) return SERIAL_TIME_OUT;
+	if (c->pos > c->end) return 0;
+
+	*data = c->data + c->pos;
+	size = c->end - c->pos + 1;
+	c->pos = c->end + 1;
+	next_block (u, c);
+	return size;
+}
+
+static int image_write (void *unit, int ch, int size, const char *data) {
+	image_unit *u = unit;
+
+	if (ch == 15) return command (u, size, data);
+	return condition (u, 26, "WRITE PROTECT ON", 0, 0);
+}
+
+/******************** MOUNTING *************************/
+
+static void release (image_unit *u) {
+	if (u->cached) archive_release (u->image);
+	else munmap ((void *) u->image, u->size);
+	free (u);
+}
+
+static int detect (image_unit *u) {
+	int i;
+
+	for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+		if (sizes[i].size == u->size) break;
+	if (i == sizeof(sizes) / sizeof(sizes[0])) return -1;
+
+	u->format = sizes[i].format;
+	u->tracks = sizes[i].tracks;
+	if (u->format == D81) {
+		u->sectors = 80 * 40;
+		u->dir_track = 40;
+		u->dir_sector = 3;
+		u->header = sector (u, 40, 0) + 0x04;
+	} else {
+		i = (u->format == D71) ? 35 : u->tracks;
+		u->sectors = track_start[i] + sectors_per_track (i);
+		if (u->format == D71) u->sectors *= 2;
+		u->dir_track = 18;
+		u->dir_sector = 1;
+		u->header = sector (u, 18, 0) + 0x90;
+	}
+	return 0;
+}
+
+/* a compressed image comes decoded from the cache, where it stays */
+static const unsigned char *load_compressed (const char *name, size_t *size) {
+	static const char *members[] = {"*.d64", "*.d71", "*.d81", NULL};
+	const unsigned char *image = NULL;
+	int i;
+
+	for (i = 0; image == NULL && i < 4; i++)
+		image = archive_get (name, members[i], size);
+	return image;
+}
+
+int image_attach (int device, const char *name) {
+	const unsigned char *image;
+	image_unit *u;
+	struct stat st;
+	size_t size;
+	int fd;
+
+	if (device < FIRST_UNIT || device >= FIRST_UNIT + UNITS) return -1;
+	if (track_start[2] == 0) init_tracks ();
+
+	if (archive_is_compressed (name)) {
+		image = load_compressed (name, &size);
+		if (image == NULL) return -1;
+	} else {
+		fd = open (name, O_RDONLY);
+		if (fd < 0) return -1;
+		if (fstat (fd, &st) < 0) {
+			close (fd);
+			return -1;
+		}
+		size = st.st_size;
+		image = mmap (NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+		close (fd);
+		if (image == MAP_FAILED) return -1;
+	}
+
+	u = calloc (1, sizeof(image_unit));
+	if (u == NULL) {
+		fprintf (stderr, "couldn't allocate disk unit\n");
+		exit (1);
+	}
+	u->image = image;
+	u->size = size;
+	u->cached = archive_is_compressed (name);
+	if (detect (u) < 0) {
+		release (u);
+		return -1;
+	}
+	condition (u, 73, "CBM DOS V2.6 1541", 0, 0);
+
+	image_detach (device);
+	units[device - FIRST_UNIT] = u;
+	serial_attach (device, &disk_image, u);
+	return 0;
+}
+
+void image_detach (int device) {
+	image_unit *u;
+	int ch;
+
+	if (device < FIRST_UNIT || device >= FIRST_UNIT + UNITS) return;
+	u = units[device - FIRST_UNIT];
+	if (u == NULL) return;
+
+	for (ch = 0; ch < 16; ch++) image_close (u, ch);
+	release (u);
+	units[device - FIRST_UNIT] = NULL;
+	serial_attach (device, device == 8 ? &disk_raw : NULL, NULL);
+}
+
+/******************** SECTOR ACCESS *************************/
+
+int image_tracks (int device) {
+	image_unit *u;
+
+	if (device < FIRST_UNIT || device >= FIRST_UNIT + UNITS) return 0;
+	u = units[device - FIRST_UNIT];
+	if (u == NULL || u->format != D64) return 0;
+	return u->tracks;
+}
+
+const unsigned char *image_sector (int device, int track, int s) {
+	if (image_tracks (device) == 0) return NULL;
+	return sector (units[device - FIRST_UNIT], track, s);
+}
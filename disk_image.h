@@ -0,0 +1,32 @@
+/* disk_image.h - D64/D71/D81 disk image driver for c64 emulator */
+
+#ifndef __DISK_IMAGE_H
+#define __DISK_IMAGE_H
+
+#include "serial.h"
+
+extern const DiskDriver disk_image;
+
+/* map the image 'name' and put it on device 8 to 11 */
+int image_attach (int device, const char *name);
+void image_detach (int device);
+
+/* the tracks of the 1541 image on 'device', or 0 if it hasn't got one */
+int image_tracks (int device);
+/* a sector of that image, for a drive that reads the disk itself */
+const unsigned char *image_sector (int device, int track, int sector);
+
+/*
+  The image file is mapped read-only and never copied: a channel reading
+  a file holds a pointer to the sector it is in and follows the link in
+  its first two bytes to the next one, so loading from an image costs
+  no more than touching the pages it is on. The format is told from the
+  file size, and the only difference between them is where a track and
+  sector are in the file and where the directory starts.
+
+  Only LOAD"$" makes something new, the directory as a BASIC program,
+  which is made from the directory sectors in place. Images are never
+  written to; saving gives WRITE PROTECT ON.
+*/
+
+#endif
@@ -9,11 +9,15 @@
 
 #include <string.h>
 #include <stdio.h>
-#include <unistd.h> // chdir
 #include <stdlib.h> // malloc free
+#include <sys/statvfs.h>
 
 #include "disk_raw.h"
 #include "serial.h"
+#include "host_dir.h"
+#include "host_write.h"
+#include "archive.h"
+#include "log.h"
 
 typedef enum {
 	CHANNEL_CLOSED,
@@ -24,6 +28,9 @@ typedef enum {
 typedef struct {
 	ChannelMode mode;
 	unsigned char *buffer;
+	int owned;
+	int cached;			/* from the archive cache */
+	int shared;			/* the unfiltered listing, maybe an old one */
 	int buffer_len;
 	int buffer_pos;
 	unsigned char filename[64];
@@ -31,10 +38,15 @@ typedef struct {
 
 ChannelInfo channel[16];
 char error_buffer[64];
-char *dirname = "/Users/brian/Backup/c64/games";
+
+/* the unfiltered LOAD"$", made again when the directory changes */
+static unsigned char *listing = NULL;
+static int listing_len = 0;
+static int listing_generation = -1;
 
 /* the disk driver interface */
-//DiskDriver disk_raw = {raw_open, raw_close, raw_read, raw_write};
+const DiskDriver disk_raw = {raw_open, raw_close, raw_read, raw_write,
+	raw_read_block};
 
 /* pet-to-ascii conversion */
 void convert_filename (const unsigned char *src, char *dest) {
@@ -55,7 +67,7 @@ void convert_filename (const unsigned char *src, char *dest) {
 /* set error message buffer with error code */
 static int condition (int code, char *description, int track, int block) {
 	snprintf (error_buffer, 64, "%i %s %i %i", code, description, track, block);
-	printf ("%s\n", error_buffer);
+	log_msg (LOG_DISK, LOG_DEBUG, "%s", error_buffer);
 	return (code ? -1 : 0);
 }
 
@@ -64,46 +76,268 @@ static int command_channel (const char *cmd) {
 	else return condition (0, "ok", 0, 0);
 }
 
-static int match (const char *pat, const char *str) {
-	if (*pat == '*') return 1;
-	else if (*pat == *str && *pat == 0) return 1;
-	else if (*pat == *str || *pat == '?') return match (pat+1, str+1);
-	else return 0;
+/* "0:name,p,r" is "name" */
+static const char *parse_name (const char *cmd, int *len) {
+	const char *colon = strchr (cmd, ':'), *comma;
+
+	if (colon != NULL) cmd = colon + 1;
+	comma = strchr (cmd, ',');
+	*len = comma ? comma - cmd : strlen (cmd);
+	return cmd;
 }
-	
+
+/* the host name a file is saved under */
+static void save_name (const char *name, int len, char *dest) {
+	unsigned char pet[64];
+	int i;
+
+	memcpy (pet, name, len);
+	pet[len] = 0;
+	convert_filename (pet, dest);
+	for (i = 0; i < len; i++)
+		if (dest[i] == '/') dest[i] = '_';
+}
+
+/* a file still being saved is read as it will be, so that one is waited
+   for; other saves carry on behind the emulation */
+static const host_file *find_file (const char *name, int len) {
+	const unsigned char *pat = (const unsigned char *) name;
+	const host_file *f = host_dir_find (pat, len);
+	char host[64];
+
+	if (f != NULL) {
+		if (!host_write_pending (host_dir_path (), f->name)) return f;
+		host_write_wait (host_dir_path (), f->name);
+	} else if (memchr (name, '*', len) || memchr (name, '?', len)) {
+		/* can't tell what a pattern matches before it is on disk */
+		if (!host_write_pending (host_dir_path (), NULL)) return NULL;
+		host_write_finish ();
+	} else {
+		save_name (name, len, host);
+		if (!host_write_pending (host_dir_path (), host)) return NULL;
+		host_write_wait (host_dir_path (), host);
+	}
+	return host_dir_find (pat, len);
+}
+
+/* decoded once, and shared with everybody else reading it */
+static int load_compressed (int ch, const char *path, const char *member) {
+	const unsigned char *data;
+	size_t size;
+
+	data = archive_get (path, member, &size);
+	if (data == NULL) return condition (62, "file not found", 0, 0);
+
+	channel[ch].buffer = (unsigned char *) data;
+	channel[ch].cached = 1;
+	channel[ch].buffer_len = size;
+	channel[ch].buffer_pos = 0;
+	channel[ch].mode = CHANNEL_READ;
+	return condition (0, "ok", 0, 0);
+}
+
 static int load_file (int ch, const char *cmd) {
+	unsigned char pet[64];
+	char path[1024], member[64];
+	const host_file *f;
+	const char *name, *slash;
 	FILE *file;
-	int size;
+	int len;
 	
 	if (strlen(cmd) > 63) return condition (32, "syntax error", 0, 0);
-	convert_filename (cmd, channel[ch].filename);
+	name = parse_name (cmd, &len);
+	f = find_file (name, len);
+
+	/* "games.zip/pacman.prg" is a member of an archive */
+	slash = memchr (name, '/', len);
+	if (f == NULL && slash != NULL) {
+		f = find_file (name, slash - name);
+		memcpy (pet, slash + 1, len - (slash + 1 - name));
+		pet[len - (slash + 1 - name)] = 0;
+		convert_filename (pet, member);
+	} else slash = NULL;
+
+	if (f == NULL) return condition (62, "file not found", 0, 0); 
+	strncpy (channel[ch].filename, f->name, 63);
+	channel[ch].filename[63] = 0;
 	
-	chdir (dirname);
-	printf ("opening \"%s\"\n", channel[ch].filename);
-	file = fopen (channel[ch].filename, "r");
+	snprintf (path, sizeof(path), "%s/%s", host_dir_path (), f->name);
+	log_msg (LOG_DISK, LOG_DEBUG, "opening \"%s\"", channel[ch].filename);
+	if (archive_is_compressed (f->name))
+		return load_compressed (ch, path, slash ? member : NULL);
+	file = fopen (path, "r");
 	
 	if (file == NULL) return condition (62, "file not found", 0, 0); 
 	
-	fseek (file, 0, SEEK_END);
-	size = ftell (file);
-	rewind (file);
-	channel[ch].buffer = malloc (size);
+	channel[ch].buffer = malloc (f->size > 0 ? f->size : 1);
 	
-	if (channel[ch].buffer == NULL) return condition (20, "read error", 0 ,0);
+	if (channel[ch].buffer == NULL) {
+		fclose (file);
+		return condition (20, "read error", 0 ,0);
+	}
 	
-	channel[ch].buffer_len = fread (channel[ch].buffer, 1, size, file);
+	channel[ch].owned = 1;
+	channel[ch].buffer_len = fread (channel[ch].buffer, 1, f->size, file);
 	channel[ch].buffer_pos = 0;
 	channel[ch].mode = CHANNEL_READ;
 	fclose(file);
 	
-	printf ("channel %i, loaded %i bytes\n", ch, size);
+	log_msg (LOG_DISK, LOG_DEBUG, "channel %i, loaded %i bytes", ch,
+		channel[ch].buffer_len);
 
 	return condition (0, "ok", 0, 0);
 }
+
+/* written to the host when it is closed */
+static int save_file (int ch, const char *cmd) {
+	int replace = (cmd[0] == '@'), len;
+	const char *name;
+
+	if (strlen(cmd) > 63) return condition (32, "syntax error", 0, 0);
+	name = parse_name (cmd + replace, &len);
+	if (len == 0) return condition (34, "syntax error", 0, 0);
+	save_name (name, len, (char *) channel[ch].filename);
+	/* a save that is still queued counts too */
+	if (!replace && (host_dir_find ((const unsigned char *) name, len) != NULL ||
+		host_write_pending (host_dir_path (), (char *) channel[ch].filename)))
+		return condition (63, "file exists", 0, 0);
+
+	channel[ch].buffer = malloc (256);
+	if (channel[ch].buffer == NULL) {
+		fprintf (stderr, "couldn't allocate save buffer\n");
+		exit (1);
+	}
+	channel[ch].owned = 1;
+	channel[ch].buffer_len = 256;
+	channel[ch].buffer_pos = 0;
+	channel[ch].mode = CHANNEL_WRITE;
+	return condition (0, "ok", 0, 0);
+}
+
+static unsigned char *put_line (unsigned char *p, int number) {
+	/* BASIC links the lines again after loading */
+	*p++ = 0x01; *p++ = 0x01;
+	*p++ = number & 0xff; *p++ = (number >> 8) & 0xff;
+	return p;
+}
+
+/* one line per file, the way a 1541 lists them */
+static unsigned char *put_file (unsigned char *p, const host_file *f) {
+	long blocks = (f->size + 253) / 254;
+	int i, len = (f->pet_len < 16) ? f->pet_len : 16;
+
+	if (blocks > 0xffff) blocks = 0xffff;
+	p = put_line (p, blocks);
+	if (blocks < 10) *p++ = ' ';
+	if (blocks < 100) *p++ = ' ';
+	if (blocks < 1000) *p++ = ' ';
+	*p++ = '"';
+	memcpy (p, f->pet, len);
+	p += len;
+	*p++ = '"';
+	for (i = len; i < 16; i++) *p++ = ' ';
+	memcpy (p, " PRG ", 5);
+	p += 5;
+	*p++ = 0;
+	return p;
+}
+
+static int blocks_free (void) {
+	struct statvfs fs;
+	double blocks;
+
+	if (statvfs (host_dir_path (), &fs) < 0) return 0;
+	blocks = (double) fs.f_bavail * fs.f_frsize / 254;
+	return (blocks > 0xffff) ? 0xffff : (int) blocks;
+}
+
+static unsigned char *make_listing (const unsigned char *pat, int len,
+	int *size) {
+	unsigned char *out, *p;
+	const char *name;
+	int i, first, last, n;
+
+	if (len > 0) host_dir_range (pat, len, &first, &last);
+	else {
+		host_dir_refresh (NULL);
+		first = 0;
+		last = host_dir_count ();
+	}
+	out = malloc ((last - first + 2) * 32 + 4);
+	if (out == NULL) {
+		fprintf (stderr, "couldn't allocate directory listing\n");
+		exit (1);
+	}
+	p = out;
+	*p++ = 0x01; *p++ = 0x04;
+
+	/* reversed name of the directory */
+	name = strrchr (host_dir_path (), '/');
+	name = name ? name + 1 : host_dir_path ();
+	n = strlen (name);
+	if (n > 16) n = 16;
+	p = put_line (p, 0);
+	*p++ = 0x12;
+	*p++ = '"';
+	for (i = 0; i < 16; i++)
+		*p++ = (i >= n) ? ' ' : (name[i] >= 'a' && name[i] <= 'z') ?
+			name[i] - 32 : name[i];
+	memcpy (p, "\" 00 2A", 7);
+	p += 7;
+	*p++ = 0;
+
+	for (i = first; i < last; i++)
+		if (len == 0 || host_dir_match (pat, len, host_dir_file (i)))
+			p = put_file (p, host_dir_file (i));
+
+	p = put_line (p, blocks_free ());
+	memcpy (p, "BLOCKS FREE.             ", 26);
+	p += 26;
+	*p++ = 0; *p++ = 0;
+
+	*size = p - out;
+	return out;
+}
+
+static int in_use (const unsigned char *buffer) {
+	int i;
+
+	for (i = 0; i < 16; i++)
+		if (channel[i].buffer == buffer) return 1;
+	return 0;
+}
+
 static int load_directory (int ch, const char *cmd) {
+	const char *pat;
+	int len;
+
+	pat = parse_name (cmd + 1, &len);
+	if (pat == cmd + 1 && len > 0 && cmd[1] >= '0' && cmd[1] <= '9') len = 0;
+
+	if (len > 0) {
+		channel[ch].buffer = make_listing ((const unsigned char *) pat, len,
+			&channel[ch].buffer_len);
+		channel[ch].owned = 1;
+	} else {
+		/* everybody shares one listing until the directory changes */
+		if (host_dir_refresh (&listing_generation) || listing == NULL) {
+			if (listing != NULL && !in_use (listing)) free (listing);
+			listing = make_listing (NULL, 0, &listing_len);
+		}
+		channel[ch].buffer = listing;
+		channel[ch].buffer_len = listing_len;
+		channel[ch].owned = 0;
+		channel[ch].shared = 1;
+	}
+	channel[ch].buffer_pos = 0;
+	channel[ch].mode = CHANNEL_READ;
 	return condition (0, "ok", 0, 0);
 }
 
+void raw_set_directory (const char *path) {
+	host_dir_open (path);
+}
+
 /**************************************************************************************/
 
 void raw_init () {
@@ -112,37 +346,61 @@ void raw_init () {
 		channel[i].mode = CHANNEL_CLOSED;
 		channel[i].filename[0] = 0;
 		channel[i].buffer = NULL;
+		channel[i].owned = 0;
+		channel[i].cached = 0;
+		channel[i].shared = 0;
 		channel[i].buffer_len = 0;
 		channel[i].buffer_pos = 0;
 	}
 	channel[15].buffer = error_buffer;
 }		
 
-int raw_open (int ch, const char *cmd) {
-	printf ("channel %i, open %s\n", ch, cmd);
+int raw_open (void *unit, int ch, const char *cmd) {
+	log_msg (LOG_DISK, LOG_DEBUG, "channel %i, open %s", ch, cmd);
 	
-	if (channel[ch].mode != CHANNEL_CLOSED) raw_close (ch);
+	if (channel[ch].mode != CHANNEL_CLOSED) raw_close (unit, ch);
 	
+	if (ch == 15) return command_channel(cmd);
+	if (ch == 1 || strstr (cmd, ",W") != NULL) return save_file (ch, cmd);
 	if (cmd[0] == '$') return load_directory (ch, cmd);
 	
 	if (ch == 0) return load_file (ch, cmd);
-	//if (ch == 1) return save_file (ch, cmd);
-	if (ch == 15) return command_channel(cmd);
 
 	convert_filename(cmd, channel[ch].filename);
 	
 	return condition (0, "ok", 0, 0);
 }
 
-int raw_close (int ch) {
-	printf ("channel %i, close\n", ch);
+int raw_close (void *unit, int ch) {
+	unsigned char *old;
 
+	log_msg (LOG_DISK, LOG_DEBUG, "channel %i, close", ch);
+
+	/* the writer frees the buffer once it's on disk */
+	if (channel[ch].mode == CHANNEL_WRITE) {
+		host_write_file (host_dir_path (), (char *) channel[ch].filename,
+			channel[ch].buffer, channel[ch].buffer_pos);
+		channel[ch].owned = 0;
+	}
 	channel[ch].mode = CHANNEL_CLOSED;
-	if (ch != 15 && channel[ch].buffer != NULL) free (channel[ch].buffer);
+	if (channel[ch].owned) free (channel[ch].buffer);
+	if (channel[ch].cached) archive_release (channel[ch].buffer);
+	channel[ch].cached = 0;
+
+	/* a listing replaced while it was open goes with its last reader */
+	if (channel[ch].shared) {
+		old = channel[ch].buffer;
+		channel[ch].buffer = NULL;
+		channel[ch].shared = 0;
+		if (old != listing && !in_use (old)) free (old);
+	}
+
+	if (ch != 15) channel[ch].buffer = NULL;
+	channel[ch].owned = 0;
 	return condition (0, "ok", 0, 0);
 }
 
-int raw_read (int ch) {
+int raw_read (void *unit, int ch) {
 	int result;
 
 	if (channel[ch].buffer == NULL) {
@@ -155,19 +413,40 @@ int raw_read (int ch) {
 	result = channel[ch].buffer[channel[ch].buffer_pos++];
 	
 	if (channel[ch].buffer_pos == channel[ch].buffer_len) {
-		printf ("end of file\n");
+		log_msg (LOG_DISK, LOG_TRACE, "channel %i, end of file", ch);
 		return (result | SERIAL_END_OF_FILE);
 	}
 	else return result;
 }
 
-int raw_write (int ch, int size, const char *data) {
-	FILE *file;
+int raw_read_block (void *unit, int ch, const unsigned char **data) {
+	int size;
 
+	if (channel[ch].buffer == NULL || ch == 15) return SERIAL_TIME_OUT;
+
+	*data = channel[ch].buffer + channel[ch].buffer_pos;
+	size = channel[ch].buffer_len - channel[ch].buffer_pos;
+	channel[ch].buffer_pos = channel[ch].buffer_len;
+	return size;
+}
+
+int raw_write (void *unit, int ch, int size, const char *data) {
 	if (ch == 15) return command_channel(data);
 
 	if (channel[ch].mode != CHANNEL_WRITE) {
 		return condition (61, "file not open", 0, 0);
 	}
+	if (channel[ch].buffer_pos + size > channel[ch].buffer_len) {
+		while (channel[ch].buffer_pos + size > channel[ch].buffer_len)
+			channel[ch].buffer_len *= 2;
+		channel[ch].buffer = realloc (channel[ch].buffer,
+			channel[ch].buffer_len);
+		if (channel[ch].buffer == NULL) {
+			fprintf (stderr, "couldn't allocate save buffer\n");
+			exit (1);
+		}
+	}
+	memcpy (channel[ch].buffer + channel[ch].buffer_pos, data, size);
+	channel[ch].buffer_pos += size;
 	return 0;
 }
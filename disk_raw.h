@@ -9,10 +9,12 @@
 
 #include "serial.h"
 
-//DiskDriver disk_raw;
+extern const DiskDriver disk_raw;
 void raw_init ();
+void raw_set_directory (const char *path);
 
-int raw_open  (int channel, const char *command);
-int raw_close (int channel);
-int raw_read  (int channel);
-int raw_write (int channel, int size, const char *data);
+int raw_open  (void *unit, int channel, const char *command);
+int raw_close (void *unit, int channel);
+int raw_read  (void *unit, int channel);
+int raw_write (void *unit, int channel, int size, const char *data);
+int raw_read_block (void *unit, int channel, const unsigned char **data);
@@ -0,0 +1,383 @@
+/* drive.c - true 1541 drive emulation for c64 emulator */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "drive.h"
+#include "cpu6502.h"
+#include "via.h"
+#include "disk_image.h"
+#include "serial.h"
+#include "mem_c64.h"
+#include "timing.h"
+#include "log.h"
+
+#define DRIVE_HZ 1000000
+#define DEVICE 8
+
+/* drive cycles with nothing going on before the drive is skipped */
+#define IDLE_CYCLES 200000
+
+#define HALF_TRACKS 84
+#define MAX_TRACK_SIZE 7692
+
+static int enabled = 0;
+
+static cpu6502 cpu;
+static via via1, via2;
+static unsigned char ram[0x800];
+static const unsigned char *rom;
+
+/* the c64 clock the drive was last brought up to, and the fraction of a
+   drive cycle left over */
+static cycle_t c64_clock;
+static long c64_remainder;
+
+/* the drive is never skipped before this */
+static cycle_t busy_until;
+
+/******************** SERIAL BUS *************************/
+
+/* lines pulled low by the c64 */
+static int c64_atn, c64_clk, c64_data;
+
+/* lines pulled low by the drive, from VIA1 port B */
+static int drive_clk, drive_data, drive_atna;
+
+/* the data line is also pulled while ATN and the acknowledge differ */
+static int bus_data (void) {
+	return c64_data | drive_data | (drive_atna ^ c64_atn);
+}
+
+static int bus_clk (void) {
+	return c64_clk | drive_clk;
+}
+
+/* whether the drive is holding anything on the bus */
+static int drive_pulling (void) {
+	return drive_clk | drive_data | (drive_atna ^ c64_atn);
+}
+
+/******************** DISK *************************/
+
+static const unsigned char gcr_nibble[16] = {
+	0x0a, 0x0b, 0x12, 0x13, 0x0e, 0x0f, 0x16, 0x17,
+	0x09, 0x19, 0x1a, 0x1b, 0x0d, 0x1d, 0x1e, 0x15
+};
+
+/* half-tracks; the even ones are the tracks of the image */
+static unsigned char *gcr_track[HALF_TRACKS + 1];
+static int gcr_size[HALF_TRACKS + 1];
+static int gcr_built[HALF_TRACKS + 1];
+
+static int half_track = 36;		/* the head, on track 18 */
+static int head_pos;			/* byte under the head */
+static int motor, phase, density;
+static int byte_ready_on;		/* CA2 routes BYTE READY to SO */
+static cycle_t next_byte;		/* when the byte under the head is in */
+static int latch;			/* the last whole byte read */
+
+static int sectors_per_track (int track) {
+	if (track <= 17) return 21;
+	if (track <= 24) return 19;
+	if (track <= 30) return 18;
+	return 17;
+}
+
+/* the bytes that fit on a track at its speed */
+static int track_size (int track) {
+	if (track <= 17) return 7692;
+	if (track <= 24) return 7142;
+	if (track <= 30) return 6666;
+	return 6250;
+}
+
+/* four bytes make five on the disk */
+static unsigned char *gcr_encode (unsigned char *out, const unsigned char *in) {
+	unsigned long long bits = 0;
+	int i;
+
+	for (i = 0; i < 4; i++)
+		bits = (bits << 10) | (gcr_nibble[in[i] >> 4] << 5) |
+			gcr_nibble[in[i] & 0x0f];
+	for (i = 4; i >= 0; i--) {
+		out[i] = bits & 0xff;
+		bits >>= 8;
+	}
+	return out + 5;
+}
+
+/* each sector is a header block and a data block, each after a sync */
+static void build_track (int track, unsigned char *p, int size) {
+	const unsigned char *bam = image_sector (DEVICE, 18, 0);
+	const unsigned char *data;
+	unsigned char header[8], block[260];
+	int id1 = 0x30, id2 = 0x30;
+	int n = sectors_per_track (track), gap, s, i, sum;
+
+	if (bam != NULL) {
+		id1 = bam[0xa2];
+		id2 = bam[0xa3];
+	}
+
+	memset (p, 0x55, size);
+	gap = size / n - (5 + 10 + 9 + 5 + 325);
+	for (s = 0; s < n; s++) {
+		header[0] = 0x08;
+		header[1] = s ^ track ^ id2 ^ id1;
+		header[2] = s;
+		header[3] = track;
+		header[4] = id2;
+		header[5] = id1;
+		header[6] = header[7] = 0x0f;
+		memset (p, 0xff, 5);
+		p = gcr_encode (p + 5, header);
+		p = gcr_encode (p, header + 4);
+		p += 9;
+
+		data = image_sector (DEVICE, track, s);
+		block[0] = 0x07;
+		if (data != NULL) memcpy (block + 1, data, 256);
+		else memset (block + 1, 0, 256);
+		for (sum = 0, i = 1; i <= 256; i++) sum ^= block[i];
+		block[257] = sum;
+		block[258] = block[259] = 0;
+		memset (p, 0xff, 5);
+		p += 5;
+		for (i = 0; i < 260; i += 4) p = gcr_encode (p, block + i);
+		p += gap;
+	}
+}
+
+/* the track under the head, or NULL where there's nothing to read */
+static const unsigned char *current_track (int *size) {
+	int track = half_track / 2;
+
+	if ((half_track & 1) || track > image_tracks (DEVICE)) return NULL;
+	if (!gcr_built[half_track]) {
+		if (gcr_track[half_track] == NULL) {
+			gcr_track[half_track] = malloc (MAX_TRACK_SIZE);
+			if (gcr_track[half_track] == NULL) {
+				fprintf (stderr, "couldn't allocate disk track\n");
+				exit (1);
+			}
+		}
+		gcr_size[half_track] = track_size (track);
+		build_track (track, gcr_track[half_track], gcr_size[half_track]);
+		gcr_built[half_track] = 1;
+		log_msg (LOG_DRIVE, LOG_DEBUG, "track %i encoded", track);
+	}
+	*size = gcr_size[half_track];
+	return gcr_track[half_track];
+}
+
+/* SYNC: the head is in a run of ones longer than any GCR byte has */
+static int in_sync (const unsigned char *t, int size, int pos) {
+	return t[pos] == 0xff && t[pos ? pos - 1 : size - 1] == 0xff;
+}
+
+static int sync_bit (void) {
+	const unsigned char *t;
+	int size;
+
+	if (!motor || (t = current_track (&size)) == NULL) return 0x80;
+	if (head_pos >= size) head_pos %= size;
+	return in_sync (t, size, head_pos) ? 0 : 0x80;
+}
+
+/* the bytes that went past the head since it was last looked at */
+static void rotate (void) {
+	const unsigned char *t;
+	int size, cycles = 32 - 2 * density;
+
+	t = current_track (&size);
+	while (next_byte <= cpu.clock) {
+		next_byte += cycles;
+		if (t == NULL) continue;
+		if (head_pos >= size) head_pos %= size;
+		if (!in_sync (t, size, head_pos)) {
+			latch = t[head_pos];
+			/* BYTE READY, to the SO pin and as a falling edge on CA1 */
+			if (byte_ready_on) cpu6502_set_overflow (&cpu);
+			via_set_ca1 (&via2, 1);
+			via_set_ca1 (&via2, 0);
+		}
+		head_pos++;
+	}
+}
+
+static void invalidate_disk (void) {
+	memset (gcr_built, 0, sizeof(gcr_built));
+}
+
+/******************** VIAS *************************/
+
+/* VIA1: the serial bus on port B, with the device number jumpers */
+static int via1_port_in (via *v, int port) {
+	if (port != 0) return 0xff;
+	return (bus_data () ? 0x01 : 0) | (bus_clk () ? 0x04 : 0) |
+		(c64_atn ? 0x80 : 0);
+}
+
+static void via1_port_out (via *v, int port, int value) {
+	int clk = drive_clk, data = drive_data, atna = drive_atna;
+
+	if (port != 0) return;
+	drive_data = (value >> 1) & 1;
+	drive_clk = (value >> 3) & 1;
+	drive_atna = (value >> 4) & 1;
+	if (clk != drive_clk || data != drive_data || atna != drive_atna)
+		busy_until = cpu.clock + IDLE_CYCLES;
+}
+
+/* VIA2: the head, the motor and the byte from the disk */
+static int via2_port_in (via *v, int port) {
+	if (port == 0) {
+		if (motor) rotate ();
+		/* PB4 low: write protected */
+		return sync_bit () | 0x6f;
+	}
+	if (motor) rotate ();
+	return latch;
+}
+
+static void via2_port_out (via *v, int port, int value) {
+	int p;
+
+	if (port == 2) {
+		/* CA2 held high enables BYTE READY */
+		byte_ready_on = (value & 0x0e) == 0x0e;
+		return;
+	}
+	if (port != 0) return;
+
+	if (motor) rotate ();
+
+	/* the stepper moves half a track for each phase it is turned */
+	p = value & 3;
+	if (p == ((phase + 1) & 3) && half_track < HALF_TRACKS) half_track++;
+	else if (p == ((phase - 1) & 3) && half_track > 2) half_track--;
+	phase = p;
+
+	if ((value & 0x04) && !motor) {
+		/* a new spin may be a new disk */
+		invalidate_disk ();
+		next_byte = cpu.clock + 32 - 2 * density;
+	}
+	motor = (value & 0x04) != 0;
+	density = (value >> 5) & 3;
+	if (motor) busy_until = cpu.clock + IDLE_CYCLES;
+}
+
+static void via_interrupt (via *v, int asserted) {
+	int bit = (v == &via1) ? 1 : 2;
+
+	if (asserted) cpu.irq |= bit;
+	else cpu.irq &= ~bit;
+}
+
+/******************** MEMORY *************************/
+
+static int drive_io_read (cpu6502 *c, int address) {
+	switch (address & 0xfc00) {
+	case 0x1800: return via_read (&via1, c->clock, address);
+	case 0x1c00: return via_read (&via2, c->clock, address);
+	}
+	/* nothing there: what was last on the data bus */
+	return address >> 8;
+}
+
+static void drive_io_write (cpu6502 *c, int address, int value) {
+	switch (address & 0xfc00) {
+	case 0x1800: via_write (&via1, c->clock, address, value); break;
+	case 0x1c00: via_write (&via2, c->clock, address, value); break;
+	}
+}
+
+/******************** RUNNING *************************/
+
+/* nothing can happen until the c64 does something on the bus */
+static int idle (void) {
+	return cpu.clock >= busy_until && !motor && !c64_atn &&
+		!drive_pulling () && !(cpu.p & 0x04);
+}
+
+static void run (cycle_t target) {
+	while (cpu.clock < target) {
+		if (idle ()) {
+			cpu.clock = target;
+			break;
+		}
+		cpu6502_step (&cpu);
+		if (cpu.clock >= via1.next) via_update (&via1, cpu.clock);
+		if (cpu.clock >= via2.next) via_update (&via2, cpu.clock);
+		if (motor && cpu.clock >= next_byte) rotate ();
+	}
+	via_update (&via1, cpu.clock);
+	via_update (&via2, cpu.clock);
+}
+
+static void drive_sync (cycle_t now) {
+	long long cycles;
+
+	if (now <= c64_clock) return;
+	cycles = (now - c64_clock) * (long long) DRIVE_HZ + c64_remainder;
+	c64_clock = now;
+	c64_remainder = cycles % machine.clock_hz;
+	run (cpu.clock + cycles / machine.clock_hz);
+}
+
+int drive_bus_read (cycle_t now) {
+	if (!enabled) return 0xff;
+	drive_sync (now);
+	/* CLK IN and DATA IN read high while the line is released */
+	return 0x3f | (bus_clk () ? 0 : 0x40) | (bus_data () ? 0 : 0x80);
+}
+
+void drive_bus_write (cycle_t now, int value) {
+	int atn = (value >> 3) & 1;
+
+	if (!enabled) return;
+	drive_sync (now);
+	c64_clk = (value >> 4) & 1;
+	c64_data = (value >> 5) & 1;
+	if (atn != c64_atn) {
+		c64_atn = atn;
+		via_set_ca1 (&via1, atn);
+	}
+	busy_until = cpu.clock + IDLE_CYCLES;
+}
+
+void drive_frame (cycle_t now) {
+	if (enabled) drive_sync (now);
+}
+
+/******************** INITIALIZATION ********************/
+
+void drive_init (FILE *f) {
+	int page;
+
+	rom = mem_load_rom (f, 0x4000);
+
+	for (page = 0; page < 0x100; page++) {
+		cpu.read_page[page] = NULL;
+		cpu.write_page[page] = NULL;
+	}
+	for (page = 0; page < 0x08; page++) {
+		cpu.read_page[page] = ram + (page << 8);
+		cpu.write_page[page] = ram + (page << 8);
+	}
+	/* the ROM is only half decoded, so it shows at $8000 too */
+	for (page = 0x80; page < 0x100; page++)
+		cpu.read_page[page] = rom + ((page & 0x3f) << 8);
+	cpu.io_read = drive_io_read;
+	cpu.io_write = drive_io_write;
+	cpu.clock = 0;
+
+	via_init (&via1, "VIA1", via1_port_in, via1_port_out, via_interrupt, NULL);
+	via_init (&via2, "VIA2", via2_port_in, via2_port_out, via_interrupt, NULL);
+	cpu6502_reset (&cpu);
+
+	enabled = 1;
+	serial_set_bus_device (8);
+}
@@ -0,0 +1,47 @@
+/* drive.h - true 1541 drive emulation for c64 emulator */
+
+#ifndef __DRIVE_H
+#define __DRIVE_H
+
+#include <stdio.h>
+#include "event.h"
+
+/* put a 1541 running 'rom' on the bus as device 8; the serial kernal
+   traps leave it to the kernal, and still serve devices 9 to 11 */
+void drive_init (FILE *rom);
+
+/* the serial lines on CIA2 port A; 'now' is the c64 clock */
+int drive_bus_read (cycle_t now);
+void drive_bus_write (cycle_t now, int value);
+
+/* catch up once a frame, so the drive doesn't fall far behind */
+void drive_frame (cycle_t now);
+
+/*
+  The drive has its own 6502, two VIAs and a disk, and runs the real DOS
+  from its ROM, so anything that talks to the drive directly, fast
+  loaders included, works as it would on the machine.
+
+  It doesn't run in step with the c64. The only way the two can see each
+  other is the serial bus, so the drive is left alone until the c64 reads
+  or writes the bus lines, and then brought up to the c64's clock before
+  the lines are looked at or changed; that gives the same result as
+  running them side by side. The frame event syncs it too, so that the
+  two clocks never drift far apart.
+
+  Most of the time the drive sits in its idle loop with the motor off and
+  the bus released, waiting for ATN. When it has been doing that for a
+  while its clock is simply moved forward to the c64's, so an idle drive
+  costs next to nothing; anything the c64 does on the bus wakes it up
+  before it happens.
+
+  The disk is the D64 image on device 8, turned into GCR a track at a
+  time when the head first reads it. Images are write protected, as with
+  the image driver, so the DOS never writes to it.
+
+  The serial kernal traps stay in. Once LISTEN or TALK has addressed
+  device 8, they hand each byte back to the kernal to send on the bus;
+  anything for devices 9 to 11 is still answered by their drivers.
+*/
+
+#endif
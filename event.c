@@ -0,0 +1,154 @@
+/* event.c - cycle scheduler for c64 emulator */
+
+/*
+  Pending events are kept in a binary heap ordered by time, so arming,
+  cancelling and firing an event are O(log n) no matter how many
+  sources exist. The cpu only ever sees the time of the earliest event,
+  as its time_left countdown.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "event.h"
+#include "6510.h"
+
+struct event_s {
+	cycle_t time;
+	cycle_t seq;        /* orders events due at the same time */
+	int index;          /* position in the heap, -1 if not pending */
+	void (*callback)(void *data);
+	void *data;
+};
+
+static event **heap = NULL;
+static int heap_used = 0, heap_size = 0;
+static cycle_t next_seq = 0;
+static int dispatching = 0;
+
+/* how far the cpu may run when nothing at all is scheduled */
+#define IDLE_CYCLES (1 << 24)
+
+static inline int earlier (const event *a, const event *b) {
+	return (a->time < b->time) || (a->time == b->time && a->seq < b->seq);
+}
+
+static inline void place (event *e, int index) {
+	heap[index] = e;
+	e->index = index;
+}
+
+static void sift_up (int index) {
+	event *e = heap[index];
+	int parent;
+
+	while (index > 0) {
+		parent = (index - 1) >> 1;
+		if (!earlier (e, heap[parent])) break;
+		place (heap[parent], index);
+		index = parent;
+	}
+	place (e, index);
+}
+
+static void sift_down (int index) {
+	event *e = heap[index];
+	int child;
+
+	while ((child = 2 * index + 1) < heap_used) {
+		if (child + 1 < heap_used && earlier (heap[child + 1], heap[child]))
+			child++;
+		if (!earlier (heap[child], e)) break;
+		place (heap[child], index);
+		index = child;
+	}
+	place (e, index);
+}
+
+static void heap_remove (event *e) {
+	int index = e->index;
+	event *last = heap[--heap_used];
+
+	e->index = -1;
+	if (last == e) return;
+
+	place (last, index);
+	sift_up (index);
+	sift_down (last->index);
+}
+
+/******************** EVENT HANDLES *************************/
+
+event *event_new (void (*callback)(void *data), void *data) {
+	event *e = malloc (sizeof(event));
+
+	if (e == NULL) {
+		fprintf (stderr, "couldn't allocate event\n");
+		exit (1);
+	}
+	e->time = 0;
+	e->seq = 0;
+	e->index = -1;
+	e->callback = callback;
+	e->data = data;
+	return e;
+}
+
+void event_free (event *e) {
+	if (e == NULL) return;
+	event_cancel (e);
+	free (e);
+}
+
+void event_schedule (event *e, cycle_t time) {
+	if (e->index >= 0) heap_remove (e);
+
+	if (heap_used == heap_size) {
+		heap_size = heap_size ? 2 * heap_size : 16;
+		heap = realloc (heap, heap_size * sizeof(event *));
+		if (heap == NULL) {
+			fprintf (stderr, "couldn't allocate event queue\n");
+			exit (1);
+		}
+	}
+
+	e->time = time;
+	e->seq = next_seq++;
+	place (e, heap_used++);
+	sift_up (e->index);
+
+	/* tell the cpu if this is now the first thing to happen */
+	if (!dispatching && heap[0] == e) cpu6510_set_deadline (time);
+}
+
+void event_cancel (event *e) {
+	/* the cpu may still stop at the old time; it will find nothing due */
+	if (e->index >= 0) heap_remove (e);
+}
+
+int event_pending (const event *e) {
+	return (e->index >= 0);
+}
+
+cycle_t event_time (const event *e) {
+	return e->time;
+}
+
+/******************** DISPATCH *************************/
+
+void event_dispatch (void) {
+	cycle_t now = cpu6510_clock ();
+	event *e;
+
+	dispatching = 1;
+	while (heap_used > 0 && heap[0]->time <= now) {
+		e = heap[0];
+		heap_remove (e);
+		e->callback (e->data);
+
+		/* the callback may have stolen cycles from the cpu */
+		now = cpu6510_clock ();
+	}
+	dispatching = 0;
+
+	cpu6510_set_deadline (heap_used > 0 ? heap[0]->time : now + IDLE_CYCLES);
+}
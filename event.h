@@ -0,0 +1,29 @@
+/* event.h - cycle scheduler for c64 emulator */
+
+#ifndef __EVENT_H
+#define __EVENT_H
+
+/* absolute cycle count; 64 bits last for thousands of years at 1 MHz */
+typedef long long cycle_t;
+
+typedef struct event_s event;
+
+event *event_new (void (*callback)(void *data), void *data);
+void event_free (event *e);
+
+/* arm (or re-arm) an event for an absolute time */
+void event_schedule (event *e, cycle_t time);
+void event_cancel (event *e);
+int event_pending (const event *e);
+cycle_t event_time (const event *e);
+
+/* run every event that is due; called by the cpu when time_left runs out */
+void event_dispatch (void);
+
+/*
+  Events due at the same cycle run in the order they were scheduled.
+  An event is disarmed just before its callback runs, so a periodic
+  event simply schedules itself again from the callback.
+*/
+
+#endif
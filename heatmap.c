@@ -0,0 +1,153 @@
+/* heatmap.c - memory access heatmap for c64 emulator */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "heatmap.h"
+
+#ifdef MEM_HEATMAP
+
+unsigned long heat_page[3][0x100];
+unsigned long *heat_address = NULL;
+
+static char heat_prefix[256];
+static int heat_frames = 0;
+static int frame_count = 0;
+static int dump_number = 0;
+
+/* print the pages with the most traffic */
+static void hot_pages (int count) {
+	unsigned long total[0x100], best;
+	int i, page, n;
+
+	for (i=0; i<0x100; i++)
+		total[i] = heat_page[HEAT_READ][i] + heat_page[HEAT_WRITE][i] +
+			heat_page[HEAT_FETCH][i];
+
+	printf ("hot pages:\n");
+	for (n=0; n<count; n++) {
+		best = 0;
+		page = -1;
+		for (i=0; i<0x100; i++)
+			if (total[i] > best) { best = total[i]; page = i; }
+		if (page < 0) break;
+		printf ("  $%02x00: %lu reads, %lu writes, %lu fetches\n", page,
+			heat_page[HEAT_READ][page], heat_page[HEAT_WRITE][page],
+			heat_page[HEAT_FETCH][page]);
+		total[page] = 0;
+	}
+}
+
+static void heat_exit (void) {
+	hot_pages (8);
+	heat_dump (heat_prefix);
+}
+
+int heat_init (const char *prefix, int frames, int per_address) {
+	strncpy (heat_prefix, prefix, sizeof(heat_prefix) - 16);
+	heat_frames = frames;
+
+	if (per_address) {
+		heat_address = calloc (3 * 0x10000, sizeof(unsigned long));
+		if (heat_address == NULL) return -1;
+	}
+	heat_clear ();
+
+	/* without a frame interval, dump the whole run when we quit */
+	if (heat_frames <= 0) atexit (heat_exit);
+	return 0;
+}
+
+void heat_clear (void) {
+	memset (heat_page, 0, sizeof(heat_page));
+	if (heat_address)
+		memset (heat_address, 0, 3 * 0x10000 * sizeof(unsigned long));
+}
+
+/* called once per frame from the main callback */
+void heat_frame (void) {
+	char name[300];
+
+	if (heat_frames <= 0 || ++frame_count < heat_frames) return;
+	frame_count = 0;
+
+	sprintf (name, "%s_%05i", heat_prefix, dump_number++);
+	heat_dump (name);
+	heat_clear ();
+}
+
+/******************** OUTPUT *************************/
+
+static void write_csv (FILE *f) {
+	int i;
+
+	fprintf (f, "page,reads,writes,fetches\n");
+	for (i=0; i<0x100; i++)
+		fprintf (f, "%02x,%lu,%lu,%lu\n", i, heat_page[HEAT_READ][i],
+			heat_page[HEAT_WRITE][i], heat_page[HEAT_FETCH][i]);
+
+	if (heat_address == NULL) return;
+
+	fprintf (f, "\naddress,reads,writes,fetches\n");
+	for (i=0; i<0x10000; i++) {
+		unsigned long r = heat_address[(HEAT_READ << 16) | i];
+		unsigned long w = heat_address[(HEAT_WRITE << 16) | i];
+		unsigned long x = heat_address[(HEAT_FETCH << 16) | i];
+		if (r | w | x) fprintf (f, "%04x,%lu,%lu,%lu\n", i, r, w, x);
+	}
+}
+
+/* count for pixel (x, y) of the 256x256 image */
+static unsigned long pixel_count (int kind, int x, int y) {
+	if (heat_address) return heat_address[(kind << 16) | (y << 8) | x];
+	return heat_page[kind][((y >> 4) << 4) | (x >> 4)];
+}
+
+static int scale (unsigned long count, double log_max) {
+	if (count == 0) return 0;
+	return 32 + (int) (223.0 * log (1.0 + count) / log_max);
+}
+
+static void write_ppm (FILE *f) {
+	static const int channel[3] = { HEAT_WRITE, HEAT_READ, HEAT_FETCH };
+	unsigned long max = 1;
+	double log_max;
+	int x, y, c;
+
+	/* one scale for all channels, so their brightness can be compared */
+	for (c=0; c<3; c++)
+		for (y=0; y<0x100; y++)
+			for (x=0; x<0x100; x++)
+				if (pixel_count (c, x, y) > max) max = pixel_count (c, x, y);
+	log_max = log (1.0 + max);
+
+	fprintf (f, "P6\n256 256\n255\n");
+	for (y=0; y<0x100; y++)
+		for (x=0; x<0x100; x++)
+			for (c=0; c<3; c++)
+				fputc (scale (pixel_count (channel[c], x, y), log_max), f);
+}
+
+void heat_dump (const char *name) {
+	char filename[320];
+	FILE *f;
+
+	sprintf (filename, "%s.csv", name);
+	if ((f = fopen (filename, "w")) == NULL) {
+		printf ("couldn't write heatmap \"%s\"\n", filename);
+		return;
+	}
+	write_csv (f);
+	fclose (f);
+
+	sprintf (filename, "%s.ppm", name);
+	if ((f = fopen (filename, "wb")) == NULL) {
+		printf ("couldn't write heatmap \"%s\"\n", filename);
+		return;
+	}
+	write_ppm (f);
+	fclose (f);
+}
+
+#endif
@@ -0,0 +1,52 @@
+/* heatmap.h - memory access heatmap for c64 emulator */
+
+#ifndef __HEATMAP_H
+#define __HEATMAP_H
+
+/*
+  Define MEM_HEATMAP (e.g. -DMEM_HEATMAP) to count every read, write and
+  opcode fetch the CPU makes, per 256 byte page and optionally per
+  address. Without it the counting macro expands to nothing and the
+  memory fast paths are exactly as they were.
+*/
+
+#define HEAT_READ   0
+#define HEAT_WRITE  1
+#define HEAT_FETCH  2
+
+#ifdef MEM_HEATMAP
+
+extern unsigned long heat_page[3][0x100];
+extern unsigned long *heat_address;
+
+#define heat_count(kind, address) do { \
+	heat_page[kind][((address) >> 8) & 0xff]++; \
+	if (heat_address) heat_address[((kind) << 16) | ((address) & 0xffff)]++; \
+} while (0)
+
+/* dump to PREFIX.csv/.ppm at exit, or PREFIX_nnnnn.* every 'frames' frames */
+int heat_init (const char *prefix, int frames, int per_address);
+void heat_frame (void);
+void heat_dump (const char *name);
+void heat_clear (void);
+
+#else
+
+#define heat_count(kind, address)
+#define heat_frame()
+
+#endif
+
+/*
+output files:
+
+  NAME.csv  page,reads,writes,fetches         one line per page
+            address,reads,writes,fetches      one line per touched address
+                                              (per address mode only)
+  NAME.ppm  256x256 image; red = writes, green = reads, blue = fetches,
+            on a log scale. Per page mode draws page $XY as a 16x16
+            block at row X, column Y; per address mode draws $XXYY at
+            row XX, column YY.
+*/
+
+#endif
@@ -0,0 +1,269 @@
+/* host_dir.c - indexed host directory for c64 emulator */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+#include "host_dir.h"
+#include "log.h"
+
+static char *dir_path = NULL;
+static host_file *files = NULL;
+static int count = 0, allocated = 0;
+
+static host_file **buckets = NULL;
+static unsigned int bucket_mask = 0;
+
+/* bumped whenever the index is read again */
+static int current = 0;
+static int stale = 1;
+
+#ifdef __linux__
+static int notify_fd = -1;
+#endif
+static time_t dir_mtime = 0;
+
+/******************** NAMES *************************/
+
+/* ascii-to-pet conversion, the reverse of disk_raw.c's; "game.prg.gz"
+   is "GAME.PRG", since it is read decoded */
+static unsigned char *pet_name (const char *src, int *len) {
+	unsigned char *dest;
+	int i, n = strlen (src);
+
+	if (n > 3 && !strcasecmp (src + n - 3, ".gz")) n -= 3;
+
+	dest = malloc (n + 1);
+	if (dest == NULL) {
+		fprintf (stderr, "couldn't allocate file name\n");
+		exit (1);
+	}
+	for (i = 0; i < n; i++) {
+		unsigned char c = src[i];
+		if (c >= 'a' && c <= 'z') dest[i] = c - 32;
+		else if (c >= 'A' && c <= 'Z') dest[i] = c + 128;
+		else dest[i] = c;
+	}
+	dest[n] = 0;
+	*len = n;
+	return dest;
+}
+
+static unsigned int hash (const unsigned char *name, int len) {
+	unsigned int h = 2166136261u;
+	int i;
+
+	for (i = 0; i < len; i++) h = (h ^ name[i]) * 16777619u;
+	return h;
+}
+
+static int compare (const unsigned char *a, int alen,
+	const unsigned char *b, int blen) {
+	int c = memcmp (a, b, alen < blen ? alen : blen);
+
+	return c ? c : alen - blen;
+}
+
+static int compare_files (const void *a, const void *b) {
+	const host_file *fa = a, *fb = b;
+
+	return compare (fa->pet, fa->pet_len, fb->pet, fb->pet_len);
+}
+
+/* '*' matches the rest of the name, '?' any one character */
+int host_dir_match (const unsigned char *pat, int len, const host_file *f) {
+	int i;
+
+	for (i = 0; i < len; i++) {
+		if (pat[i] == '*') return 1;
+		if (i == f->pet_len) return 0;
+		if (pat[i] != '?' && pat[i] != f->pet[i]) return 0;
+	}
+	return i == f->pet_len;
+}
+
+/******************** READING *************************/
+
+static void clear (void) {
+	int i;
+
+	for (i = 0; i < count; i++) {
+		free (files[i].name);
+		free (files[i].pet);
+	}
+	count = 0;
+}
+
+static void add (const char *name, long size) {
+	if (count == allocated) {
+		allocated = allocated ? allocated * 2 : 256;
+		files = realloc (files, allocated * sizeof(host_file));
+		if (files == NULL) {
+			fprintf (stderr, "couldn't allocate directory index\n");
+			exit (1);
+		}
+	}
+	files[count].name = strdup (name);
+	if (files[count].name == NULL) {
+		fprintf (stderr, "couldn't allocate file name\n");
+		exit (1);
+	}
+	files[count].pet = pet_name (name, &files[count].pet_len);
+	files[count].size = size;
+	count++;
+}
+
+static void make_buckets (void) {
+	unsigned int size = 16, h;
+	int i;
+
+	while (size < 2 * (unsigned int) count) size *= 2;
+	free (buckets);
+	buckets = calloc (size, sizeof(host_file *));
+	if (buckets == NULL) {
+		fprintf (stderr, "couldn't allocate directory index\n");
+		exit (1);
+	}
+	bucket_mask = size - 1;
+
+	/* backwards, so the first of equal names is found first */
+	for (i = count - 1; i >= 0; i--) {
+		h = hash (files[i].pet, files[i].pet_len) & bucket_mask;
+		files[i].next = buckets[h];
+		buckets[h] = &files[i];
+	}
+}
+
+static void read_directory (void) {
+	char path[1024];
+	struct dirent *d;
+	struct stat st;
+	DIR *dir;
+
+	clear ();
+	dir = opendir (dir_path);
+	if (dir != NULL) {
+		while ((d = readdir (dir)) != NULL) {
+			if (d->d_name[0] == '.') continue;
+			snprintf (path, sizeof(path), "%s/%s", dir_path, d->d_name);
+			if (stat (path, &st) < 0 || !S_ISREG (st.st_mode)) continue;
+			add (d->d_name, st.st_size);
+		}
+		closedir (dir);
+	}
+	qsort (files, count, sizeof(host_file), compare_files);
+	make_buckets ();
+
+	current++;
+	stale = 0;
+	log_msg (LOG_HOST, LOG_DEBUG, "host_dir: %i files in %s", count, dir_path);
+}
+
+/******************** WATCHING *************************/
+
+void host_dir_open (const char *path) {
+	free (dir_path);
+	dir_path = strdup (path);
+	stale = 1;
+
+#ifdef __linux__
+	if (notify_fd >= 0) close (notify_fd);
+	notify_fd = inotify_init ();
+	if (notify_fd >= 0) {
+		fcntl (notify_fd, F_SETFL, O_NONBLOCK);
+		if (inotify_add_watch (notify_fd, path, IN_CREATE | IN_DELETE |
+			IN_MOVED_FROM | IN_MOVED_TO | IN_CLOSE_WRITE |
+			IN_DELETE_SELF | IN_MOVE_SELF) < 0) {
+			close (notify_fd);
+			notify_fd = -1;
+		}
+	}
+#endif
+}
+
+const char *host_dir_path (void) {
+	if (dir_path == NULL) host_dir_open (".");
+	return dir_path;
+}
+
+static void check (void) {
+	struct stat st;
+#ifdef __linux__
+	char events[4096];
+
+	if (notify_fd >= 0) {
+		while (read (notify_fd, events, sizeof(events)) > 0) stale = 1;
+		return;
+	}
+#endif
+	if (stat (dir_path, &st) == 0 && st.st_mtime != dir_mtime) {
+		dir_mtime = st.st_mtime;
+		stale = 1;
+	}
+}
+
+int host_dir_refresh (int *generation) {
+	if (dir_path == NULL) host_dir_open (".");
+	check ();
+	if (stale) read_directory ();
+	if (generation == NULL || *generation == current) return 0;
+	*generation = current;
+	return 1;
+}
+
+/******************** LOOKING UP *************************/
+
+int host_dir_count (void) {
+	return count;
+}
+
+const host_file *host_dir_file (int index) {
+	return &files[index];
+}
+
+void host_dir_range (const unsigned char *pat, int len, int *first, int *last) {
+	int prefix, lo = 0, hi = count, mid;
+
+	host_dir_refresh (NULL);
+	for (prefix = 0; prefix < len; prefix++)
+		if (pat[prefix] == '*' || pat[prefix] == '?') break;
+
+	/* the first name not less than the prefix */
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (compare (files[mid].pet, files[mid].pet_len < prefix ?
+			files[mid].pet_len : prefix, pat, prefix) < 0) lo = mid + 1;
+		else hi = mid;
+	}
+	*first = lo;
+	while (hi < count && files[hi].pet_len >= prefix &&
+		memcmp (files[hi].pet, pat, prefix) == 0) hi++;
+	*last = hi;
+}
+
+const host_file *host_dir_find (const unsigned char *pat, int len) {
+	const host_file *f;
+	int i, first, last;
+
+	host_dir_refresh (NULL);
+	for (i = 0; i < len; i++)
+		if (pat[i] == '*' || pat[i] == '?') break;
+
+	if (i == len) {
+		for (f = buckets[hash (pat, len) & bucket_mask]; f; f = f->next)
+			if (compare (f->pet, f->pet_len, pat, len) == 0) return f;
+		return NULL;
+	}
+
+	host_dir_range (pat, len, &first, &last);
+	for (i = first; i < last; i++)
+		if (host_dir_match (pat, len, &files[i])) return &files[i];
+	return NULL;
+}
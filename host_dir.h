@@ -0,0 +1,47 @@
+/* host_dir.h - indexed host directory for c64 emulator */
+
+#ifndef __HOST_DIR_H
+#define __HOST_DIR_H
+
+typedef struct host_file_s {
+	char *name;			/* as on the host */
+	unsigned char *pet;		/* as the c64 sees it */
+	int pet_len;
+	long size;
+	struct host_file_s *next;	/* the next with the same hash */
+} host_file;
+
+void host_dir_open (const char *path);
+const char *host_dir_path (void);
+
+/* bring the index up to date; true if it changed since 'generation' */
+int host_dir_refresh (int *generation);
+
+/* the files, sorted by their c64 names */
+int host_dir_count (void);
+const host_file *host_dir_file (int index);
+
+/* the first file matching a c64 pattern with '*' and '?', or NULL */
+const host_file *host_dir_find (const unsigned char *pattern, int len);
+
+/* the sorted range of files that can match 'pattern' */
+void host_dir_range (const unsigned char *pattern, int len,
+	int *first, int *last);
+int host_dir_match (const unsigned char *pattern, int len,
+	const host_file *file);
+
+/*
+  Directories with tens of thousands of files are read once, into an
+  array sorted by the PETSCII names and a hash table over the same
+  entries. A name without wildcards is a hash lookup; a pattern is a
+  binary search for the part before its first wildcard, and only the
+  files starting with that are tried against the rest of it.
+
+  Gzipped files are listed without the .gz, as what they decode to.
+
+  On Linux inotify says when the directory changes; elsewhere its
+  modification time is checked. Either way the index is only read again
+  the next time somebody asks for it.
+*/
+
+#endif
@@ -0,0 +1,163 @@
+/* host_write.c - background file writer for c64 emulator */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "host_write.h"
+#include "log.h"
+
+typedef struct write_job_s {
+	char *path, *temp;
+	unsigned char *data;
+	int size;
+	struct write_job_s *next;
+} write_job;
+
+static pthread_t writer;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wake = PTHREAD_COND_INITIALIZER;
+
+static write_job *first = NULL, *last = NULL;
+static write_job *current = NULL;	/* being written now */
+static int started = 0;
+static mode_t file_mode = 0644;
+
+/* into a temporary file, then renamed over the real one */
+static void write_job_now (write_job *job) {
+	char *temp = job->temp;
+	FILE *file;
+	int fd, ok;
+
+	/* mkstemp makes it private */
+	fd = mkstemp (temp);
+	if (fd >= 0) fchmod (fd, file_mode);
+	file = (fd >= 0) ? fdopen (fd, "wb") : NULL;
+	ok = file != NULL && fwrite (job->data, 1, job->size, file) ==
+		(size_t) job->size && fflush (file) == 0 && fsync (fd) == 0;
+	if (file != NULL) ok = (fclose (file) == 0) && ok;
+	else if (fd >= 0) close (fd);
+
+	if (ok && rename (temp, job->path) == 0) {
+		log_msg (LOG_HOST, LOG_DEBUG, "host_write: %i bytes to %s",
+			job->size, job->path);
+	} else {
+		fprintf (stderr, "couldn't write \"%s\"\n", job->path);
+		if (fd >= 0) unlink (temp);
+	}
+}
+
+static void free_job (write_job *job) {
+	free (job->temp);
+	free (job->path);
+	free (job->data);
+	free (job);
+}
+
+/* whether 'path' is queued or being written, or anything if NULL; the
+   lock is held */
+static int pending (const char *path) {
+	write_job *job;
+
+	if (path == NULL) return first != NULL || current != NULL;
+	if (current != NULL && !strcmp (current->path, path)) return 1;
+	for (job = first; job != NULL; job = job->next)
+		if (!strcmp (job->path, path)) return 1;
+	return 0;
+}
+
+static void *writer_main (void *data) {
+	write_job *job;
+
+	pthread_mutex_lock (&lock);
+	while (1) {
+		while (first == NULL) pthread_cond_wait (&wake, &lock);
+		job = first;
+		first = job->next;
+		if (first == NULL) last = NULL;
+		current = job;
+		pthread_mutex_unlock (&lock);
+
+		write_job_now (job);
+
+		pthread_mutex_lock (&lock);
+		current = NULL;
+		free_job (job);
+		pthread_cond_broadcast (&wake);
+	}
+	return NULL;
+}
+
+void host_write_file (const char *dir, const char *name,
+	unsigned char *data, int size) {
+	write_job *job = malloc (sizeof(write_job));
+	int length = strlen (dir) + strlen (name) + 10;
+
+	if (job != NULL) {
+		job->path = malloc (length);
+		job->temp = malloc (length);
+	}
+	if (job == NULL || job->path == NULL || job->temp == NULL) {
+		fprintf (stderr, "couldn't allocate file write\n");
+		exit (1);
+	}
+	/* hidden, so the directory index doesn't list it */
+	sprintf (job->path, "%s/%s", dir, name);
+	sprintf (job->temp, "%s/.%s.XXXXXX", dir, name);
+	job->data = data;
+	job->size = size;
+	job->next = NULL;
+
+	if (!started) {
+		file_mode = umask (0);
+		umask (file_mode);
+		file_mode = 0666 & ~file_mode;
+		started = (pthread_create (&writer, NULL, writer_main, NULL) == 0)
+			? 1 : -1;
+		if (started > 0) atexit (host_write_finish);
+	}
+	/* no thread: the emulation waits after all */
+	if (started < 0) {
+		write_job_now (job);
+		free_job (job);
+		return;
+	}
+
+	pthread_mutex_lock (&lock);
+	if (last != NULL) last->next = job;
+	else first = job;
+	last = job;
+	pthread_cond_broadcast (&wake);
+	pthread_mutex_unlock (&lock);
+}
+
+int host_write_pending (const char *dir, const char *name) {
+	char path[1024];
+	int result;
+
+	if (started <= 0) return 0;
+	if (name != NULL) snprintf (path, sizeof(path), "%s/%s", dir, name);
+
+	pthread_mutex_lock (&lock);
+	result = pending (name != NULL ? path : NULL);
+	pthread_mutex_unlock (&lock);
+	return result;
+}
+
+void host_write_wait (const char *dir, const char *name) {
+	char path[1024];
+
+	if (started <= 0) return;
+	if (name != NULL) snprintf (path, sizeof(path), "%s/%s", dir, name);
+
+	pthread_mutex_lock (&lock);
+	while (pending (name != NULL ? path : NULL))
+		pthread_cond_wait (&wake, &lock);
+	pthread_mutex_unlock (&lock);
+}
+
+void host_write_finish (void) {
+	host_write_wait (NULL, NULL);
+}
@@ -0,0 +1,28 @@
+/* host_write.h - background file writer for c64 emulator */
+
+#ifndef __HOST_WRITE_H
+#define __HOST_WRITE_H
+
+/* write 'size' bytes to 'name' in 'dir' sometime soon; 'data' is the
+   writer's to free afterwards */
+void host_write_file (const char *dir, const char *name,
+	unsigned char *data, int size);
+
+/* whether 'name' in 'dir' is still to be written, or anything if NULL */
+int host_write_pending (const char *dir, const char *name);
+/* wait until it is on disk */
+void host_write_wait (const char *dir, const char *name);
+
+/* wait for everything queued to be on disk */
+void host_write_finish (void);
+
+/*
+  Saving doesn't wait for the host: the whole file is already in memory
+  when the c64 closes it, so it is handed to a thread that writes it to
+  a temporary file beside the real one and renames it over the top. A
+  reader never sees half a file, and the emulation never waits for the
+  disk, unless it opens a file that is still queued. Whatever is still
+  queued is written before the program exits.
+*/
+
+#endif
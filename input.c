@@ -0,0 +1,166 @@
+/* input.c - host input queue for c64 emulator */
+
+#include <stdio.h>
+#include <time.h>
+#include <pthread.h>
+#include "input.h"
+#include "vic2.h"
+#include "6510.h"
+
+#define RING_SIZE 256    /* a power of two */
+
+static SDL_Event ring[RING_SIZE];
+static volatile unsigned int ring_head = 0;   /* written by the host side */
+static volatile unsigned int ring_tail = 0;   /* written by the emulator */
+static int dropped = 0;
+
+static void (*deliver)(const SDL_Event *event) = NULL;
+static int (*host_key)(const SDL_Event *event) = NULL;
+static int threaded = 0;
+static event *poll_event = NULL, *replay_event = NULL;
+static cycle_t poll_time;
+static int poll_cycles;
+
+static FILE *record_file = NULL, *replay_file = NULL;
+static SDL_Event replay_next;
+
+/******************** RING *************************/
+
+static int ring_put (const SDL_Event *e) {
+	unsigned int head = ring_head;
+
+	if (head - ring_tail == RING_SIZE) return 0;
+	ring[head & (RING_SIZE - 1)] = *e;
+	__sync_synchronize ();   /* the entry before the index */
+	ring_head = head + 1;
+	return 1;
+}
+
+static int ring_get (SDL_Event *e) {
+	unsigned int tail = ring_tail;
+
+	if (tail == ring_head) return 0;
+	__sync_synchronize ();   /* the index before the entry */
+	*e = ring[tail & (RING_SIZE - 1)];
+	__sync_synchronize ();   /* done with the entry before freeing it */
+	ring_tail = tail + 1;
+	return 1;
+}
+
+static void put (const SDL_Event *e) {
+	if (!ring_put (e) && !dropped++)
+		printf ("input queue full; events dropped\n");
+}
+
+/* collects events as they arrive, with SDL running its own event loop */
+static void *input_thread (void *data) {
+	struct timespec ms = { 0, 1000000 };
+	SDL_Event e;
+
+	while (1) {
+		while (SDL_PeepEvents (&e, 1, SDL_GETEVENT, SDL_ALLEVENTS) > 0)
+			put (&e);
+		nanosleep (&ms, NULL);
+	}
+	return NULL;
+}
+
+/******************** DELIVERY *************************/
+
+static int is_key (const SDL_Event *e) {
+	return (e->type == SDL_KEYDOWN || e->type == SDL_KEYUP);
+}
+
+static void apply (const SDL_Event *e) {
+	/* hotkeys for the emulator are live even during a replay */
+	if (host_key (e)) return;
+	if (is_key (e)) {
+		/* a replay owns the keyboard */
+		if (replay_file != NULL) return;
+		if (record_file != NULL)
+			fprintf (record_file, "%lli %i %i %i\n", cpu6510_clock (),
+				e->type, (int) e->key.keysym.sym, (int) e->key.keysym.mod);
+	}
+	deliver (e);
+}
+
+/* without an event thread SDL is pumped once a frame; it is far slower
+   than draining the ring */
+void input_frame (void) {
+	SDL_Event e;
+
+	if (!threaded && deliver != NULL)
+		while (SDL_PollEvent (&e)) put (&e);
+}
+
+/* runs on a raster line boundary */
+static void callback_poll (void *data) {
+	SDL_Event e;
+
+	while (ring_get (&e)) apply (&e);
+
+	poll_time += poll_cycles;
+	event_schedule (poll_event, poll_time);
+}
+
+/******************** RECORD AND REPLAY *************************/
+
+int input_record (const char *filename) {
+	record_file = fopen (filename, "w");
+	if (record_file == NULL) return -1;
+	setvbuf (record_file, NULL, _IOLBF, 0);
+	return 0;
+}
+
+static void schedule_replay (void) {
+	long long when;
+	int type, sym, mod;
+
+	if (fscanf (replay_file, "%lli %i %i %i", &when, &type, &sym, &mod) != 4) {
+		printf ("input replay finished\n");
+		fclose (replay_file);
+		replay_file = NULL;
+		return;
+	}
+	replay_next.type = type;
+	replay_next.key.type = type;
+	replay_next.key.keysym.sym = (SDLKey) sym;
+	replay_next.key.keysym.mod = (SDLMod) mod;
+	event_schedule (replay_event, when);
+}
+
+static void callback_replay (void *data) {
+	deliver (&replay_next);
+	schedule_replay ();
+}
+
+int input_replay (const char *filename) {
+	replay_file = fopen (filename, "r");
+	if (replay_file == NULL) return -1;
+	return 0;
+}
+
+/******************** INITIALIZATION *************************/
+
+void input_start (void (*handler)(const SDL_Event *event),
+	int (*host_handler)(const SDL_Event *event), int lines, int use_thread) {
+	pthread_t thread;
+
+	deliver = handler;
+	host_key = host_handler;
+	if (lines <= 0) lines = 1;
+	poll_cycles = lines * CYCLES_PER_LINE;
+
+	threaded = use_thread &&
+		pthread_create (&thread, NULL, input_thread, NULL) == 0;
+
+	/* line boundaries are counted from now, the start of the beam */
+	poll_time = cpu6510_clock () + poll_cycles;
+	poll_event = event_new (callback_poll, NULL);
+	event_schedule (poll_event, poll_time);
+
+	if (replay_file != NULL) {
+		replay_event = event_new (callback_replay, NULL);
+		schedule_replay ();
+	}
+}
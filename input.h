@@ -0,0 +1,34 @@
+/* input.h - host input queue for c64 emulator */
+
+#ifndef __INPUT_H
+#define __INPUT_H
+
+#include <SDL/SDL.h>
+
+/* deliver host events to 'handler' every 'lines' raster lines; with
+   'threaded', a thread collects them (SDL_INIT_EVENTTHREAD is needed).
+   'host_handler' is offered each event first, and returns non-zero for
+   the emulator's own hotkeys, which the c64 never sees */
+void input_start (void (*handler)(const SDL_Event *event),
+	int (*host_handler)(const SDL_Event *event), int lines, int threaded);
+/* collects events once a frame when there is no thread doing it */
+void input_frame (void);
+
+/* keyboard events can be saved with the cycle they were applied on,
+   and applied on exactly the same cycles later; hotkeys aren't */
+int input_record (const char *filename);
+int input_replay (const char *filename);
+
+/*
+  The host side only ever adds to the ring and the emulator only ever
+  takes from it, so no lock is needed: each side owns one index, and a
+  memory barrier orders the entry against the index that publishes it.
+
+  The emulator drains the ring at raster line boundaries, so an event
+  from the thread waits a few lines at most instead of up to a whole
+  frame. Without the thread, SDL itself is only asked once a frame. The cycle
+  an event is applied on is what gets recorded; the recording is
+  a text file with one "cycle type key modifiers" line per event.
+*/
+
+#endif
@@ -13,7 +13,14 @@
 
 
 static int keymap[SDLK_LAST];
-static int key_rows_data[8];
+
+/* keys down, one bit per key code: a byte per column, a bit per row */
+static key_matrix pressed = 0;
+/* the same, with every key ghosting could make appear held down */
+static key_matrix ghosted = 0, ghosted_by_row = 0;
+static int matrix_dirty = 0;
+/* spreads the bits of a column mask to whole bytes */
+static key_matrix column_bytes[256];
 //static int joystick_data[2];
 static int joy_data = 0xff;
 static int select_joystick = 2;
@@ -51,15 +58,17 @@ typedef struct keymap_s {
 */
 
 inline static void press(int code) {
-	key_rows_data[(code >> 3) & 7] &= ~(1 << (code & 7));
+	pressed |= KEY_BIT(code & 63);
+	matrix_dirty = 1;
 }
 inline static void release(code) {
-	key_rows_data[(code >> 3) & 7] |= (1 << (code & 7));
+	pressed &= ~KEY_BIT(code & 63);
+	matrix_dirty = 1;
 }
 
 static void show() {
 	int i;
-	for (i=0;i<8;i++) printf("%02x ",key_rows_data[i]);
+	for (i=0;i<8;i++) printf("%02x ",(int) (~pressed >> (8 * i)) & 0xff);
 	printf("\n");
 }
 
@@ -130,11 +139,16 @@ void joystick_up (int x) {
 #define keys(a,b,c) ((a) + ((b) << 8)) + ((c) << 16)
 
 void key_init () {
-	int i;
+	int i, col;
 	
 	cia1_set_joysticks(0xff,0xff);
 
-	for (i=0; i<8; i++) key_rows_data[i] = 255;
+	for (i=0; i<256; i++) {
+		column_bytes[i] = 0;
+		for (col=0; col<8; col++)
+			if (i & (1 << col)) column_bytes[i] |= 0xffULL << (8 * col);
+	}
+	keyboard_set_matrix(0);
 	
 	/* positional key mappings */
 	for (i=0; i<SDLK_LAST; i++) keymap[i] = -1;
@@ -273,16 +287,73 @@ void key_main_sdl () {
 }
 */
 
-int keyboard_read_rows (int column_mask) {
-	int col, rows = 0xff;
-	
-	for (col=0; col<8; col++) {
-		/* is that bit a zero in the column mask? */
-		if ( ((column_mask >> col) & 1) == 0) rows &= key_rows_data[col];
+/******************** MATRIX *************************/
+
+/* the rows connected to any of the columns in 'm' */
+inline static int fold_bytes(key_matrix m) {
+	m |= m >> 32;
+	m |= m >> 16;
+	m |= m >> 8;
+	return (int) m & 0xff;
+}
+
+/* swap rows for columns (Hacker's Delight, transpose8) */
+static key_matrix transpose(key_matrix m) {
+	key_matrix t;
+
+	t = (m ^ (m >> 7)) & 0x00aa00aa00aa00aaULL;
+	m ^= t ^ (t << 7);
+	t = (m ^ (m >> 14)) & 0x0000cccc0000ccccULL;
+	m ^= t ^ (t << 14);
+	t = (m ^ (m >> 28)) & 0x00000000f0f0f0f0ULL;
+	m ^= t ^ (t << 28);
+	return m;
+}
+
+/*
+  Two keys held in one row join their columns, so driving either column
+  low pulls every row of the other one low too: a third key can appear
+  pressed. That repeats until nothing more joins, and the result is the
+  rows each column reaches through any chain of held keys.
+*/
+static void update_matrix() {
+	key_matrix reach = pressed, by_row, next;
+	int col, cols;
+
+	while (1) {
+		by_row = transpose(reach);
+		next = 0;
+		for (col=0; col<8; col++) {
+			/* the columns sharing a row with this one, then all their rows */
+			cols = fold_bytes(by_row & column_bytes[(reach >> (8 * col)) & 0xff]);
+			next |= (key_matrix) fold_bytes(reach & column_bytes[cols]) << (8 * col);
+		}
+		if (next == reach) break;
+		reach = next;
 	}
 
-	//printf("keyboard_read_rows(%02x) = %02x\n", column_mask, rows);
-	return (rows);
+	ghosted = reach;
+	ghosted_by_row = transpose(reach);
+	matrix_dirty = 0;
 }
 
+void keyboard_set_matrix(key_matrix keys) {
+	pressed = keys;
+	matrix_dirty = 1;
+}
 
+key_matrix keyboard_get_matrix() {
+	return pressed;
+}
+
+/* rows pulled low by the columns driven low in 'column_mask' */
+int keyboard_read_rows (int column_mask) {
+	if (matrix_dirty) update_matrix();
+	return ~fold_bytes(ghosted & column_bytes[~column_mask & 0xff]) & 0xff;
+}
+
+/* the other way round, for programs that drive the rows */
+int keyboard_read_columns (int row_mask) {
+	if (matrix_dirty) update_matrix();
+	return ~fold_bytes(ghosted_by_row & column_bytes[~row_mask & 0xff]) & 0xff;
+}
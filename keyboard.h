@@ -12,8 +12,16 @@ void keyboard_keydown (SDLKey key, SDLMod mod);
 void keyboard_keyup (SDLKey key, SDLMod mod);
 
 int keyboard_read_rows (int column_mask);
+int keyboard_read_columns (int row_mask);
 int keyboard_read_joy2 ();
 
+/* the whole matrix at once, one bit per key code (see below) */
+typedef unsigned long long key_matrix;
+#define KEY_BIT(code) (1ULL << (code))
+
+void keyboard_set_matrix (key_matrix keys);
+key_matrix keyboard_get_matrix ();
+
 void joystick_select (int x);
 void joystick_down (int x);
 void joystick_up (int x);
@@ -0,0 +1,170 @@
+/* log.c - structured logging for c64 emulator */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <time.h>
+#include <pthread.h>
+#include "log.h"
+#include "6510.h"
+
+#define RING_SIZE 4096   /* a power of two */
+#define TEXT_SIZE 112
+
+typedef struct {
+	volatile unsigned int written;   /* its index + 1, once it is */
+	cycle_t clock;
+	unsigned char module, level;
+	char text[TEXT_SIZE];
+} log_entry;
+
+static log_entry ring[RING_SIZE];
+static volatile unsigned int ring_head = 0;   /* claimed by the writers */
+static volatile unsigned int ring_tail = 0;   /* freed by the drain */
+static volatile unsigned int dropped = 0;
+
+/* only one drain at a time; writers never take it */
+static pthread_mutex_t drain_lock = PTHREAD_MUTEX_INITIALIZER;
+static int threaded = 0;
+static FILE *out = NULL;
+
+unsigned char log_levels[LOG_MODULES] = {
+	LOG_INFO, LOG_INFO, LOG_INFO, LOG_INFO,
+	LOG_INFO, LOG_INFO, LOG_INFO, LOG_INFO
+};
+
+static const char *module_names[LOG_MODULES] = {
+	"serial", "disk", "drive", "tape", "host", "cia", "vic", "video"
+};
+
+static const char *level_names[] = {
+	"error", "warn", "info", "debug", "trace"
+};
+
+/******************** RING *************************/
+
+static log_entry *ring_claim (unsigned int *index) {
+	unsigned int head;
+
+	do {
+		head = ring_head;
+		if (head - ring_tail >= RING_SIZE) return NULL;
+	} while (!__sync_bool_compare_and_swap (&ring_head, head, head + 1));
+	*index = head;
+	return &ring[head & (RING_SIZE - 1)];
+}
+
+static void drain (void) {
+	unsigned int tail, lost;
+	log_entry *e;
+
+	pthread_mutex_lock (&drain_lock);
+	if (out == NULL) out = stdout;
+	for (tail = ring_tail; ; tail++) {
+		e = &ring[tail & (RING_SIZE - 1)];
+		/* claimed but not written yet: the rest waits for next time */
+		if (e->written != tail + 1) break;
+		__sync_synchronize ();   /* the flag before the entry */
+		fprintf (out, "%lli %s %s: %s\n", e->clock,
+			module_names[e->module], level_names[e->level], e->text);
+		__sync_synchronize ();   /* done with the entry before freeing it */
+		ring_tail = tail + 1;
+	}
+	lost = __sync_lock_test_and_set (&dropped, 0);
+	if (lost) fprintf (out, "log: %u messages dropped\n", lost);
+	fflush (out);
+	pthread_mutex_unlock (&drain_lock);
+}
+
+void log_write (int module, int level, const char *format, ...) {
+	unsigned int index;
+	log_entry *e = ring_claim (&index);
+	va_list args;
+
+	if (e == NULL) {
+		__sync_fetch_and_add (&dropped, 1);
+		return;
+	}
+	e->clock = cpu6510_clock ();
+	e->module = module;
+	e->level = level;
+	va_start (args, format);
+	vsnprintf (e->text, TEXT_SIZE, format, args);
+	va_end (args);
+
+	__sync_synchronize ();   /* the entry before the flag */
+	e->written = index + 1;
+
+	if (!threaded) drain ();
+}
+
+/******************** DRAINING *************************/
+
+static void *drain_main (void *data) {
+	struct timespec wait = { 0, 10000000 };
+
+	while (1) {
+		nanosleep (&wait, NULL);
+		drain ();
+	}
+	return NULL;
+}
+
+static void log_finish (void) {
+	drain ();
+}
+
+void log_start (void) {
+	pthread_t thread;
+
+	drain ();
+	threaded = pthread_create (&thread, NULL, drain_main, NULL) == 0;
+	atexit (log_finish);
+}
+
+int log_open (const char *filename) {
+	FILE *f = fopen (filename, "w");
+
+	if (f == NULL) return -1;
+	out = f;
+	return 0;
+}
+
+/******************** LEVELS *************************/
+
+static int find (const char **names, int count, const char *name, int len) {
+	int i;
+
+	for (i = 0; i < count; i++)
+		if ((int) strlen (names[i]) == len && !strncmp (names[i], name, len))
+			return i;
+	return -1;
+}
+
+int log_parse (const char *spec) {
+	const char *end, *equals;
+	int module, level, i;
+
+	while (*spec) {
+		end = strchr (spec, ',');
+		if (end == NULL) end = spec + strlen (spec);
+		equals = memchr (spec, '=', end - spec);
+
+		if (equals == NULL) {
+			module = -1;
+			equals = spec - 1;
+		} else {
+			module = find (module_names, LOG_MODULES, spec, equals - spec);
+			if (module < 0) return -1;
+		}
+		level = find (level_names, 5, equals + 1, end - equals - 1);
+		if (level < 0) return -1;
+
+		if (module >= 0) log_levels[module] = level;
+		else for (i = 0; i < LOG_MODULES; i++) log_levels[i] = level;
+
+		spec = *end ? end + 1 : end;
+	}
+	return 0;
+}
@@ -0,0 +1,56 @@
+/* log.h - structured logging for c64 emulator */
+
+#ifndef __LOG_H
+#define __LOG_H
+
+/* the parts of the emulator that log */
+enum {
+	LOG_SERIAL, LOG_DISK, LOG_DRIVE, LOG_TAPE, LOG_HOST,
+	LOG_CIA, LOG_VIC, LOG_VIDEO,
+	LOG_MODULES
+};
+
+enum { LOG_ERROR, LOG_WARN, LOG_INFO, LOG_DEBUG, LOG_TRACE };
+
+/* messages above this level aren't compiled in at all */
+#ifndef LOG_COMPILED
+#define LOG_COMPILED LOG_TRACE
+#endif
+
+/* the level each module logs at; LOG_INFO until changed */
+extern unsigned char log_levels[LOG_MODULES];
+
+#define log_enabled(module, level) \
+	((level) <= LOG_COMPILED && (level) <= log_levels[module])
+
+/* printf-style; costs one comparison when the level is off */
+#define log_msg(module, level, ...) \
+	do { \
+		if (log_enabled (module, level)) \
+			log_write (module, level, __VA_ARGS__); \
+	} while (0)
+
+void log_write (int module, int level, const char *format, ...)
+	__attribute__ ((format (printf, 3, 4)));
+
+/* "debug" for every module, or "serial=trace,cia=debug"; -1 if bad */
+int log_parse (const char *spec);
+/* where messages go instead of stdout; -1 if it can't be opened */
+int log_open (const char *filename);
+void log_start (void);
+
+/*
+  A message is formatted straight into a slot of a ring in memory, with
+  the cycle it happened at, and that is all the emulator does; a thread
+  of its own writes the ring out every few milliseconds. Anyone may log:
+  a slot is claimed with one compare-and-swap and marked written when it
+  is, so neither side ever waits for the other. When the ring is full
+  messages are dropped and counted rather than slowing the emulator
+  down.
+
+  Each module has a level that can be changed at run time, and the
+  check in log_msg is all a message that is off costs. Building with
+  LOG_COMPILED set lower takes the messages above it out altogether.
+*/
+
+#endif
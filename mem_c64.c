@@ -4,50 +4,115 @@
 /* memory management is described on page 260 of the C64 PRG */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 #include "mem_c64.h"
 #include "keyboard.h"
 #include "vic2.h"
 #include "cia1.h"
+#include "cia2.h"
+#include "sound.h"
+#include "reu.h"
+#include "cartridge.h"
+#include "vic_defer.h"
+#include "tape.h"
 
 #undef MEM_DEBUG
 
 /* ROM images */
-unsigned char kernal_rom[0x2000];
-unsigned char basic_rom[0x2000];
+const unsigned char *kernal_rom;
+const unsigned char *basic_rom;
+const unsigned char *character_rom;
 
-/* 256 pages of 256 bytes each; this table marks which are ordinary RAM */
-#define PAGE_ZERO          (1<<0)
-#define PAGE_IO_RAM        (1<<1)
-#define PAGE_ROM           (1<<2)
+/*
+  The kernal is never modified in place; the 0x02 opcodes that start the
+  highlevel routines are patched into 'readable' whenever the kernal is
+  mapped in. That keeps the ROM images read only, so they can be shared.
+*/
+static const int kernal_traps[] = {
+	/* wait for key press */
+	// 0xe5cd,
+	/* copy screen line */
+	// 0xe9d4,
+	/* read from serial port */
+	0xee13,
+	/* write to serial port */
+	0xed40,
+	/* LOAD from serial port, the loop that reads the file */
+	0xf4f3,
+	/* LOAD from tape */
+	0xf539
+};
+
+#define KERNAL_TRAPS ((int) (sizeof(kernal_traps) / sizeof(kernal_traps[0])))
 
+/* 256 pages of 256 bytes each; this table marks which are ordinary RAM */
+/* (the PAGE_* flag bits are defined in mem_c64.h) */
 int ram_page_flag[0x100];
 
+/* what is copied into each PLA region of 'readable' (see update_mem_map);
+   nothing is while a cartridge bank is mapped there */
+#define SOURCE_RAM ((const unsigned char *) 0)
+#define SOURCE_CART ((const unsigned char *) -1)
+static const unsigned char *region_source[4];
+
+/* where the PAGE_CART pages are read from */
+static const unsigned char *cart_page[0x100];
+
+/* what the PLA shows for a chip the cartridge doesn't have */
+static unsigned char open_bus[0x2000];
+
 /*
   Reading from memory should be extremely fast.
   The 'readable' array is maintained so that there
   is no need for slow lookup tables, etc.
 */
 
+/*
+  ROM images are mapped straight from their files, so every emulator
+  running on the host shares one copy through the page cache. Files that
+  can't be mapped (pipes, short files) are read into private memory.
+*/
+const unsigned char *mem_load_rom( FILE *f, int size ) {
+	unsigned char *rom;
+
+	rom = mmap(NULL, size, PROT_READ, MAP_SHARED, fileno(f), 0);
+	if (rom != MAP_FAILED) {
+		/* make sure the file really covers the whole image */
+		fseek(f, 0, SEEK_END);
+		if (ftell(f) >= size) return rom;
+		munmap(rom, size);
+		rewind(f);
+	}
+
+	rom = calloc(size, 1);
+	if (rom == NULL) {
+		fprintf(stderr, "couldn't allocate ROM memory\n");
+		exit(1);
+	}
+	fread (rom, size, 1, f);
+	return rom;
+}
+
 void mem_init( FILE *fk, FILE *fb, FILE *fc ) {
 	/* load rom images */
-	fread (kernal_rom, 0x2000, 1, fk);
-	fread (basic_rom, 0x2000, 1, fb);
-	fread (character_rom, 0x1000, 1, fc);
-
-	/* patch kernal: put 0x02 at start of all highlevel routines */
-	/* wait for key press */
-	// kernal_rom[0xe5cd & 0x1fff] = 0x02;
-	/* copy screen line */
-	// kernal_rom[0xe9d4 & 0x1fff] = 0x02;
-	/* read from serial port */
-	kernal_rom[0xee13 & 0x1fff] = 0x02;
-	/* write to serial port */
-	kernal_rom[0xed40 & 0x1fff] = 0x02;
+	kernal_rom = mem_load_rom (fk, 0x2000);
+	basic_rom = mem_load_rom (fb, 0x2000);
+	character_rom = mem_load_rom (fc, 0x1000);
+	memset (open_bus, 0xff, sizeof(open_bus));
 
+	cia1_init();
+	cia2_init();
 	mem_reset();
 }
 
+/* bytes of memory owned by one emulated machine */
+int mem_footprint(void) {
+	return sizeof(ram_64k) + sizeof(readable) + sizeof(io_ram) +
+		sizeof(color_ram) + sizeof(ram_page_flag);
+}
+
 void mem_reset() {
 	int i;
 
@@ -56,13 +121,17 @@ void mem_reset() {
 	for (i=0; i< 0x1000; i++) io_ram[i] = 0x00;
 	for (i=0; i< 0x0400; i++) color_ram[i] = 0x00;
 
-	/* initialize flags, ram_page_flag array */
-	for (i=0; i<256; i++) ram_page_flag[i] = 0;
-	ram_page_flag[0] = PAGE_ZERO;
+	/* initialize flags, ram_page_flag array; watchpoints and the VIC bank
+	   flags survive a reset, on the zero page too */
+	for (i=0; i<256; i++) ram_page_flag[i] &= PAGE_WATCH | PAGE_VIC;
+	ram_page_flag[0] |= PAGE_ZERO;
 
 	/* initialize pointer to stack page */
 	stack = readable + 0x100;
 
+	/* 'readable' now holds plain RAM everywhere */
+	for (i=0; i<4; i++) region_source[i] = SOURCE_RAM;
+
 	/* set HIRAM, LORAM, clear CHAREN */
 	/* load rom images into 'readable' */
 	mem_flags = 0;
@@ -74,10 +143,16 @@ void mem_reset() {
 
 void mem_load_cartridge (FILE *cart) {
 	int flags = mem_flags;
-	update_mem_flags(0);
 
 	printf("loading cartridge image...\n");
 
+	/* .CRT containers are mapped as real cartridge hardware */
+	if (cart != NULL && cart_load_crt(cart) == 0) return;
+
+	/* otherwise it is a raw memory image for $8000-$ffff */
+	if (cart != NULL) rewind (cart);
+	update_mem_flags(0);
+
 	/* load cartridge into memory, if necessary */
 	if (cart != NULL) {
 		fread (readable + 0x8000, 0x8000, 1, cart);
@@ -91,26 +166,54 @@ void mem_load_cartridge (FILE *cart) {
 
 static unsigned char mem_read_io(int address) {
 
-	if (address < 0xd400) /* VIC video controller */
-		return vic_mem_read(address & 0x3f);
-	else if (address < 0xd800) /* SID sound synthesizer */
+	if (address < 0xd400) { /* VIC video controller */
+		/* only the raster registers are worked out when they are read */
+		if ((address & 0x3f) == 0x11 || (address & 0x3f) == 0x12)
+			return vic_mem_read(address & 0x3f);
 		return readable[address];
+	}
+	else if (address < 0xd800) /* SID sound synthesizer */
+		return sound_mem_read(address);
 	else if (address < 0xdc00) /* Color RAM */
 		return readable[address];
 	else if (address < 0xdd00) /* CIA1 Keyboard */
-		return readable[address];
+		return cia1_mem_read(address);
 	else if (address < 0xde00) /* CIA2 Serial Bus */
+		return cia2_mem_read(address);
+	else if (address >= 0xdf00 && reu_present()) /* I/O 2: REU */
+		return reu_mem_read(address);
+	else /* I/O 1 and 2: cartridge or disconnected */
 		return readable[address];
-	else return 0xff; /* Disconnected */
 }
 
 unsigned char mem_read_slow(int address) {
+	unsigned char value;
 
 	/* does the address reside in IO RAM? */
 	if (ram_page_flag[address >> 8] & PAGE_IO_RAM)
-		return mem_read_io(address);
+		value = mem_read_io(address);
+	else if (ram_page_flag[address >> 8] & PAGE_CART)
+		value = cart_page[address >> 8][address & 0xff];
 	else
-		return readable[address];
+		value = readable[address];
+
+	/* is somebody watching this page? */
+	if (ram_page_flag[address >> 8] & PAGE_WATCH_READ)
+		watch_hit(WATCH_READ, address, value);
+	return value;
+}
+
+unsigned char mem_fetch_slow(int address) {
+	unsigned char value;
+
+	if (ram_page_flag[address >> 8] & PAGE_CART)
+		value = cart_page[address >> 8][address & 0xff];
+	else
+		value = readable[address];
+
+	if (ram_page_flag[address >> 8] & PAGE_WATCH_EXEC)
+		watch_hit(WATCH_EXEC, address, value);
+	return value;
 }
 
 /******************* MEMORY WRITE ************************/
@@ -123,33 +226,33 @@ static void mem_write_io(int address, int value) {
 	DC00-DCFF   CIA1 (Keyboard)                       256 Bytes
 	DD00-DDFF   CIA2 (Serial Bus, User Port/RS-232)   256 Bytes
 	DE00-DEFF   Open I/O slot #1 (CP/M Enable)        256 Bytes
-	DF00-DFFF   Open I/O slot #2 (Disk)               256 Bytes
+	DF00-DFFF   Open I/O slot #2 (Disk, REU)          256 Bytes
 	*/
 
 	if (address < 0xd400) {/* VIC video controller */
 		vic_mem_write(address, value);
 	}
 	else if (address < 0xd800) { /* SID sound synthesizer */
-		readable[address] = 0xff;
+		sound_mem_write(address, value);
 	}
 	else if (address < 0xdc00) { /* Color RAM */
 		readable[address] = io_ram[address & 0x0fff] = value | 0xf0;
 		color_ram[address & 0x3ff] = value & 0x0f;
+		if (vic_deferred) vic_defer_color(address & 0x3ff, value & 0x0f);
 	}
 	else if (address < 0xdd00) { /* CIA1 Keyboard */
 		cia1_mem_write (address, value);
 	}
 	else if (address < 0xde00) { /* CIA2 Serial Bus */
-		readable[address] = value;
-		if (address == 0xdd00) mem_set_video_bank(value);
-#ifdef MEM_DEBUG
-		else fprintf(stderr,
-			"CIA 2 accessed at $%04x, set to #$%02x\n",
-			address, value);
-#endif
+		cia2_mem_write (address, value);
+	}
+	else if (address < 0xdf00) { /* I/O 1: cartridge */
+		if (!cart_io1_write (address, value)) readable[address] = 0xff;
 	}
-	else { /* Disconnected */
-		readable[address] = 0xff;
+	else { /* I/O 2: cartridge or RAM expansion unit */
+		if (cart_io2_write (address, value)) return;
+		if (reu_present()) reu_mem_write (address, value);
+		else readable[address] = 0xff; /* Disconnected */
 	}
 }
 
@@ -157,6 +260,8 @@ void mem_write(int address, int value) {
 
 	int page_flag = ram_page_flag[address >> 8];
 
+	heat_count(HEAT_WRITE, address);
+
 	/*
 	Writing to memory does extra work to ensure that it
 	always updates the 'readable' array after each write.
@@ -171,9 +276,23 @@ void mem_write(int address, int value) {
 
 	/* if we made it this far, the memory must be somehow special */
 
+	/* is somebody watching this page? */
+	if (page_flag & PAGE_WATCH_WRITE) watch_hit(WATCH_WRITE, address, value);
+
+	/* a pending REU transfer starts with a write to $ff00 */
+	if ((page_flag & PAGE_TRIGGER) && address == 0xff00) {
+		ram_64k[address] = value;
+		if (page_flag & PAGE_VIC) vic_defer_ram(address, value);
+		if ( !(page_flag & PAGE_ROM) ) readable[address] = value;
+		reu_trigger();
+		return;
+	}
+
 	/* writes always go to underlying ram, except in I/O address space */
 	if ( !(page_flag & PAGE_IO_RAM) ) {
 		ram_64k[address] = value;
+		/* is the VIC going to look at it later? */
+		if (page_flag & PAGE_VIC) vic_defer_ram(address, value);
 		/* put in readable unless in ROM memory */
 		if ( !(page_flag & PAGE_ROM) ) {
 			readable[address] = value;
@@ -181,6 +300,8 @@ void mem_write(int address, int value) {
 		/* are they changing the memory map? */
 		if (address == 0x0001) {
 			update_mem_flags(value & 0x07);
+			/* the cassette sense line reads back from the deck */
+			readable[address] = tape_port(value);
 			return;
 		}
 	} else {
@@ -189,6 +310,55 @@ void mem_write(int address, int value) {
 	}
 }
 
+/******************* BLOCK TRANSFERS *********************/
+
+/*
+  Block transfers (for DMA) see memory the same way the CPU does, but
+  copy whole pages with memcpy where nothing special lives in them.
+*/
+
+void mem_read_block(int address, unsigned char *dest, int count) {
+	int run, i;
+
+	while (count > 0) {
+		address &= 0xffff;
+		run = 0x100 - (address & 0xff);
+		if (run > count) run = count;
+
+		if (ram_page_flag[address >> 8] & (PAGE_IO_RAM | PAGE_WATCH_READ))
+			for (i=0; i<run; i++) dest[i] = mem_read(address + i);
+		else if (ram_page_flag[address >> 8] & PAGE_CART)
+			memcpy(dest, cart_page[address >> 8] + (address & 0xff), run);
+		else
+			memcpy(dest, readable + address, run);
+
+		dest += run;
+		address += run;
+		count -= run;
+	}
+}
+
+void mem_write_block(int address, const unsigned char *src, int count) {
+	int run, i;
+
+	while (count > 0) {
+		address &= 0xffff;
+		run = 0x100 - (address & 0xff);
+		if (run > count) run = count;
+
+		if (ram_page_flag[address >> 8])
+			for (i=0; i<run; i++) mem_write(address + i, src[i]);
+		else {
+			memcpy(ram_64k + address, src, run);
+			memcpy(readable + address, src, run);
+		}
+
+		src += run;
+		address += run;
+		count -= run;
+	}
+}
+
 
 /********************** VIDEO MEMORY CONFIGURATION *****************/
 
@@ -197,8 +367,25 @@ void mem_write(int address, int value) {
 /* bitmap        starts on 0x2000 boundary (bit 3)   */
 /* character map starts on 0x0800 boundary (bit 3-1) */
 
-void mem_set_video_memptr(int value) {
+/* work out the VIC's view of 'ram' for a bank and $d018 value */
+void mem_vic_pointers(vic_memory *vic, const unsigned char *ram,
+	const unsigned char *color, int bank, int memptr) {
 	int char_base;
+
+	vic->video_bank = ram + bank;
+	vic->video_matrix = ram + bank + ((memptr << 6) & (0x4000 - 0x0400));
+	vic->bitmap_base = ram + bank + ((memptr << 10) & (0x4000 - 0x2000));
+	vic->color_ram = color;
+
+	/* character rom images located at $1x00 and $9x00 */
+	char_base = bank + ((memptr << 10) & (0x4000 - 0x0800));
+	vic->character_base =
+		((char_base & 0x7000) == 0x1000) ?
+		character_rom + (char_base & 0x0fff) :
+		ram + char_base;
+}
+
+void mem_set_video_memptr(int value) {
 	/* D018   VIC Memory Control Register */
 
 	/* return immediately if nothing changed */
@@ -208,133 +395,213 @@ void mem_set_video_memptr(int value) {
 
 	mem_videoptr = value;
 
-	/* do video matrix memory pointer */
+	/* do video matrix and bitmap memory pointers */
 	mem_video_matrix = mem_videobank + ((value << 6) & (0x4000 - 0x0400));
-	video_matrix = ram_64k + mem_video_matrix;
-
-	/* do bitmap memory pointer */
 	mem_bitmap_base = mem_videobank + ((value << 10) & (0x4000 - 0x2000));
-	bitmap_base = ram_64k + mem_bitmap_base;
-
-	/* do character memory pointer */
-	char_base = mem_videobank + ((value << 10) & (0x4000 - 0x0800));
-
-	/* character rom images located at $1x00 and $9x00 */
-	character_base =
-		((char_base & 0x7000) == 0x1000) ?
-		character_rom + (char_base & 0x0fff) :
-		ram_64k + char_base;
+	mem_vic_pointers(&mem_vic, ram_64k, color_ram, mem_videobank, value);
 
 #ifdef MEM_DEBUG
-	if ((char_base & 0x7000) == 0x1000)
+	if (mem_vic.character_base < ram_64k ||
+		mem_vic.character_base >= ram_64k + 0x10000)
 		printf("reading characters from CHARGEN ROM\n");
-	printf("character base = $%04x\n", char_base);
 	printf("bitmap base = $%04x\n", mem_bitmap_base);
 	printf("video matrix = $%04x\n", mem_video_matrix);
 #endif
 
 }
 
+/* flag the 16K the VIC can see, so that writes to it are logged */
+static void set_vic_pages(int bank, int on) {
+	int page;
+	for (page = bank >> 8; page < (bank >> 8) + 0x40; page++) {
+		if (on) ram_page_flag[page] |= PAGE_VIC;
+		else ram_page_flag[page] &= ~PAGE_VIC;
+	}
+}
+
+void mem_set_vic_logging(int on) {
+	set_vic_pages(mem_videobank, on);
+}
+
 void mem_set_video_bank(int value) {
 	int new_videobank = ((~value) & 0x03) << 14;
 
 	if (new_videobank == mem_videobank) return;
 
+	if (vic_deferred) set_vic_pages(mem_videobank, 0);
 	mem_videobank = new_videobank;
-	video_bank = ram_64k + mem_videobank;
+	if (vic_deferred) {
+		set_vic_pages(mem_videobank, 1);
+		vic_defer_bank(mem_videobank);
+	}
 	mem_set_video_memptr(mem_videoptr);
 }
 
 
+/********************** WATCHPOINTS AND TRIGGERS ******************/
+
+void mem_set_page_watch(int page, int flags) {
+	ram_page_flag[page] &= ~PAGE_WATCH;
+	ram_page_flag[page] |= flags & PAGE_WATCH;
+}
+
+void mem_set_page_trigger(int page, int on) {
+	if (on) ram_page_flag[page] |= PAGE_TRIGGER;
+	else ram_page_flag[page] &= ~PAGE_TRIGGER;
+}
+
+
 /************************* ROM CONFIGURATION **********************/
 
-void update_mem_flags(int new_flags) {
-	const int load_basic[8]  = {0,0,0,1,0,0,0,1};
-	const int load_kernal[8] = {0,0,1,1,0,0,1,1};
-	const int load_io[8]     = {0,0,0,0,0,1,1,1};
-	const int load_char[8]   = {0,1,1,1,0,0,0,0};
-	int page;
+/*
+  The PLA maps four regions: $8000, $a000, $d000 and $e000. For each one
+  we remember what is currently copied into 'readable', so that switching
+  to a different ROM copies only the regions whose source actually
+  changed, and switching back and forth between the same configurations
+  costs nothing.
+
+  Cartridge banks are never copied. Their pages are flagged PAGE_CART and
+  read through cart_page, so a bank switch only changes a few pointers.
+*/
 
-	if (new_flags == mem_flags) return;
+static const int region_start[4] = { 0x8000, 0xa000, 0xd000, 0xe000 };
+static const int region_size[4]  = { 0x2000, 0x2000, 0x1000, 0x2000 };
 
-#ifdef MEM_DEBUG
-	printf("Memory configuration flags updated: %i\n", new_flags);
-#endif
+/* cartridge ROM banks currently presented to the PLA, and the state of
+   the EXROM and GAME lines (1 = pulled low by the cartridge) */
+static const unsigned char *cart_roml, *cart_romh;
+static int cart_exrom, cart_game;
 
-	/* should BASIC be loaded? */
-	if ( load_basic[new_flags] && !load_basic[mem_flags] ) {
-		/* copy basic rom into location a000 */
-#ifdef MEM_DEBUG
-		printf("BASIC loaded\n");
-#endif
-		memcpy (readable+0xa000, basic_rom, 0x2000);
-		for (page = 0xa0; page < 0xc0; page++)
-			ram_page_flag[page] |= PAGE_ROM;
-	}
-	/* should Kernal be loaded? */
-	if ( load_kernal[new_flags] && !load_kernal[mem_flags] ) {
-		/* copy kernal rom into location e000 */
-#ifdef MEM_DEBUG
-		printf("KERNAL loaded\n");
-#endif
-		memcpy (readable+0xe000, kernal_rom, 0x2000);
-		for (page = 0xe0; page < 0x100; page++)
-			ram_page_flag[page] |= PAGE_ROM;
-	}
-	/* should I/O be loaded? */
-	if ( load_io[new_flags] && !load_io[mem_flags] ) {
+static void map_region(int region, const unsigned char *source, int flag) {
+	int start = region_start[region];
+	int page, i;
+
+	if (source == SOURCE_RAM) flag = 0;
+
+	if (source != region_source[region]) {
 #ifdef MEM_DEBUG
-		printf("I/O loaded\n");
+		printf("$%04x: %s loaded\n", start,
+			source == SOURCE_RAM ? "RAM" :
+			source == basic_rom ? "BASIC" :
+			source == kernal_rom ? "KERNAL" :
+			source == character_rom ? "CHARGEN" : "I/O");
 #endif
-		memcpy (readable+0xd000, io_ram, 0x1000);
-		for (page = 0xd0; page < 0xe0; page++) {
-			ram_page_flag[page] |= PAGE_IO_RAM;
-			ram_page_flag[page] &= ~(PAGE_ROM);
+		memcpy(readable + start,
+			source == SOURCE_RAM ? ram_64k + start : source,
+			region_size[region]);
+		region_source[region] = source;
+
+		/* put 0x02 at start of all highlevel routines */
+		if (source == kernal_rom) {
+			for (i=0; i < KERNAL_TRAPS; i++)
+				readable[kernal_traps[i]] = 0x02;
 		}
 	}
-	/* should CHARGEN be loaded? */
-	if ( load_char[new_flags] && !load_char[mem_flags] ) {
-#ifdef MEM_DEBUG
-		printf("CHARGEN loaded\n");
-#endif
-		memcpy (readable+0xd000, character_rom, 0x1000);
-		for (page = 0xd0; page < 0xe0; page++) {
-			ram_page_flag[page] |= PAGE_ROM;
-			ram_page_flag[page] &= ~(PAGE_IO_RAM);
-		}
+
+	for (page = start >> 8; page < (start + region_size[region]) >> 8; page++) {
+		ram_page_flag[page] &=
+			~(PAGE_ROM | PAGE_IO_RAM | PAGE_IO_READ | PAGE_CART);
+		ram_page_flag[page] |= flag;
 	}
 
-	/* should BASIC be unloaded? */
-	if ( !load_basic[new_flags] && load_basic[mem_flags] ) {
-		/* copy ram into location a000 */
-#ifdef MEM_DEBUG
-		printf("BASIC unloaded\n");
-#endif
-		memcpy( readable+0xa000, ram_64k+0xa000, 0x2000);
-		for (page = 0xa0; page < 0xc0; page++)
-			ram_page_flag[page] &= ~(PAGE_ROM);
+	if (source == io_ram) mem_update_io_reads();
+}
+
+/* the VIC, the SID, the CIAs and the REU compute their registers when
+   read; called again when the REU is plugged in */
+void mem_update_io_reads(void) {
+	int page;
+
+	if (region_source[2] != io_ram) return;
+	for (page = 0xd0; page < 0xd8; page++)
+		ram_page_flag[page] |= PAGE_IO_READ;
+	ram_page_flag[0xdc] |= PAGE_IO_READ;
+	ram_page_flag[0xdd] |= PAGE_IO_READ;
+	if (reu_present()) ram_page_flag[0xdf] |= PAGE_IO_READ;
+}
+
+/* a missing chip reads as open bus */
+static void map_cart(int region, const unsigned char *bank) {
+	int start = region_start[region];
+	int page;
+
+	if (bank == NULL) bank = open_bus;
+
+	/* 'readable' no longer holds what is mapped here */
+	region_source[region] = SOURCE_CART;
+
+	for (page = start >> 8; page < (start + region_size[region]) >> 8; page++) {
+		ram_page_flag[page] &= ~(PAGE_IO_RAM | PAGE_IO_READ);
+		ram_page_flag[page] |= PAGE_ROM | PAGE_CART;
+		cart_page[page] = bank + ((page << 8) - start);
 	}
-	/* should Kernal be unloaded? */
-	if ( !load_kernal[new_flags] && load_kernal[mem_flags] ) {
-		/* copy ram into location e000 */
-#ifdef MEM_DEBUG
-		printf("KERNAL unloaded\n");
-#endif
-		memcpy( readable+0xe000, ram_64k+0xe000, 0x2000);
-		for (page = 0xc0; page < 0x100; page++)
-			ram_page_flag[page] &= ~(PAGE_ROM);
+}
+
+static void update_mem_map(void) {
+	int loram = mem_flags & 1;
+	int hiram = mem_flags & 2;
+	int charen = mem_flags & 4;
+
+	/* ultimax mode: cartridge replaces BASIC and KERNAL, I/O always on */
+	if (cart_game && !cart_exrom) {
+		map_cart(0, cart_roml);
+		map_region(1, SOURCE_RAM, 0);
+		map_region(2, io_ram, PAGE_IO_RAM);
+		map_cart(3, cart_romh);
+		return;
 	}
-	/* should IO/C be unloaded? */
-	if ( !load_io[new_flags] && !load_char[new_flags] ) {
-		/* copy ram into location d000 */
+
+	/* $8000: cartridge ROML (8K and 16K modes) */
+	if (cart_exrom && loram && hiram)
+		map_cart(0, cart_roml);
+	else
+		map_region(0, SOURCE_RAM, 0);
+
+	/* $a000: cartridge ROMH (16K mode) or BASIC */
+	if (cart_exrom && cart_game && hiram)
+		map_cart(1, cart_romh);
+	else if (!cart_game && loram && hiram)
+		map_region(1, basic_rom, PAGE_ROM);
+	else
+		map_region(1, SOURCE_RAM, 0);
+
+	/* $d000: I/O or CHARGEN */
+	if (!loram && !hiram)
+		map_region(2, SOURCE_RAM, 0);
+	else if (charen)
+		map_region(2, io_ram, PAGE_IO_RAM);
+	else if (cart_game && !hiram)
+		map_region(2, SOURCE_RAM, 0);
+	else
+		map_region(2, character_rom, PAGE_ROM);
+
+	/* $e000: KERNAL */
+	if (hiram)
+		map_region(3, kernal_rom, PAGE_ROM);
+	else
+		map_region(3, SOURCE_RAM, 0);
+}
+
+void update_mem_flags(int new_flags) {
+
+	if (new_flags == mem_flags) return;
+
 #ifdef MEM_DEBUG
-		printf("IO/CHAR unloaded\n");
+	printf("Memory configuration flags updated: %i\n", new_flags);
 #endif
-		memcpy( readable+0xd000, ram_64k+0xd000, 0x1000);
-		for (page = 0xc0; page < 0x100; page++)
-			ram_page_flag[page] &= ~(PAGE_ROM | PAGE_IO_RAM);
-	}
 
 	/* update flag values */
 	mem_flags = new_flags;
+	update_mem_map();
+}
+
+/* called by the cartridge whenever it switches banks or lines */
+void mem_set_cartridge(const unsigned char *roml, const unsigned char *romh,
+	int exrom, int game) {
+
+	cart_roml = roml;
+	cart_romh = romh;
+	cart_exrom = exrom;
+	cart_game = game;
+	update_mem_map();
 }
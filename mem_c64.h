@@ -7,19 +7,33 @@
 #define MEM_C64_H
 
 #include <stdio.h>
+#include "watch.h"
+#include "heatmap.h"
 
 /* declare arrays for memory storage */
 extern unsigned char ram_64k[0x10000];
 extern unsigned char readable[0x10000];
 extern unsigned char io_ram[0x1000];
-extern unsigned char character_rom[0x1000];
 extern unsigned char color_ram[0x0400];
 
+/* ROM images are read only and shared with every other process
+   running the emulator (see mem_init) */
+extern const unsigned char *kernal_rom;
+extern const unsigned char *basic_rom;
+extern const unsigned char *character_rom;
+
 extern unsigned char *stack;
-extern unsigned char *character_base;
-extern unsigned char *video_matrix;
-extern unsigned char *bitmap_base;
-extern unsigned char *video_bank;
+
+/* the memory the VIC fetches from; see mem_vic_pointers */
+typedef struct vic_memory_s {
+	const unsigned char *video_matrix;
+	const unsigned char *character_base;
+	const unsigned char *bitmap_base;
+	const unsigned char *video_bank;
+	const unsigned char *color_ram;
+} vic_memory;
+
+extern vic_memory mem_vic;
 extern int mem_video_matrix, mem_bitmap_base;
 extern int mem_videoptr, mem_videobank;
 
@@ -27,59 +41,72 @@ extern int mem_videoptr, mem_videobank;
 /* bit0 = LORAM; bit1 = HIRAM; bit2 = CHAREN */
 extern int mem_flags;
 
+/* 256 pages of 256 bytes each; this table marks which are ordinary RAM */
+#define PAGE_ZERO          (1<<0)
+#define PAGE_IO_RAM        (1<<1)
+#define PAGE_ROM           (1<<2)
+#define PAGE_WATCH_READ    (1<<3)
+#define PAGE_WATCH_WRITE   (1<<4)
+#define PAGE_WATCH_EXEC    (1<<5)
+#define PAGE_TRIGGER       (1<<6)
+#define PAGE_IO_READ       (1<<7)   /* reads have to ask the chip */
+#define PAGE_VIC           (1<<8)   /* writes are logged for the VIC */
+#define PAGE_CART          (1<<9)   /* reads come from a cartridge bank */
+
+#define PAGE_WATCH (PAGE_WATCH_READ | PAGE_WATCH_WRITE | PAGE_WATCH_EXEC)
+
+extern int ram_page_flag[0x100];
+
+unsigned char mem_read_slow(int address);
+unsigned char mem_fetch_slow(int address);
 
 /***************************************/
 /* static inline function declarations */
 /***************************************/
 
 static inline unsigned char mem_read(int address) {
+	heat_count(HEAT_READ, address);
+	/* only watched pages and live chip registers leave the fast path */
+	if (ram_page_flag[address >> 8] &
+		(PAGE_WATCH_READ | PAGE_IO_READ | PAGE_CART))
+		return mem_read_slow(address);
 	return (readable[address]);
 }
 
 static inline int mem_read_16(int address) {
 	/* #define mem_read_16(addr) (*((short*)&mem_read(addr)) & 0xffff) */
-	return (readable[address] + (readable[address+1]<<8));
+	return (mem_read(address) + (mem_read(address+1)<<8));
+}
+
+/* opcode fetch; this is where execution breakpoints are caught */
+static inline unsigned char mem_fetch(int address) {
+	heat_count(HEAT_FETCH, address);
+	if (ram_page_flag[address >> 8] & (PAGE_WATCH_EXEC | PAGE_CART))
+		return mem_fetch_slow(address);
+	return (readable[address]);
 }
 
 static inline unsigned char stack_read(int address) {
+	heat_count(HEAT_READ, 0x100 + address);
+	if (ram_page_flag[0x01] & PAGE_WATCH_READ)
+		return mem_read_slow(0x100 + address);
 	return (stack[address]);
 }
 
 static inline int stack_read_16(int address) {
-	return (stack[address] + (stack[address+1]<<8));
+	return (stack_read(address) + (stack_read(address+1)<<8));
 }
 
 static inline void stack_write(int address, int value) {
+	heat_count(HEAT_WRITE, 0x100 + address);
+	if (ram_page_flag[0x01] & PAGE_WATCH_WRITE)
+		watch_hit(WATCH_WRITE, 0x100 + address, value);
 	stack[address] = value;
 }
 
 static inline void mem_io_write(int address, int value) {
 	io_ram[address & 0x0fff] = value;
-	if (mem_flags >= 5) readable[address] = value;
-}
-
-/******************************************/
-/* inline functions for vic memory access */
-/******************************************/
-
-static inline unsigned char mem_read_color_ram(int address) {
-	return color_ram[address];
-}
-
-static inline unsigned char mem_read_video_matrix(int address) {
-	return video_matrix[address];
-}
-
-static inline unsigned char mem_read_character_base(int address) {
-	return character_base[address];
-}
-
-static inline unsigned char mem_read_bitmap_base(int address) {
-	return bitmap_base[address];
-}
-
-static inline unsigned char mem_read_video_bank(int address) {
-	return video_bank[address];
+	if (ram_page_flag[address >> 8] & PAGE_IO_RAM) readable[address] = value;
 }
 
 /*****************************/
@@ -87,13 +114,25 @@ static inline unsigned char mem_read_video_bank(int address) {
 /*****************************/
 
 void mem_init( FILE *fk, FILE *fb, FILE *fc );
+const unsigned char *mem_load_rom( FILE *f, int size );
+int mem_footprint(void);
 void mem_reset();
 void mem_load_cartridge( FILE *cart );
 
 void mem_write(int address, int value);
+void mem_read_block(int address, unsigned char *dest, int count);
+void mem_write_block(int address, const unsigned char *src, int count);
 
 void update_mem_flags(int new_flags);
+void mem_set_cartridge(const unsigned char *roml, const unsigned char *romh,
+	int exrom, int game);
+void mem_set_page_watch(int page, int flags);
+void mem_set_page_trigger(int page, int on);
+void mem_update_io_reads(void);
 void mem_set_video_memptr(int value);
 void mem_set_video_bank(int value);
+void mem_vic_pointers(vic_memory *vic, const unsigned char *ram,
+	const unsigned char *color, int bank, int memptr);
+void mem_set_vic_logging(int on);
 
 #endif
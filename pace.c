@@ -0,0 +1,179 @@
+/* pace.c - real time pacing for c64 emulator */
+
+#include <stdio.h>
+#include <time.h>
+#include <errno.h>
+#include <math.h>
+#include <sys/time.h>
+#include "pace.h"
+#include "vic2.h"
+#include "6510.h"
+#include "log.h"
+
+#if defined(CLOCK_MONOTONIC) && defined(TIMER_ABSTIME) && !defined(__APPLE__)
+#define PACE_ABSOLUTE_SLEEP
+#endif
+
+/* lag absorbed per slice, as a shift; lags under LAG_NS are only the
+   host waking us late, and lags beyond STALL_NS are stalls */
+#define PHASE_GAIN 3
+#define LAG_NS     1000000LL
+#define STALL_NS   250000000LL
+#define MAX_BIAS   1000000LL
+
+typedef long long nsec_t;
+
+static nsec_t base_ns;           /* wall time of cycle base_cycle */
+static cycle_t base_cycle;
+static nsec_t wake_bias = 0;     /* how late the host wakes us */
+static int paced = 1;
+
+static event *slice_event = NULL;
+static cycle_t slice_frame;      /* start of the frame being sliced */
+static int slice_lines, slice_line;
+
+/* statistics */
+static int stat_frames, stat_late;
+static nsec_t stat_last, stat_start, stat_slept;
+static double stat_sum, stat_sumsq, stat_min, stat_max;
+
+static nsec_t now_ns (void) {
+#ifdef CLOCK_MONOTONIC
+	struct timespec ts;
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return (nsec_t) ts.tv_sec * 1000000000LL + ts.tv_nsec;
+#else
+	struct timeval tv;
+	gettimeofday (&tv, NULL);
+	return (nsec_t) tv.tv_sec * 1000000000LL + tv.tv_usec * 1000LL;
+#endif
+}
+
+static void sleep_until (nsec_t when) {
+	struct timespec ts;
+#ifdef PACE_ABSOLUTE_SLEEP
+	ts.tv_sec = when / 1000000000LL;
+	ts.tv_nsec = when % 1000000000LL;
+	while (clock_nanosleep (CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+		;
+#else
+	nsec_t left = when - now_ns ();
+	if (left <= 0) return;
+	ts.tv_sec = left / 1000000000LL;
+	ts.tv_nsec = left % 1000000000LL;
+	while (nanosleep (&ts, &ts) < 0 && errno == EINTR)
+		;
+#endif
+}
+
+/* wall clock time at which the cpu should reach 'cycle' */
+static nsec_t target_ns (cycle_t cycle) {
+	return base_ns +
+		(nsec_t) ((double) (cycle - base_cycle) * 1e9 / machine.clock_hz);
+}
+
+/* sleep until the cpu clock is due; returns how late we were (ns) */
+static nsec_t pace_wait (void) {
+	cycle_t cycle = cpu6510_clock ();
+	nsec_t target = target_ns (cycle), now = now_ns (), error;
+
+	if (!paced) return 0;
+	if (now < target - wake_bias) {
+		sleep_until (target - wake_bias);
+		error = now_ns ();
+		stat_slept += error - now;
+		now = error;
+
+		/* learn how long the host oversleeps, a little at a time */
+		wake_bias += (now - target) >> 3;
+		if (wake_bias < 0) wake_bias = 0;
+		if (wake_bias > MAX_BIAS) wake_bias = MAX_BIAS;
+	}
+
+	error = now - target;
+	if (error > STALL_NS) {
+		/* stopped in the debugger, or the machine was asleep */
+		log_msg (LOG_VIDEO, LOG_DEBUG, "pace: %lli ms stall", error / 1000000);
+		base_ns += error;
+	} else if (error > LAG_NS) {
+		/* behind: drift back into step rather than run flat out */
+		base_ns += error >> PHASE_GAIN;
+	}
+	return error;
+}
+
+static void callback_slice (void *data) {
+	pace_wait ();
+
+	/* the frame boundary itself is paced by pace_frame */
+	slice_line += slice_lines;
+	if (slice_line >= LINES_PER_FRAME) {
+		slice_line = slice_lines;
+		slice_frame += CYCLES_PER_FRAME;
+	}
+	event_schedule (slice_event, slice_frame + slice_line * CYCLES_PER_LINE);
+}
+
+/******************** INTERFACE *************************/
+
+/* warp mode turns pacing off */
+void pace_enable (int on) {
+	if (on && !paced) pace_sync ();
+	paced = on;
+}
+
+void pace_sync (void) {
+	base_ns = now_ns ();
+	base_cycle = cpu6510_clock ();
+	stat_last = 0;
+}
+
+void pace_start (int lines) {
+	pace_sync ();
+	pace_reset_stats ();
+
+	if (lines <= 0 || lines >= LINES_PER_FRAME) return;
+	slice_lines = slice_line = lines;
+	slice_frame = base_cycle;
+	if (slice_event == NULL) slice_event = event_new (callback_slice, NULL);
+	event_schedule (slice_event, slice_frame + slice_line * CYCLES_PER_LINE);
+}
+
+int pace_frame (void) {
+	nsec_t late = pace_wait (), now = now_ns ();
+	double ms;
+
+	if (late > 1000000) stat_late++;
+	if (stat_last) {
+		ms = (now - stat_last) / 1e6;
+		stat_sum += ms;
+		stat_sumsq += ms * ms;
+		if (ms < stat_min) stat_min = ms;
+		if (ms > stat_max) stat_max = ms;
+		stat_frames++;
+	}
+	stat_last = now;
+	return (int) (late / 1000000);
+}
+
+void pace_get_stats (pace_stats *s) {
+	int n = stat_frames;
+	nsec_t elapsed = now_ns () - stat_start;
+
+	s->frames = n;
+	s->late = stat_late;
+	s->mean_ms = n ? stat_sum / n : 0;
+	s->jitter_ms = n ? sqrt (fabs (stat_sumsq / n - s->mean_ms * s->mean_ms)) : 0;
+	s->min_ms = n ? stat_min : 0;
+	s->max_ms = n ? stat_max : 0;
+	s->idle = elapsed > 0 ? (double) stat_slept / elapsed : 0;
+}
+
+void pace_reset_stats (void) {
+	stat_frames = stat_late = 0;
+	stat_sum = stat_sumsq = 0;
+	stat_min = 1e9;
+	stat_max = 0;
+	stat_slept = 0;
+	stat_start = now_ns ();
+}
@@ -0,0 +1,41 @@
+/* pace.h - real time pacing for c64 emulator */
+
+#ifndef __PACE_H
+#define __PACE_H
+
+#include "event.h"
+
+typedef struct pace_stats_s {
+	int frames;           /* frames paced since the last reset */
+	int late;             /* frames that started behind real time */
+	double mean_ms;       /* time between frames */
+	double jitter_ms;     /* standard deviation of the same */
+	double min_ms, max_ms;
+	double idle;          /* fraction of the time spent asleep */
+} pace_stats;
+
+/* start pacing the cpu, waking every 'slice_lines' raster lines */
+void pace_start (int slice_lines);
+
+/* wait for the frame boundary; returns how late we are, in ms */
+int pace_frame (void);
+
+/* forget the past, e.g. after a pause */
+void pace_sync (void);
+void pace_enable (int on);
+
+void pace_get_stats (pace_stats *stats);
+void pace_reset_stats (void);
+
+/*
+  Emulated time is tied to the host's monotonic clock: cycle n should
+  happen at base + n / clock_hz, for the clock of the machine model (see
+  timing.h). The cpu runs in slices of a few raster lines, and sleeps at
+  the end of each slice until its wall clock time (an absolute sleep, so
+  errors don't add up). Running late doesn't reset the clock: a fraction
+  of the lag is absorbed every slice, like the phase correction of a
+  PLL, and the time the host takes to wake us up is learned and slept
+  off early.
+*/
+
+#endif
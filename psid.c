@@ -0,0 +1,323 @@
+/* psid.c - headless PSID music renderer for c64 emulator */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include "psid.h"
+#include "mem_c64.h"
+#include "vic2.h"
+#include "sound.h"
+#include "6510.h"
+
+#define HEADER_SIZE 0x7c
+#define SAMPLE_RATE 44100
+
+typedef struct psid_header_s {
+	int version, data_offset;
+	int load, init, play;
+	int songs, start_song;
+	unsigned long speed;
+	char name[33];
+	int ntsc, sid_8580;
+	int free_page, free_pages;
+} psid_header;
+
+static unsigned char image[HEADER_SIZE + 0x10000];
+static int image_size;
+static psid_header header;
+
+static event *frame_event, *end_event;
+static cycle_t end_time;
+static double start_time;
+static const char *tune_name;
+static int tune_song, tune_seconds;
+
+static double now_seconds (void) {
+	struct timeval tv;
+
+	gettimeofday (&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+/******************** LOADING *************************/
+
+static int be16 (const unsigned char *p) {
+	return (p[0] << 8) | p[1];
+}
+
+static int load_psid (const char *name) {
+	FILE *f = fopen (name, "rb");
+	const unsigned char *h = image;
+	int flags;
+
+	if (f == NULL) return -1;
+	image_size = fread (image, 1, sizeof(image), f);
+	fclose (f);
+
+	if (image_size < 0x76 || memcmp (h, "PSID", 4)) return -1;
+	header.version = be16 (h + 4);
+	header.data_offset = be16 (h + 6);
+	header.load = be16 (h + 8);
+	header.init = be16 (h + 10);
+	header.play = be16 (h + 12);
+	header.songs = be16 (h + 14);
+	header.start_song = be16 (h + 16);
+	header.speed = ((unsigned long) be16 (h + 18) << 16) | be16 (h + 20);
+	memcpy (header.name, h + 0x16, 32);
+	header.name[32] = 0;
+
+	header.ntsc = header.sid_8580 = 0;
+	header.free_page = header.free_pages = 0;
+	if (header.version >= 2 && image_size >= HEADER_SIZE) {
+		flags = be16 (h + 0x76);
+		header.ntsc = ((flags >> 2) & 3) == 2;
+		header.sid_8580 = ((flags >> 4) & 3) == 2;
+		header.free_page = h[0x78];
+		header.free_pages = h[0x79];
+	}
+
+	/* the load address may be the first two bytes of the data */
+	if (header.data_offset >= image_size) return -1;
+	if (header.load == 0) {
+		header.load = image[header.data_offset] |
+			(image[header.data_offset + 1] << 8);
+		header.data_offset += 2;
+	}
+	if (header.init == 0) header.init = header.load;
+	return 0;
+}
+
+/******************** DRIVER *************************/
+
+/*
+  main:    LDX #$FF / TXS / SEI / LDA #bank / STA $01
+           LDA #song / JSR init / CLI
+  idle:    JMP idle
+  irq:     PHA / TXA / PHA / TYA / PHA         (from $FFFE)
+  kernal:  LDA $01 / PHA / LDA #bank / STA $01  (from $0314)
+           JSR play / PLA / STA $01
+           LDA $DC0D / LDA #$0F / STA $D019     (acknowledge both)
+           PLA / TAY / PLA / TAX / PLA / RTI
+*/
+static const unsigned char driver_code[] = {
+	0xa2, 0xff, 0x9a, 0x78, 0xa9, 0x00, 0x85, 0x01,
+	0xa9, 0x00, 0x20, 0x00, 0x00, 0x58,
+	0x4c, 0x00, 0x00,
+	0x48, 0x8a, 0x48, 0x98, 0x48,
+	0xa5, 0x01, 0x48, 0xa9, 0x00, 0x85, 0x01,
+	0x20, 0x00, 0x00, 0x68, 0x85, 0x01,
+	0xad, 0x0d, 0xdc, 0xa9, 0x0f, 0x8d, 0x19, 0xd0,
+	0x68, 0xa8, 0x68, 0xaa, 0x68, 0x40
+};
+
+#define DRIVER_BANK1  5
+#define DRIVER_SONG   9
+#define DRIVER_INIT   11
+#define DRIVER_IDLE   14
+#define DRIVER_IRQ    17
+#define DRIVER_KERNAL 22
+#define DRIVER_BANK2  26
+#define DRIVER_PLAY   30
+#define DRIVER_RTI    (sizeof(driver_code) - 1)
+
+static int overlaps (int start, int size, int other, int other_size) {
+	return start < other + other_size && other < start + size;
+}
+
+/* somewhere the tune doesn't use: where it says, or the first free page */
+static int driver_address (int data_size) {
+	int page;
+
+	if (header.free_page != 0 && header.free_page != 0xff)
+		return header.free_page << 8;
+	if (!overlaps (0x0334, sizeof(driver_code), header.load, data_size))
+		return 0x0334;
+	for (page = 0x04; page < 0xd0; page++)
+		if (!overlaps (page << 8, 0x100, header.load, data_size))
+			return page << 8;
+	return -1;
+}
+
+static void put16 (unsigned char *p, int value) {
+	p[0] = value & 0xff;
+	p[1] = value >> 8;
+}
+
+/* the memory configuration the tune's routines run with */
+static int tune_bank (int data_size) {
+	int top = header.load + data_size;
+
+	if (header.init > top) top = header.init;
+	if (header.play > top) top = header.play;
+	if (top <= 0xa000) return 0x37;
+	if (top <= 0xd000) return 0x36;
+	return 0x35;
+}
+
+static int install (int song) {
+	unsigned char code[sizeof(driver_code)], vector[2];
+	int data_size = image_size - header.data_offset, at, bank;
+
+	if (header.load + data_size > 0x10000) data_size = 0x10000 - header.load;
+	at = driver_address (data_size);
+	if (at < 0) return -1;
+	bank = tune_bank (data_size);
+
+	memcpy (code, driver_code, sizeof(code));
+	code[DRIVER_BANK1] = code[DRIVER_BANK2] = bank;
+	code[DRIVER_SONG] = song - 1;
+	put16 (code + DRIVER_INIT, header.init);
+	put16 (code + DRIVER_IDLE + 1, at + DRIVER_IDLE);
+	put16 (code + DRIVER_PLAY, header.play);
+
+	/* everything goes into RAM, under the ROMs and I/O */
+	update_mem_flags (0);
+	mem_write_block (header.load, image + header.data_offset, data_size);
+	mem_write_block (at, code, sizeof(code));
+
+	/* tunes with a play routine of 0 set up their own interrupts */
+	if (header.play != 0) {
+		put16 (vector, at + DRIVER_IRQ);
+		mem_write_block (0xfffe, vector, 2);
+		put16 (vector, at + DRIVER_KERNAL);
+		mem_write_block (0x0314, vector, 2);
+	}
+	put16 (vector, at + DRIVER_RTI);
+	mem_write_block (0xfffa, vector, 2);
+	mem_write_block (0x0318, vector, 2);
+	update_mem_flags (7);
+
+	cpu6510_jump (at);
+	return 0;
+}
+
+/* speed bit set: the CIA1 timer, as the KERNAL sets it up; clear: the
+   raster interrupt, once a frame */
+static void start_timer (int song) {
+	int bit = (song > 32) ? 31 : song - 1;
+	int latch = header.ntsc ? 0x4295 : 0x4025;
+
+	if ((header.speed >> bit) & 1) {
+		mem_write (0xdc04, latch & 0xff);
+		mem_write (0xdc05, latch >> 8);
+		mem_write (0xdc0d, 0x81);
+		mem_write (0xdc0e, 0x11);
+	} else {
+		mem_write (0xdc0d, 0x7f);
+		mem_write (0xd011, 0x1b);
+		mem_write (0xd012, 0x00);
+		mem_write (0xd01a, 0x01);
+	}
+}
+
+/******************** RENDERING *************************/
+
+static void callback_frame (void *data) {
+	sound_frame ();
+	event_schedule (frame_event, event_time (frame_event) + CYCLES_PER_FRAME);
+}
+
+static void callback_end (void *data) {
+	double elapsed = now_seconds () - start_time;
+
+	printf ("%s: \"%s\" song %i, %i s in %.2f s, %.1fx real time\n",
+		tune_name, header.name, tune_song, tune_seconds, elapsed,
+		elapsed > 0 ? tune_seconds / elapsed : 0);
+	/* the WAV file is finished at exit */
+	exit (0);
+}
+
+static char *wav_name (const char *name) {
+	char *out = malloc (strlen (name) + 5), *dot;
+
+	if (out == NULL) {
+		fprintf (stderr, "couldn't allocate file name\n");
+		exit (1);
+	}
+	strcpy (out, name);
+	dot = strrchr (out, '.');
+	if (dot != NULL && strchr (dot, '/') == NULL) *dot = 0;
+	strcat (out, ".wav");
+	return out;
+}
+
+/* runs in a process of its own */
+static void render (const char *name, int seconds, int song, int sid_model) {
+	if (load_psid (name) < 0) {
+		printf ("%s: not a PSID file\n", name);
+		exit (1);
+	}
+	if (song <= 0 || song > header.songs) song = header.start_song;
+	if (song <= 0) song = 1;
+	tune_name = name;
+	tune_song = song;
+	tune_seconds = seconds;
+
+	timing_select (header.ntsc ? "ntsc" : "pal");
+	if (sid_model < 0) sid_model = header.sid_8580 ? SID_8580 : SID_6581;
+	sound_init (sid_model, SAMPLE_RATE, 0, wav_name (name));
+
+	if (install (song) < 0) {
+		printf ("%s: no room for the driver\n", name);
+		exit (1);
+	}
+	start_timer (song);
+
+	frame_event = event_new (callback_frame, NULL);
+	event_schedule (frame_event, cpu6510_clock () + CYCLES_PER_FRAME);
+	end_time = cpu6510_clock () + (cycle_t) seconds * machine.clock_hz;
+	end_event = event_new (callback_end, NULL);
+	event_schedule (end_event, end_time);
+	vic_start_raster ();
+
+	start_time = now_seconds ();
+	cpu6510_main ();
+}
+
+static int processors (void) {
+#ifdef _SC_NPROCESSORS_ONLN
+	long n = sysconf (_SC_NPROCESSORS_ONLN);
+	if (n > 0) return (int) n;
+#endif
+	return 1;
+}
+
+void psid_render_files (char **files, int count, int seconds, int song,
+	int sid_model, int jobs) {
+	int next = 0, running = 0, failed = 0, status;
+	double start = now_seconds (), elapsed;
+	pid_t pid;
+
+	if (jobs <= 0) jobs = processors ();
+	if (seconds <= 0) seconds = 1;
+	printf ("rendering %i tunes, %i at a time\n", count, jobs);
+
+	while (next < count || running > 0) {
+		if (next < count && running < jobs) {
+			/* don't let the children inherit unwritten output */
+			fflush (stdout);
+			pid = fork ();
+			if (pid == 0) render (files[next], seconds, song, sid_model);
+			if (pid < 0) {
+				printf ("%s: couldn't start a process\n", files[next]);
+				failed++;
+			} else running++;
+			next++;
+			continue;
+		}
+		if (wait (&status) > 0) {
+			running--;
+			if (!WIFEXITED (status) || WEXITSTATUS (status) != 0) failed++;
+		}
+	}
+
+	elapsed = now_seconds () - start;
+	printf ("%i tunes (%i failed), %i s of music each, in %.2f s: "
+		"%.1fx real time overall\n", count, failed, seconds, elapsed,
+		elapsed > 0 ? (count - failed) * seconds / elapsed : 0);
+	exit (failed ? 1 : 0);
+}
@@ -0,0 +1,24 @@
+/* psid.h - headless PSID music renderer for c64 emulator */
+
+#ifndef __PSID_H
+#define __PSID_H
+
+/* render 'seconds' of each PSID file to a WAV file beside it, 'jobs'
+   files at a time (0: one per processor); 'song' 0 is the default one
+   and 'sid_model' -1 the one the file asks for. Doesn't return. */
+void psid_render_files (char **files, int count, int seconds, int song,
+	int sid_model, int jobs);
+
+/*
+  The machine has a lot of global state, so every tune gets a process
+  of its own: a copy of the machine as it is after loading the ROMs,
+  which the tune is loaded into. Nothing opens SDL or draws; the VIC
+  only runs its raster, for tunes paced by the vertical blank.
+
+  A small driver in RAM calls the tune's init routine and then idles,
+  while the play routine is called from the IRQ handler: the CIA1 timer
+  or the VIC raster interrupt, as the header says, both of them
+  scheduler events like everywhere else.
+*/
+
+#endif
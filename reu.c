@@ -0,0 +1,317 @@
+/* reu.c - RAM expansion unit (1700/1764/1750) for c64 emulator */
+
+/*
+  DMA transfers run in one go, as host memcpy/memcmp over whole runs of
+  bytes, instead of one byte per cycle. The CPU is charged one cycle per
+  byte transferred, which is what the real REU steals from it.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "reu.h"
+#include "mem_c64.h"
+#include "6510.h"
+
+/* status register */
+#define STATUS_IRQ     0x80
+#define STATUS_EOB     0x40
+#define STATUS_FAULT   0x20
+#define STATUS_256K    0x10
+
+/* command register */
+#define CMD_EXECUTE    0x80
+#define CMD_AUTOLOAD   0x20
+#define CMD_NO_FF00    0x10
+
+/* interrupt mask register */
+#define MASK_ENABLE    0x80
+#define MASK_EOB       0x40
+#define MASK_FAULT     0x20
+
+/* address control register */
+#define FIX_C64        0x80
+#define FIX_REU        0x40
+
+enum { STASH, FETCH, SWAP, VERIFY };
+
+static unsigned char *reu_ram = NULL;
+static int reu_size = 0;
+
+static int status, command, irq_mask, address_control;
+static int c64_address, reu_address, length;
+static int c64_shadow, reu_shadow, length_shadow;
+
+/* scratch buffers for one transfer, allocated with the expansion */
+static unsigned char *block = NULL, *other = NULL;
+
+/* write 8 copies of the registers into io space */
+static void set_register (int reg, int data) {
+	int offset;
+	for (offset = 0xdf00 + reg; offset < 0xe000; offset += 0x20)
+		mem_io_write (offset, data);
+}
+
+static void update_registers (void) {
+	int bank_bits = (reu_size - 1) >> 16;
+
+	set_register (0x00, status);
+	set_register (0x01, command);
+	set_register (0x02, c64_address & 0xff);
+	set_register (0x03, c64_address >> 8);
+	set_register (0x04, reu_address & 0xff);
+	set_register (0x05, (reu_address >> 8) & 0xff);
+	/* unconnected bank bits read as 1 */
+	set_register (0x06, (reu_address >> 16) | (~bank_bits & 0xff));
+	set_register (0x07, length & 0xff);
+	set_register (0x08, (length >> 8) & 0xff);
+	set_register (0x09, irq_mask | 0x1f);
+	set_register (0x0a, address_control | 0x3f);
+}
+
+int reu_init (int kbytes) {
+	int reg, size = 128;
+
+	/* round up to a supported size */
+	while (size < kbytes && size < REU_MAX_KB) size <<= 1;
+
+	free (reu_ram);
+	reu_ram = malloc (size * 1024);
+	if (block == NULL) block = malloc (0x10000);
+	if (other == NULL) other = malloc (0x10000);
+	if (reu_ram == NULL || block == NULL || other == NULL) {
+		reu_size = 0;
+		return -1;
+	}
+	memset (reu_ram, 0, size * 1024);
+	reu_size = size * 1024;
+
+	status = (size > 128) ? STATUS_256K : 0;
+	command = CMD_NO_FF00;
+	irq_mask = address_control = 0;
+	c64_address = c64_shadow = 0;
+	reu_address = reu_shadow = 0;
+	length = length_shadow = 0xffff;
+
+	/* registers above $0a are not connected */
+	for (reg = 0x0b; reg < 0x20; reg++) set_register (reg, 0xff);
+	update_registers ();
+	mem_update_io_reads ();
+
+	printf ("RAM expansion unit: %i KB\n", size);
+	return 0;
+}
+
+int reu_present (void) {
+	return (reu_size != 0);
+}
+
+int reu_footprint (void) {
+	return reu_present () ? reu_size + 2 * 0x10000 : 0;
+}
+
+/******************** TRANSFERS *************************/
+
+/* copy 'count' bytes of expansion ram starting at 'address' into 'dest' */
+static void reu_read_block (int address, unsigned char *dest, int count) {
+	int run;
+	while (count > 0) {
+		address &= reu_size - 1;
+		run = reu_size - address;
+		if (run > count) run = count;
+		memcpy (dest, reu_ram + address, run);
+		dest += run;
+		address += run;
+		count -= run;
+	}
+}
+
+static void reu_write_block (int address, const unsigned char *src, int count) {
+	int run;
+	while (count > 0) {
+		address &= reu_size - 1;
+		run = reu_size - address;
+		if (run > count) run = count;
+		memcpy (reu_ram + address, src, run);
+		src += run;
+		address += run;
+		count -= run;
+	}
+}
+
+/* the c64 side of a transfer, with or without a fixed address */
+static void c64_read (unsigned char *dest, int count) {
+	if (address_control & FIX_C64)
+		memset (dest, mem_read (c64_address), count);
+	else
+		mem_read_block (c64_address, dest, count);
+}
+
+static void c64_write (const unsigned char *src, int count) {
+	int i;
+	if (address_control & FIX_C64)
+		for (i=0; i<count; i++) mem_write (c64_address, src[i]);
+	else
+		mem_write_block (c64_address, src, count);
+}
+
+/* the expansion side of a transfer */
+static void reu_read (unsigned char *dest, int count) {
+	if (address_control & FIX_REU)
+		memset (dest, reu_ram[reu_address & (reu_size - 1)], count);
+	else
+		reu_read_block (reu_address, dest, count);
+}
+
+static void reu_write (const unsigned char *src, int count) {
+	if (address_control & FIX_REU)
+		reu_ram[reu_address & (reu_size - 1)] = src[count - 1];
+	else
+		reu_write_block (reu_address, src, count);
+}
+
+static int verify (int count) {
+	int i;
+
+	c64_read (block, count);
+	reu_read (other, count);
+	if (memcmp (block, other, count) == 0) return count;
+
+	/* find the first byte that differs; the transfer stops after it */
+	for (i=0; block[i] == other[i]; i++);
+	status |= STATUS_FAULT;
+	return i + 1;
+}
+
+static void execute (void) {
+	int count = length ? length : 0x10000;
+	int done = count;
+
+	/* the command is taken; $ff00 is disarmed before the transfer, which
+	   may write to $ff00 itself */
+	command = (command & ~CMD_EXECUTE) | CMD_NO_FF00;
+	mem_set_page_trigger (0xff, 0);
+
+	switch (command & 0x03) {
+	case STASH:
+		c64_read (block, count);
+		reu_write (block, count);
+		break;
+	case FETCH:
+		reu_read (block, count);
+		c64_write (block, count);
+		break;
+	case SWAP:
+		c64_read (block, count);
+		reu_read (other, count);
+		reu_write (block, count);
+		c64_write (other, count);
+		/* a swap takes two cycles per byte */
+		cpu6510_steal_cycles (count);
+		break;
+	case VERIFY:
+		done = verify (count);
+		break;
+	}
+
+	/* the cpu is halted while the REU owns the bus */
+	cpu6510_steal_cycles (done);
+
+	/* update address and length registers */
+	if (command & CMD_AUTOLOAD) {
+		c64_address = c64_shadow;
+		reu_address = reu_shadow;
+		length = length_shadow;
+	} else {
+		if (!(address_control & FIX_C64))
+			c64_address = (c64_address + done) & 0xffff;
+		if (!(address_control & FIX_REU))
+			reu_address = (reu_address + done) & (reu_size - 1);
+		length = (count - done) & 0xffff;
+		if (length == 0) length = 1;
+	}
+	if (done == count) status |= STATUS_EOB;
+
+	/* raise an interrupt if one is enabled */
+	if ((irq_mask & MASK_ENABLE) &&
+		(((irq_mask & MASK_EOB) && (status & STATUS_EOB)) ||
+		 ((irq_mask & MASK_FAULT) && (status & STATUS_FAULT)))) {
+		status |= STATUS_IRQ;
+		cpu6510_irq ();
+	}
+
+	update_registers ();
+}
+
+/* called for writes to $ff00 while a transfer is waiting for it */
+void reu_trigger (void) {
+	if ((command & (CMD_EXECUTE | CMD_NO_FF00)) == CMD_EXECUTE) execute ();
+}
+
+/******************** REGISTER MEMORY READ *************************/
+
+int reu_mem_read (int address) {
+	int data = io_ram[address & 0x0fff];
+
+	/* reading the status acknowledges it, as on the 17xx */
+	if ((address & 0x1f) == 0x00 &&
+		(status & (STATUS_IRQ | STATUS_EOB | STATUS_FAULT))) {
+		status &= ~(STATUS_IRQ | STATUS_EOB | STATUS_FAULT);
+		update_registers ();
+	}
+	return data;
+}
+
+/******************** REGISTER MEMORY WRITE *************************/
+
+void reu_mem_write (int address, int data) {
+
+	/* address space only covers 5 bits */
+	address &= 0x1f;
+
+	switch (address) {
+	case 0x00: /* status is read only */
+		break;
+	case 0x01:
+		command = data;
+		break;
+	case 0x02:
+		c64_address = c64_shadow = (c64_shadow & 0xff00) | data;
+		break;
+	case 0x03:
+		c64_address = c64_shadow = (c64_shadow & 0x00ff) | (data << 8);
+		break;
+	case 0x04:
+		reu_address = reu_shadow = (reu_shadow & 0xffff00) | data;
+		break;
+	case 0x05:
+		reu_address = reu_shadow = (reu_shadow & 0xff00ff) | (data << 8);
+		break;
+	case 0x06:
+		reu_shadow = (reu_shadow & 0x00ffff) | (data << 16);
+		reu_address = reu_shadow &= reu_size - 1;
+		break;
+	case 0x07:
+		length = length_shadow = (length_shadow & 0xff00) | data;
+		break;
+	case 0x08:
+		length = length_shadow = (length_shadow & 0x00ff) | (data << 8);
+		break;
+	case 0x09:
+		irq_mask = data & (MASK_ENABLE | MASK_EOB | MASK_FAULT);
+		break;
+	case 0x0a:
+		address_control = data & (FIX_C64 | FIX_REU);
+		break;
+	default:
+		return;
+	}
+
+	/* start the transfer now, or when $ff00 is written */
+	if (address == 0x01 && (command & CMD_EXECUTE)) {
+		if (command & CMD_NO_FF00) execute ();
+		else mem_set_page_trigger (0xff, 1);
+	}
+
+	update_registers ();
+}
@@ -0,0 +1,34 @@
+/* reu.h - RAM expansion unit (1700/1764/1750) for c64 emulator */
+
+#ifndef __REU_H
+#define __REU_H
+
+/* size of the largest supported expansion, in kilobytes */
+#define REU_MAX_KB 16384
+
+int reu_init (int kbytes);
+int reu_present (void);
+int reu_footprint (void);
+int reu_mem_read (int address);
+void reu_mem_write (int address, int data);
+void reu_trigger (void);
+
+/* REU memory map ($DF00-$DF0A, mirrored every $20 bytes)
+
+  | $00 | IRQ  EOB  FLT  SIZE VER3 VER2 VER1 VER0   Status (read only)  |
+  | $01 | EXEC  -   LOAD FF00  -    -   TYP1 TYP0   Command             |
+  | $02 | C64 base address, low byte                                    |
+  | $03 | C64 base address, high byte                                   |
+  | $04 | REU base address, low byte                                    |
+  | $05 | REU base address, high byte                                   |
+  | $06 | REU base address, bank                                        |
+  | $07 | Transfer length, low byte  (0000 means 64K)                   |
+  | $08 | Transfer length, high byte                                    |
+  | $09 | IE   EOB  FLT   -    -    -    -    -      Interrupt mask      |
+  | $0A | C64  REU   -    -    -    -    -    -      Fix address         |
+
+  transfer types: 00 = stash (C64 -> REU), 01 = fetch (REU -> C64),
+                  10 = swap, 11 = verify
+*/
+
+#endif
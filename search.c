@@ -0,0 +1,212 @@
+/* search.c - RAM search for c64 emulator */
+
+/*
+  Candidates are kept as a byte mask over all 64K of RAM ($ff = still a
+  candidate), so that a search step is one pass comparing RAM against
+  the previous snapshot, 16 bytes at a time, ANDing the result into the
+  mask. With the GCC vector extensions this compiles to SSE2, AltiVec
+  or NEON; other compilers get the plain byte loop.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "search.h"
+#include "mem_c64.h"
+
+#if defined(__GNUC__) && (__GNUC__ >= 5 || defined(__clang__))
+#define SEARCH_VECTOR
+typedef unsigned char vec __attribute__ ((vector_size (16)));
+#endif
+
+/* only allocated once a search is started */
+static unsigned char *snapshot = NULL;
+static unsigned char *candidate = NULL;
+static int candidates = 0x10000;
+
+/* predicate given with -search; -1 if none */
+static int search_predicate = -1, search_n = 0;
+static int every_frame = 0;
+
+void search_reset (void) {
+	if (snapshot == NULL) {
+		snapshot = malloc (0x10000);
+		candidate = malloc (0x10000);
+		if (snapshot == NULL || candidate == NULL) {
+			fprintf (stderr, "couldn't allocate ram search buffers\n");
+			exit (1);
+		}
+	}
+	memset (candidate, 0xff, 0x10000);
+	memcpy (snapshot, ram_64k, 0x10000);
+	candidates = 0x10000;
+}
+
+#ifdef SEARCH_VECTOR
+
+static inline vec load (const unsigned char *p) {
+	vec v;
+	memcpy (&v, p, sizeof(v));
+	return v;
+}
+
+static inline void store (unsigned char *p, vec v) {
+	memcpy (p, &v, sizeof(v));
+}
+
+/* one comparison step over all of RAM; returns the new candidate count */
+static int compare (int predicate, int n) {
+	vec cur, prev, match, count;
+	vec nv = (vec) {0} + (unsigned char) n;
+	int i, j, result = 0;
+
+	count = (vec) {0};
+	for (i=0, j=0; i<0x10000; i+=16) {
+		cur = load (ram_64k + i);
+		prev = load (snapshot + i);
+
+		switch (predicate) {
+		case SEARCH_EQUAL:     match = (vec) (cur == nv); break;
+		case SEARCH_NOT_EQUAL: match = (vec) (cur != nv); break;
+		case SEARCH_CHANGED:   match = (vec) (cur != prev); break;
+		case SEARCH_UNCHANGED: match = (vec) (cur == prev); break;
+		case SEARCH_INCREASED:
+			match = n ? (vec) ((vec) (cur - prev) == nv) : (vec) (cur > prev);
+			break;
+		case SEARCH_DECREASED:
+		default:
+			match = n ? (vec) ((vec) (prev - cur) == nv) : (vec) (cur < prev);
+			break;
+		}
+
+		match &= load (candidate + i);
+		store (candidate + i, match);
+		store (snapshot + i, cur);
+
+		/* each lane counts up to 255 matches before it is folded in */
+		count -= match;
+		if (++j == 255) {
+			for (j=0; j<16; j++) result += count[j];
+			count = (vec) {0};
+			j = 0;
+		}
+	}
+	for (j=0; j<16; j++) result += count[j];
+	return result;
+}
+
+#else
+
+static int compare (int predicate, int n) {
+	int i, cur, prev, match, result = 0;
+
+	for (i=0; i<0x10000; i++) {
+		cur = ram_64k[i];
+		prev = snapshot[i];
+		snapshot[i] = cur;
+		if (!candidate[i]) continue;
+
+		switch (predicate) {
+		case SEARCH_EQUAL:     match = (cur == (n & 0xff)); break;
+		case SEARCH_NOT_EQUAL: match = (cur != (n & 0xff)); break;
+		case SEARCH_CHANGED:   match = (cur != prev); break;
+		case SEARCH_UNCHANGED: match = (cur == prev); break;
+		case SEARCH_INCREASED:
+			match = n ? (((cur - prev) & 0xff) == (n & 0xff)) : (cur > prev);
+			break;
+		case SEARCH_DECREASED:
+		default:
+			match = n ? (((prev - cur) & 0xff) == (n & 0xff)) : (cur < prev);
+			break;
+		}
+		candidate[i] = match ? 0xff : 0x00;
+		result += match;
+	}
+	return result;
+}
+
+#endif
+
+int search_step (int predicate, int n) {
+	if (predicate < SEARCH_EQUAL || predicate > SEARCH_DECREASED) return -1;
+	if (snapshot == NULL) search_reset ();
+	candidates = compare (predicate, n);
+	return candidates;
+}
+
+int search_count (void) {
+	return candidates;
+}
+
+int search_candidate (int address) {
+	if (candidate == NULL) return 1;
+	return candidate[address & 0xffff] != 0;
+}
+
+void search_list (int max) {
+	int i, shown = 0;
+
+	printf ("ram search: %i candidate(s)\n", candidates);
+	if (candidate == NULL) return;
+	for (i=0; i<0x10000 && shown < max; i++) {
+		if (!candidate[i]) continue;
+		printf ("  $%04x = $%02x\n", i, ram_64k[i]);
+		shown++;
+	}
+}
+
+/******************** SEARCH FROM THE COMMAND LINE *************************/
+
+int search_parse (const char *spec, int frames) {
+	static const struct {
+		const char *name;
+		int predicate;
+		int needs_n;
+	} names[] = {
+		{ "eq", SEARCH_EQUAL, 1 },
+		{ "ne", SEARCH_NOT_EQUAL, 1 },
+		{ "changed", SEARCH_CHANGED, 0 },
+		{ "unchanged", SEARCH_UNCHANGED, 0 },
+		{ "inc", SEARCH_INCREASED, 0 },
+		{ "dec", SEARCH_DECREASED, 0 }
+	};
+	const char *arg = strchr (spec, ':');
+	int len = arg ? arg - spec : strlen (spec);
+	char *end;
+	int i, n = 0;
+
+	for (i=0; i<6; i++)
+		if (strlen (names[i].name) == len && !strncmp (spec, names[i].name, len))
+			break;
+	if (i == 6) return -1;
+
+	if (arg != NULL) {
+		arg++;
+		if (*arg == '$') arg++;
+		n = strtol (arg, &end, 16);
+		if (end == arg || *end != 0) return -1;
+	} else if (names[i].needs_n) return -1;
+
+	search_predicate = names[i].predicate;
+	search_n = n;
+	every_frame = frames;
+	search_reset ();
+	return 0;
+}
+
+/* the search key: one step against RAM as it was at the last one */
+void search_key (void) {
+	if (search_predicate < 0) return;
+	search_step (search_predicate, search_n);
+	if (candidates <= 16) search_list (16);
+	else printf ("ram search: %i candidate(s)\n", candidates);
+}
+
+/* called once per frame from the main callback */
+void search_frame (void) {
+	int old = candidates;
+
+	if (search_predicate < 0 || !every_frame) return;
+	search_step (search_predicate, search_n);
+	if (candidates != old && candidates <= 16) search_list (16);
+}
@@ -0,0 +1,42 @@
+/* search.h - RAM search for c64 emulator */
+
+#ifndef __SEARCH_H
+#define __SEARCH_H
+
+/* predicates; "previous" is the snapshot taken at the last step */
+#define SEARCH_EQUAL      0   /* value == N */
+#define SEARCH_NOT_EQUAL  1   /* value != N */
+#define SEARCH_CHANGED    2   /* value != previous */
+#define SEARCH_UNCHANGED  3   /* value == previous */
+#define SEARCH_INCREASED  4   /* value > previous, or value == previous + N */
+#define SEARCH_DECREASED  5   /* value < previous, or value == previous - N */
+
+void search_reset (void);
+int search_step (int predicate, int n);
+int search_count (void);
+int search_candidate (int address);
+void search_list (int max);
+
+/* set the predicate for the search key, or for every frame if 'frames' */
+int search_parse (const char *spec, int frames);
+void search_key (void);
+void search_frame (void);
+
+/*
+search specifications (numbers in hex, '$' is optional):
+
+  eq:N  ne:N  changed  unchanged  inc  inc:N  dec  dec:N
+
+  inc and dec without N accept any increase or decrease; with N the
+  difference must be exactly N (mod 256).
+
+  -search SPEC takes a step each time End is pressed, comparing RAM with
+  the last step; -searchframe SPEC takes one at the end of every frame.
+
+examples:
+  -search dec:1          press End after each life lost to narrow down
+                         the lives counter
+  -searchframe changed   anything that moves every frame
+*/
+
+#endif
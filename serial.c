@@ -4,6 +4,7 @@
 #include <string.h>
 #include "serial.h"
 #include "disk_raw.h"
+#include "log.h"
 
 #define NUM_DEV 32
 /* declare status word conditions */
@@ -30,21 +31,45 @@ enum { D64, T64, RAW };
 static int device = 0x1f;
 static int second = 0;
 
+/* a real drive, which the kernal traps leave alone; -1 if none */
+static int bus_device = -1;
+
+static const DiskDriver *driver[NUM_DEV];
+static void *unit[NUM_DEV];
+
 #define BUFFER_SIZE (256)
 static char buffer[BUFFER_SIZE];
 static int buffer_pos = 0;
 
-/* initialization */
+/* initialization: device 8 reads host files, unless an image is on it */
 void serial_init () {
 	raw_init();
+	if (driver[8] == NULL) serial_attach(8, &disk_raw, NULL);
+}
+
+void serial_attach (int dev, const DiskDriver *new_driver, void *new_unit) {
+	driver[dev & 0x1f] = new_driver;
+	unit[dev & 0x1f] = new_unit;
+}
+
+void serial_set_bus_device (int dev) {
+	bus_device = dev;
 }
 
 /************ READ from serial port **************/
 
 int serial_read() {
-	if (device != 0x08) return SERIAL_TIME_OUT;
+	if (driver[device] == NULL) return SERIAL_TIME_OUT;
 	
-	return raw_read (second & 0x0f);
+	return driver[device]->read (unit[device], second & 0x0f);
+}
+
+/* as much of the file as the driver has in one piece; 0 at the end */
+int serial_read_block(const unsigned char **data) {
+	if (driver[device] == NULL || driver[device]->read_block == NULL)
+		return SERIAL_TIME_OUT;
+
+	return driver[device]->read_block (unit[device], second & 0x0f, data);
 }
 
 
@@ -52,36 +77,39 @@ int serial_read() {
 
 void flush_buffer () {
 	int channel = second & 0x0f;
-	if (device != 0x08) return;
+	const DiskDriver *d = driver[device];
+
+	if (d == NULL) return;
 	
 	switch (second & 0xf0) {
 	case 0x60:
-		if (buffer_pos > 0) raw_write (channel, buffer_pos, buffer);
+		if (buffer_pos > 0) d->write (unit[device], channel, buffer_pos, buffer);
 		break;
 	case 0xe0:
-		raw_close (channel);
+		d->close (unit[device], channel);
 		break;
 	case 0xf0:
-		raw_open (channel, buffer);
+		d->open (unit[device], channel, buffer);
 		break;
 	}
 	buffer_pos = 0;
+	buffer[0] = 0;
 }
 
 int serial_write(int atn, int a) {
 	if (atn) {
 		flush_buffer();
 
-		printf("serial ATN: %02x\n", a);
+		log_msg(LOG_SERIAL, LOG_TRACE, "ATN %02x", a);
 		second = a;
 	
 		if (a < 0x60) device = a & 0x1f;
-		else if (device != 0x08) return SERIAL_DEVICE_NOT_PRESENT;
+		else if (driver[device] == NULL) return SERIAL_DEVICE_NOT_PRESENT;
 	}
 	else {
 		if (second < 0x60) return SERIAL_TIME_OUT;
 	
-		printf("serial: %02x\n", a);
+		log_msg(LOG_SERIAL, LOG_TRACE, "data %02x", a);
 
 		buffer[buffer_pos++] = a;
 		if (buffer_pos == BUFFER_SIZE) flush_buffer();
@@ -90,6 +118,28 @@ int serial_write(int atn, int a) {
 	return 0;
 }
 
+/************ the real drive **************/
+
+/*
+  Bytes for the real drive never come through serial_write(), so LISTEN
+  and TALK are looked at here to know who is addressed. UNLISTEN and
+  UNTALK go to whoever that is.
+*/
+int serial_on_bus (int atn, int a) {
+	if (bus_device < 0) return 0;
+
+	if (atn && a < 0x60 && (a & 0x1f) != 0x1f) {
+		if ((a & 0x1f) != bus_device) return 0;
+		flush_buffer();
+		second = a;
+		device = bus_device;
+		return 1;
+	}
+	if (device != bus_device) return 0;
+	if (atn && a < 0x60) device = 0x1f;
+	return 1;
+}
+
 /*
   +---------+------------+---------------+------------+-------------------+
   |  ST Bit | ST Numeric |    Cassette   |   Serial   |    Tape Verify    |
@@ -7,19 +7,29 @@
 #define SERIAL_DEVICE_NOT_PRESENT (-2)
 #define SERIAL_END_OF_FILE (256)
 
+/* what answers for a device on the bus; 'unit' is the driver's own */
+typedef struct {
+	int (*open)  (void *unit, int channel, const char *command);
+	int (*close) (void *unit, int channel);
+	int (*read)  (void *unit, int channel);
+	int (*write) (void *unit, int channel, int size, const char *data);
+	/* optional: the next contiguous run of a file being read, in place */
+	int (*read_block) (void *unit, int channel, const unsigned char **data);
+} DiskDriver;
+
 /* function declarations */
 void serial_init();
 int serial_read();
+int serial_read_block(const unsigned char **data);
 int serial_write(int atn, int a);
 
-/*
-typedef struct {
-	int (*open)  (int channel, const char *command);
-	int (*close) (int channel);
-	int (*read)  (int channel);
-	int (*write) (int channel, int size, const char *data);
-} DiskDriver;
-*/
+/* put a driver on device 'device', or take it off with NULL */
+void serial_attach(int device, const DiskDriver *driver, void *unit);
+
+/* a real drive is on the bus as 'device'; the kernal talks to it itself */
+void serial_set_bus_device(int device);
+/* non-zero if byte 'a' (or a read, with atn 0) is for the real drive */
+int serial_on_bus(int atn, int a);
 /*
 How the C1541 is called by the C64:
 
@@ -0,0 +1,465 @@
+/* sid.c - 6581/8580 sound interface device for c64 emulator */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "sid.h"
+
+#undef SID_DEBUG
+
+#define BLOCK 256          /* samples made in one pass */
+#define MAX_LOG 65536      /* writes kept before rendering anyway */
+
+/* voice control register */
+#define CTRL_GATE  0x01
+#define CTRL_SYNC  0x02
+#define CTRL_RING  0x04
+#define CTRL_TEST  0x08
+#define CTRL_TRI   0x10
+#define CTRL_SAW   0x20
+#define CTRL_PULSE 0x40
+#define CTRL_NOISE 0x80
+
+/* filter mode and volume register */
+#define MODE_LP    0x10
+#define MODE_BP    0x20
+#define MODE_HP    0x40
+#define MODE_3OFF  0x80
+
+#define ATTACK        0
+#define DECAY_SUSTAIN 1
+#define RELEASE       2
+
+/* the 6581 mixer has a DC offset, which the volume register scales:
+   that is what makes volume register samples audible */
+#define MIXER_DC_6581 1024.0f
+
+/* cycles per envelope step for each rate setting */
+static const int rate_period[16] = {
+	9, 32, 63, 95, 149, 220, 267, 313,
+	392, 977, 1954, 3126, 3907, 11720, 19532, 31251
+};
+
+typedef struct voice_s {
+	unsigned int acc;          /* 24 bit phase */
+	unsigned int lfsr;         /* 23 bit noise shift register */
+	int freq, pw, control;
+	int attack_decay, sustain_release;
+	int env, state;
+	int rate_count, exp_count;
+} voice;
+
+typedef struct log_entry_s {
+	cycle_t time;
+	unsigned char reg, value;
+} log_entry;
+
+struct sid_s {
+	int model;
+	voice v[3];
+	unsigned char regs[0x20];
+	int bus;                   /* the last value written */
+
+	/* filter */
+	float f, damp;             /* state variable filter coefficients */
+	float low, band;
+	float dc_in, dc_out;       /* the coupling capacitor at the output */
+
+	/* time */
+	long clock_hz;
+	int rate;
+	cycle_t time;              /* the cycle the chip state is at */
+	unsigned int step, frac;   /* cycles per sample, 16.16 */
+
+	log_entry *log;
+	int used, size;
+
+	sid_sink sink;
+	void *sink_data;
+};
+
+/******************** OSCILLATORS *************************/
+
+/* the voice that syncs or ring modulates voice 'k' */
+#define SOURCE(k) (((k) + 2) % 3)
+
+static void clock_noise (voice *v) {
+	unsigned int bit = ((v->lfsr >> 22) ^ (v->lfsr >> 17)) & 1;
+
+	v->lfsr = ((v->lfsr << 1) | bit) & 0x7fffff;
+}
+
+/* eight of the shift register bits make the top of the noise output */
+static int noise_output (unsigned int l) {
+	return ((l >> 11) & 0x800) | ((l >> 10) & 0x400) | ((l >> 7) & 0x200) |
+		((l >> 5) & 0x100) | ((l >> 4) & 0x080) | ((l >> 1) & 0x040) |
+		((l << 1) & 0x020) | ((l << 2) & 0x010);
+}
+
+/* the 12 bit waveform output; combined waveforms are ANDed together */
+inline static int waveform (const voice *v, unsigned int acc,
+	unsigned int source_acc, int noise) {
+	int control = v->control, out = 0xfff;
+	unsigned int msb;
+
+	if (!(control & 0xf0)) return 0;
+	if (control & CTRL_TRI) {
+		msb = acc & 0x800000;
+		if (control & CTRL_RING) msb ^= source_acc & 0x800000;
+		out &= ((msb ? ~acc : acc) >> 11) & 0xfff;
+	}
+	if (control & CTRL_SAW)
+		out &= acc >> 12;
+	if ((control & CTRL_PULSE) && !(control & CTRL_TEST) &&
+		(int) (acc >> 12) < v->pw)
+		out = 0;
+	if (control & CTRL_NOISE)
+		out &= noise;
+	return out;
+}
+
+/* advance the phases of all three voices; sync needs them in step */
+static void run_oscillators (sid *s, const int *delta, int n,
+	unsigned int acc[3][BLOCK], int noise[3][BLOCK]) {
+	unsigned int old, add, edges;
+	int i, k, rose[3];
+	voice *v;
+
+	for (i=0; i<n; i++) {
+		for (k=0; k<3; k++) {
+			v = &s->v[k];
+			old = v->acc;
+			if (v->control & CTRL_TEST) {
+				v->acc = 0;
+				rose[k] = 0;
+			} else {
+				add = v->freq * delta[i];
+				v->acc = (old + add) & 0xffffff;
+				rose[k] = !(old & 0x800000) && (v->acc & 0x800000);
+
+				/* the noise register shifts when bit 19 goes high */
+				edges = ((old + add + 0x80000) >> 20) - ((old + 0x80000) >> 20);
+				while (edges--) clock_noise (v);
+			}
+		}
+		for (k=0; k<3; k++) {
+			v = &s->v[k];
+			if ((v->control & CTRL_SYNC) && rose[SOURCE(k)]) v->acc = 0;
+			acc[k][i] = v->acc;
+			noise[k][i] = noise_output (v->lfsr);
+		}
+	}
+}
+
+/******************** ENVELOPES *************************/
+
+/* decay and release slow down as the level falls */
+static int exp_divider (int env) {
+	if (env >= 0x5d) return 1;
+	if (env >= 0x36) return 2;
+	if (env >= 0x1a) return 4;
+	if (env >= 0x0e) return 8;
+	if (env >= 0x06) return 16;
+	return 30;
+}
+
+static int env_period (const voice *v) {
+	switch (v->state) {
+	case ATTACK:        return rate_period[v->attack_decay >> 4];
+	case DECAY_SUSTAIN: return rate_period[v->attack_decay & 0x0f];
+	default:            return rate_period[v->sustain_release & 0x0f];
+	}
+}
+
+static void env_step (voice *v) {
+	switch (v->state) {
+	case ATTACK:
+		if (++v->env >= 0xff) {
+			v->env = 0xff;
+			v->state = DECAY_SUSTAIN;
+			v->exp_count = 0;
+		}
+		return;
+	case DECAY_SUSTAIN:
+		if (v->env == (v->sustain_release >> 4) * 0x11) return;
+		break;
+	default:
+		if (v->env == 0) return;
+		break;
+	}
+	if (++v->exp_count >= exp_divider (v->env)) {
+		v->exp_count = 0;
+		v->env--;
+	}
+}
+
+static void run_envelope (voice *v, const int *delta, int n, int *env) {
+	int i, period = env_period (v);
+
+	for (i=0; i<n; i++) {
+		v->rate_count += delta[i];
+		while (v->rate_count >= period) {
+			v->rate_count -= period;
+			env_step (v);
+			period = env_period (v);
+		}
+		env[i] = v->env;
+	}
+}
+
+/******************** FILTER *************************/
+
+static void set_filter (sid *s) {
+	int cutoff = (s->regs[0x16] << 3) | (s->regs[0x15] & 7);
+	int res = s->regs[0x17] >> 4;
+	double fc, x = cutoff / 2047.0;
+
+	/* the 8580 curve is close to linear; the 6581 one is anything but,
+	   and this is only its general shape */
+	if (s->model == SID_8580) fc = 30.0 + 12000.0 * x;
+	else fc = 220.0 + 17800.0 * x * x;
+
+	/* the state variable filter is only stable below a quarter of the rate */
+	if (fc > s->rate / 4.0) fc = s->rate / 4.0;
+	s->f = (float) (2.0 * sin (M_PI * fc / s->rate));
+	s->damp = 1.4f - res * (s->model == SID_8580 ? 0.075f : 0.07f);
+}
+
+/******************** SYNTHESIS *************************/
+
+/* the cycles between each of the next samples due by 'until' */
+static int sample_deltas (sid *s, cycle_t until, int *delta) {
+	unsigned int frac = s->frac;
+	int n = 0, d;
+
+	while (n < BLOCK) {
+		d = (frac + s->step) >> 16;
+		if (s->time + d > until) break;
+		frac = (frac + s->step) & 0xffff;
+		s->time += d;
+		delta[n++] = d;
+	}
+	s->frac = frac;
+	return n;
+}
+
+static void synth_block (sid *s, const int *delta, int n) {
+	unsigned int acc[3][BLOCK];
+	int noise[3][BLOCK], env[BLOCK];
+	float out[3][BLOCK];
+	short pcm[BLOCK];
+	int route = s->regs[0x17] & 7, mode = s->regs[0x18];
+	float volume = (mode & 0x0f) / 15.0f;
+	float dc = (s->model == SID_6581) ? MIXER_DC_6581 : 0.0f;
+	float direct, in, high, mix;
+	int i, k, w;
+
+	run_oscillators (s, delta, n, acc, noise);
+
+	for (k=0; k<3; k++) {
+		run_envelope (&s->v[k], delta, n, env);
+		for (i=0; i<n; i++) {
+			w = waveform (&s->v[k], acc[k][i], acc[SOURCE(k)][i], noise[k][i]);
+			out[k][i] = (w - 0x800) * env[i] * (1.0f / 256);
+		}
+	}
+
+	for (i=0; i<n; i++) {
+		in = direct = 0;
+		for (k=0; k<3; k++) {
+			if (route & (1 << k)) in += out[k][i];
+			else if (k < 2 || !(mode & MODE_3OFF)) direct += out[k][i];
+		}
+
+		high = in - s->low - s->damp * s->band;
+		s->band += s->f * high;
+		s->low += s->f * s->band;
+
+		mix = direct + dc;
+		if (mode & MODE_LP) mix += s->low;
+		if (mode & MODE_BP) mix += s->band;
+		if (mode & MODE_HP) mix += high;
+		mix *= volume;
+
+		/* block the DC, as the output capacitor does */
+		s->dc_out = mix - s->dc_in + 0.9977f * s->dc_out;
+		s->dc_in = mix;
+
+		mix = s->dc_out * 4;
+		if (mix > 32767) mix = 32767;
+		if (mix < -32768) mix = -32768;
+		pcm[i] = (short) mix;
+	}
+
+	if (s->sink != NULL) s->sink (s->sink_data, pcm, n);
+}
+
+static void synth_until (sid *s, cycle_t until) {
+	int delta[BLOCK], n;
+
+	do {
+		n = sample_deltas (s, until, delta);
+		if (n > 0) synth_block (s, delta, n);
+	} while (n == BLOCK);
+}
+
+/******************** REGISTERS *************************/
+
+static void apply (sid *s, int reg, int value) {
+	voice *v = &s->v[reg < 0x15 ? reg / 7 : 0];
+	int old;
+
+	s->regs[reg] = value;
+	if (reg >= 0x15) {
+		if (reg < 0x18) set_filter (s);
+		return;
+	}
+
+	switch (reg % 7) {
+	case 0:
+	case 1:
+		v->freq = s->regs[reg - reg % 7] | (s->regs[reg - reg % 7 + 1] << 8);
+		break;
+	case 2:
+	case 3:
+		v->pw = s->regs[reg - reg % 7 + 2] |
+			((s->regs[reg - reg % 7 + 3] & 0x0f) << 8);
+		break;
+	case 4:
+		old = v->control;
+		v->control = value;
+		if ((value & CTRL_GATE) && !(old & CTRL_GATE)) {
+			v->state = ATTACK;
+		} else if (!(value & CTRL_GATE) && (old & CTRL_GATE)) {
+			v->state = RELEASE;
+			v->exp_count = 0;
+		}
+		/* the test bit holds the phase and fills the noise register */
+		if (value & CTRL_TEST) {
+			v->acc = 0;
+			v->lfsr = 0x7ffff8;
+		}
+		break;
+	case 5:
+		v->attack_decay = value;
+		break;
+	case 6:
+		v->sustain_release = value;
+		break;
+	}
+}
+
+void sid_write (sid *s, cycle_t time, int reg, int value) {
+	log_entry *e;
+
+	if (s->used == MAX_LOG) sid_flush (s, time);
+	if (s->used == s->size) {
+		s->size = s->size ? 2 * s->size : 1024;
+		s->log = realloc (s->log, s->size * sizeof(log_entry));
+		if (s->log == NULL) {
+			fprintf (stderr, "couldn't allocate SID write log\n");
+			exit (1);
+		}
+	}
+	e = &s->log[s->used++];
+	e->time = time;
+	e->reg = reg & 0x1f;
+	e->value = value;
+	s->bus = value;
+}
+
+void sid_flush (sid *s, cycle_t time) {
+	int i;
+
+	for (i=0; i<s->used; i++) {
+		synth_until (s, s->log[i].time);
+		if (s->log[i].reg <= 0x18) apply (s, s->log[i].reg, s->log[i].value);
+	}
+	s->used = 0;
+	synth_until (s, time);
+}
+
+unsigned char sid_read (sid *s, cycle_t time, int reg) {
+	voice v;
+	unsigned int add, edges, source_acc;
+
+	switch (reg & 0x1f) {
+	case 0x19: /* paddles: nothing connected */
+	case 0x1a:
+		return 0xff;
+	case 0x1b: /* voice 3 oscillator, to the cycle */
+		sid_flush (s, time);
+
+		/* the chip is at the last sample; look ahead on a copy */
+		v = s->v[2];
+		if (!(v.control & CTRL_TEST)) {
+			add = v.freq * (unsigned int) (time - s->time);
+			edges = ((v.acc + add + 0x80000) >> 20) - ((v.acc + 0x80000) >> 20);
+			while (edges--) clock_noise (&v);
+			v.acc = (v.acc + add) & 0xffffff;
+		}
+		source_acc = s->v[1].acc;
+		return waveform (&v, v.acc, source_acc, noise_output (v.lfsr)) >> 4;
+	case 0x1c: /* voice 3 envelope */
+		sid_flush (s, time);
+		return s->v[2].env;
+	default: /* write only */
+		return s->bus;
+	}
+}
+
+/******************** INITIALIZATION *************************/
+
+void sid_reset (sid *s) {
+	int k;
+
+	memset (s->v, 0, sizeof(s->v));
+	memset (s->regs, 0, sizeof(s->regs));
+	for (k=0; k<3; k++) {
+		s->v[k].lfsr = 0x7ffff8;
+		s->v[k].state = RELEASE;
+	}
+	s->bus = 0;
+	s->low = s->band = s->dc_in = s->dc_out = 0;
+	s->used = 0;
+	set_filter (s);
+}
+
+sid *sid_new (int model, long clock_hz, int sample_rate) {
+	sid *s = calloc (1, sizeof(sid));
+
+	if (s == NULL) {
+		fprintf (stderr, "couldn't allocate SID\n");
+		exit (1);
+	}
+	s->model = model;
+	s->clock_hz = clock_hz;
+	s->rate = sample_rate;
+	s->step = (unsigned int) (((long long) clock_hz << 16) / sample_rate);
+	sid_reset (s);
+	return s;
+}
+
+void sid_free (sid *s) {
+	free (s->log);
+	free (s);
+}
+
+void sid_set_sink (sid *s, sid_sink sink, void *data) {
+	s->sink = sink;
+	s->sink_data = data;
+}
+
+/*
+ SID register map
+  $D400-$D406  voice 1: frequency lo/hi, pulse width lo/hi, control, AD, SR
+  $D407-$D40D  voice 2
+  $D40E-$D414  voice 3
+  $D415-$D416  filter cutoff, 11 bits
+  $D417        resonance (high nibble) and filter routing
+  $D418        filter mode, voice 3 off and volume
+  $D419-$D41A  paddles
+  $D41B        voice 3 oscillator, top 8 bits
+  $D41C        voice 3 envelope
+*/
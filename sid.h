@@ -0,0 +1,38 @@
+/* sid.h - 6581/8580 sound interface device for c64 emulator */
+
+#ifndef __SID_H
+#define __SID_H
+
+#include "event.h"
+
+#define SID_6581 0
+#define SID_8580 1
+
+typedef struct sid_s sid;
+
+/* rendered samples go to 'sink' in blocks, signed 16 bit mono */
+typedef void (*sid_sink)(void *data, const short *samples, int count);
+
+sid *sid_new (int model, long clock_hz, int sample_rate);
+void sid_free (sid *s);
+void sid_reset (sid *s);
+void sid_set_sink (sid *s, sid_sink sink, void *data);
+
+/* writes are only logged; they take effect when the log is rendered */
+void sid_write (sid *s, cycle_t time, int reg, int value);
+unsigned char sid_read (sid *s, cycle_t time, int reg);
+
+/* render everything up to 'time' */
+void sid_flush (sid *s, cycle_t time);
+
+/*
+  The chip is not clocked along with the cpu. Register writes go into
+  a log with the cycle they were made on, and whole blocks of samples
+  are made at once when somebody wants them: the oscillators, the
+  envelopes and the mixer each run over a block before the next one
+  does, and writes take effect on the first sample after their cycle.
+  Only reading the voice 3 oscillator or envelope makes the chip catch
+  up early.
+*/
+
+#endif
@@ -0,0 +1,170 @@
+/* sound.c - sound output for c64 emulator */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <SDL/SDL.h>
+#include "sound.h"
+#include "timing.h"
+#include "6510.h"
+
+#define RING_SIZE 16384   /* samples; a power of two */
+
+static sid *chip = NULL;
+static FILE *wav = NULL;
+static int playing = 0;
+
+static short ring[RING_SIZE];
+static volatile unsigned int ring_head = 0;   /* written by the emulator */
+static volatile unsigned int ring_tail = 0;   /* written by the audio thread */
+static short last_sample = 0;
+
+/******************** RING *************************/
+
+static void ring_put (const short *samples, int count) {
+	unsigned int head = ring_head;
+	int i, room = RING_SIZE - (int) (head - ring_tail);
+
+	if (count > room) count = room;
+	for (i=0; i<count; i++)
+		ring[(head + i) & (RING_SIZE - 1)] = samples[i];
+	__sync_synchronize ();   /* the samples before the index */
+	ring_head = head + count;
+}
+
+/* runs on SDL's audio thread */
+static void fill_audio (void *data, Uint8 *stream, int len) {
+	short *out = (short *) stream;
+	unsigned int tail = ring_tail;
+	int i, count = len / 2, ready = (int) (ring_head - tail);
+
+	__sync_synchronize ();   /* the index before the samples */
+	if (ready > count) ready = count;
+	for (i=0; i<ready; i++)
+		out[i] = ring[(tail + i) & (RING_SIZE - 1)];
+	if (ready > 0) last_sample = out[ready - 1];
+	for (; i<count; i++) out[i] = last_sample;
+	__sync_synchronize ();   /* done with the samples before freeing them */
+	ring_tail = tail + ready;
+}
+
+static void sink (void *data, const short *samples, int count) {
+	if (playing) ring_put (samples, count);
+	if (wav != NULL) wav_write (wav, samples, count);
+}
+
+/******************** WAV FILES *************************/
+
+static void put_le (unsigned char *p, unsigned int value, int bytes) {
+	while (bytes--) {
+		*p++ = value & 0xff;
+		value >>= 8;
+	}
+}
+
+static void wav_header (FILE *f, int rate, unsigned int data_bytes) {
+	unsigned char h[44];
+
+	memcpy (h, "RIFF....WAVEfmt ", 16);
+	put_le (h + 4, 36 + data_bytes, 4);
+	put_le (h + 16, 16, 4);          /* format chunk size */
+	put_le (h + 20, 1, 2);           /* PCM */
+	put_le (h + 22, 1, 2);           /* mono */
+	put_le (h + 24, rate, 4);
+	put_le (h + 28, rate * 2, 4);    /* bytes per second */
+	put_le (h + 32, 2, 2);           /* bytes per sample */
+	put_le (h + 34, 16, 2);          /* bits per sample */
+	memcpy (h + 36, "data", 4);
+	put_le (h + 40, data_bytes, 4);
+	fwrite (h, sizeof(h), 1, f);
+}
+
+FILE *wav_open (const char *filename, int rate) {
+	FILE *f = fopen (filename, "wb");
+
+	if (f != NULL) wav_header (f, rate, 0);
+	return f;
+}
+
+void wav_write (FILE *f, const short *samples, int count) {
+	unsigned char buffer[512];
+	int i, n;
+
+	while (count > 0) {
+		n = (count > 256) ? 256 : count;
+		for (i=0; i<n; i++) put_le (buffer + 2 * i, (unsigned short) samples[i], 2);
+		fwrite (buffer, 2, n, f);
+		samples += n;
+		count -= n;
+	}
+}
+
+/* fill in the sizes, now that they are known */
+void wav_close (FILE *f) {
+	unsigned char size[4];
+	long bytes = ftell (f) - 44;
+
+	put_le (size, 36 + bytes, 4);
+	fseek (f, 4, SEEK_SET);
+	fwrite (size, 4, 1, f);
+	put_le (size, bytes, 4);
+	fseek (f, 40, SEEK_SET);
+	fwrite (size, 4, 1, f);
+	fclose (f);
+}
+
+static void close_wav (void) {
+	if (chip != NULL) sid_flush (chip, cpu6510_clock ());
+	wav_close (wav);
+	wav = NULL;
+}
+
+/******************** MACHINE *************************/
+
+/* the SID shows up 32 times over $D400-$D7FF */
+void sound_mem_write (int address, int value) {
+	if (chip != NULL) sid_write (chip, cpu6510_clock (), address & 0x1f, value);
+}
+
+unsigned char sound_mem_read (int address) {
+	if (chip == NULL) return 0xff;
+	return sid_read (chip, cpu6510_clock (), address & 0x1f);
+}
+
+void sound_frame (void) {
+	if (chip != NULL) sid_flush (chip, cpu6510_clock ());
+}
+
+void sound_init (int model, int rate, int device, const char *wav_name) {
+	SDL_AudioSpec want, got;
+
+	chip = sid_new (model, machine.clock_hz, rate);
+	sid_set_sink (chip, sink, NULL);
+
+	if (wav_name != NULL) {
+		wav = wav_open (wav_name, rate);
+		if (wav == NULL)
+			printf ("couldn't write \"%s\"; not recording sound\n", wav_name);
+		else atexit (close_wav);
+	}
+
+	if (!device) return;
+	want.freq = rate;
+	want.format = AUDIO_S16SYS;
+	want.channels = 1;
+	want.samples = 1024;
+	want.callback = fill_audio;
+	want.userdata = NULL;
+	if (SDL_InitSubSystem (SDL_INIT_AUDIO) < 0 ||
+		SDL_OpenAudio (&want, &got) < 0) {
+		printf ("couldn't open audio: %s\n", SDL_GetError ());
+		return;
+	}
+	if (got.freq != rate || got.format != AUDIO_S16SYS || got.channels != 1) {
+		printf ("audio device won't take %i Hz 16 bit mono\n", rate);
+		SDL_CloseAudio ();
+		return;
+	}
+	playing = 1;
+	SDL_PauseAudio (0);
+}
@@ -0,0 +1,31 @@
+/* sound.h - sound output for c64 emulator */
+
+#ifndef __SOUND_H
+#define __SOUND_H
+
+#include <stdio.h>
+#include "sid.h"
+
+/* the machine's SID: 'device' plays it, and it is recorded to 'wav_name'
+   unless that is NULL */
+void sound_init (int model, int rate, int device, const char *wav_name);
+
+void sound_mem_write (int address, int value);
+unsigned char sound_mem_read (int address);
+
+/* render what was written during the frame */
+void sound_frame (void);
+
+/* 16 bit mono WAV files */
+FILE *wav_open (const char *filename, int rate);
+void wav_write (FILE *f, const short *samples, int count);
+void wav_close (FILE *f);
+
+/*
+  Samples reach the audio device through a ring with one writer, the
+  emulator, and one reader, SDL's audio thread, so neither ever waits
+  for the other: when the ring runs dry the device repeats the last
+  sample, and when it is full (in warp mode) new samples are dropped.
+*/
+
+#endif
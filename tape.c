@@ -0,0 +1,247 @@
+/* tape.c - T64 and TAP tape images for c64 emulator */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "tape.h"
+#include "archive.h"
+#include "event.h"
+#include "cia1.h"
+#include "6510.h"
+#include "video.h"
+#include "log.h"
+
+enum { NONE, T64, TAP };
+
+#define T64_HEADER 64
+#define T64_ENTRY 32
+#define TAP_HEADER 20
+
+static const unsigned char *tape;
+static size_t tape_size;
+static int tape_cached, format = NONE;
+
+/* T64: the entry after the one last loaded, where a search starts */
+static int entries, next_entry;
+
+/* TAP: the next pulse, and the cycle it ends if the motor is on */
+static const unsigned char *pulse_pos;
+static int version;
+static int motor;
+static long pending = -1;	/* cycles to the next pulse while stopped */
+static cycle_t pulse_time;
+static event *pulse_event;
+
+static int autowarp, warp_before;
+
+/******************** T64 *************************/
+
+static int word (const unsigned char *p) {
+	return p[0] | (p[1] << 8);
+}
+
+static long dword (const unsigned char *p) {
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((long) p[3] << 24);
+}
+
+/* the kernal matches the start of the names on a tape */
+static int match (const unsigned char *pat, int len, const unsigned char *name) {
+	int i;
+
+	for (i = 0; i < len; i++) {
+		if (pat[i] == '*') return 1;
+		if (i >= 16) return 0;
+		if (pat[i] != '?' && pat[i] != name[i]) return 0;
+	}
+	return 1;
+}
+
+/* the end address in a T64 is often wrong; the data can't run past the
+   next entry's or the end of the file */
+static int entry_size (const unsigned char *e) {
+	long offset = dword (e + 8), limit = tape_size, o;
+	int size = (word (e + 4) - word (e + 2)) & 0xffff, i;
+
+	for (i = 0; i < entries; i++) {
+		o = dword (tape + T64_HEADER + i * T64_ENTRY + 8);
+		if (o > offset && o < limit) limit = o;
+	}
+	if (offset >= (long) tape_size) return 0;
+	if (offset + size > limit) size = limit - offset;
+	return size;
+}
+
+int tape_find (const unsigned char *pattern, int len, int *start,
+	const unsigned char **data) {
+	const unsigned char *e;
+	int i, n;
+
+	if (format != T64) return TAPE_NO_T64;
+	for (i = 0; i < entries; i++) {
+		n = (next_entry + i) % entries;
+		e = tape + T64_HEADER + n * T64_ENTRY;
+		if (e[0] == 0 || !match (pattern, len, e + 16)) continue;
+		next_entry = n + 1;
+		*start = word (e + 2);
+		*data = tape + dword (e + 8);
+		log_msg (LOG_TAPE, LOG_DEBUG, "entry %i, $%04x, %i bytes", n, *start,
+			entry_size (e));
+		return entry_size (e);
+	}
+	return TAPE_NOT_FOUND;
+}
+
+/******************** TAP *************************/
+
+/* cycles to the end of the next pulse, or -1 at the end of the tape */
+static long pulse_length (void) {
+	const unsigned char *end = tape + tape_size;
+	long length;
+
+	if (pulse_pos >= end) return -1;
+	length = *pulse_pos++;
+	if (length != 0) return length * 8;
+	/* a zero is an overflow in version 0, and a long pulse after that */
+	if (version == 0) return 256 * 8;
+	if (pulse_pos + 3 > end) return -1;
+	length = pulse_pos[0] | (pulse_pos[1] << 8) | (pulse_pos[2] << 16);
+	pulse_pos += 3;
+	return length;
+}
+
+static void set_warp (int on) {
+	if (!autowarp) return;
+	if (on) {
+		warp_before = video_warp ();
+		video_set_warp (1);
+	} else video_set_warp (warp_before);
+}
+
+static void start_motor (void) {
+	if (pending < 0) pending = pulse_length ();
+	if (pending < 0) return;
+	pulse_time = cpu6510_clock () + pending;
+	event_schedule (pulse_event, pulse_time);
+	set_warp (1);
+}
+
+static void stop_motor (void) {
+	if (!event_pending (pulse_event)) return;
+	pending = pulse_time - cpu6510_clock ();
+	if (pending < 0) pending = 0;
+	event_cancel (pulse_event);
+	set_warp (0);
+}
+
+/* a pulse ends with a falling edge on the read line */
+static void callback_pulse (void *data) {
+	long length;
+
+	cia1_flag ();
+	length = pulse_length ();
+	if (length < 0) {
+		log_msg (LOG_TAPE, LOG_DEBUG, "end of tape");
+		pending = -1;
+		set_warp (0);
+		return;
+	}
+	pulse_time += length;
+	event_schedule (pulse_event, pulse_time);
+}
+
+int tape_port (int value) {
+	int on = !(value & 0x20);
+
+	if (format != TAP) return value | 0x10;
+	if (on != motor) {
+		motor = on;
+		if (on) start_motor ();
+		else stop_motor ();
+	}
+	/* PLAY is down */
+	return value & ~0x10;
+}
+
+void tape_set_autowarp (int on) {
+	autowarp = on;
+}
+
+/******************** ATTACHING *************************/
+
+static const unsigned char *load_compressed (const char *name, size_t *size) {
+	static const char *members[] = {"*.t64", "*.tap", NULL};
+	const unsigned char *image = NULL;
+	int i;
+
+	for (i = 0; image == NULL && i < 3; i++)
+		image = archive_get (name, members[i], size);
+	return image;
+}
+
+static int detect (void) {
+	if (tape_size >= TAP_HEADER && !memcmp (tape, "C64-TAPE-RAW", 12)) {
+		version = tape[12];
+		pulse_pos = tape + TAP_HEADER;
+		pending = -1;
+		return TAP;
+	}
+	if (tape_size >= T64_HEADER && !memcmp (tape, "C64", 3)) {
+		entries = word (tape + 34);
+		if (entries * T64_ENTRY + T64_HEADER > (long) tape_size)
+			entries = (tape_size - T64_HEADER) / T64_ENTRY;
+		next_entry = 0;
+		return T64;
+	}
+	return NONE;
+}
+
+void tape_detach (void) {
+	if (format == NONE) return;
+	if (motor) stop_motor ();
+	motor = 0;
+	if (tape_cached) archive_release (tape);
+	else munmap ((void *) tape, tape_size);
+	tape = NULL;
+	format = NONE;
+}
+
+int tape_attach (const char *name) {
+	const unsigned char *image;
+	struct stat st;
+	size_t size;
+	int fd;
+
+	if (archive_is_compressed (name)) {
+		image = load_compressed (name, &size);
+		if (image == NULL) return -1;
+	} else {
+		fd = open (name, O_RDONLY);
+		if (fd < 0) return -1;
+		if (fstat (fd, &st) < 0) {
+			close (fd);
+			return -1;
+		}
+		size = st.st_size;
+		image = mmap (NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+		close (fd);
+		if (image == MAP_FAILED) return -1;
+	}
+
+	tape_detach ();
+	if (pulse_event == NULL) pulse_event = event_new (callback_pulse, NULL);
+	tape = image;
+	tape_size = size;
+	tape_cached = archive_is_compressed (name);
+	format = detect ();
+	if (format == NONE) {
+		tape_detach ();
+		if (tape_cached) archive_release (image);
+		else munmap ((void *) image, size);
+		return -1;
+	}
+	return 0;
+}
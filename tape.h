@@ -0,0 +1,42 @@
+/* tape.h - T64 and TAP tape images for c64 emulator */
+
+#ifndef __TAPE_H
+#define __TAPE_H
+
+/* tape_find results besides a size */
+#define TAPE_NO_T64     -1
+#define TAPE_NOT_FOUND  -2
+
+/* put a T64 or TAP file (or one in a .gz or .zip) in the datassette */
+int tape_attach (const char *name);
+void tape_detach (void);
+
+/* turn warp mode on while the motor runs a TAP */
+void tape_set_autowarp (int on);
+
+/* the next file on a T64 matching a LOAD name with '*' and '?': its
+   size, with its load address and its data; or one of the above */
+int tape_find (const unsigned char *pattern, int len, int *start,
+	const unsigned char **data);
+
+/* the 6510 port was written; returns what it reads back, with the
+   cassette sense line */
+int tape_port (int value);
+
+/*
+  A T64 is only a container of files, so it is never played: a trap at
+  the start of the kernal's tape LOAD takes the file straight out of
+  it, in one copy, the way the serial LOAD trap does for disks.
+
+  A TAP is the tape itself, the length of every pulse on it in cycles.
+  While PLAY is down and the motor is on, the next pulse is an event
+  scheduled for the cycle it ends, which signals the FLAG input of
+  CIA1; nothing is looked at between pulses. The kernal loader, and
+  any turbo loader, reads it as from a real datassette. With auto warp
+  the emulator runs unpaced while the motor does.
+
+  The motor and sense lines are the 6510 port bits 5 and 4; the port's
+  direction register isn't looked at.
+*/
+
+#endif
@@ -0,0 +1,37 @@
+/* timing.c - machine timing models for c64 emulator */
+
+#include <stdio.h>
+#include <string.h>
+#include "timing.h"
+
+/* name, cycles/line, lines/frame, cycles/frame, clock, mains, visible */
+static const machine_timing models[] = {
+	{ "pal",     63, 312, 63*312,  985248, 50, 21, 260 },  /* 6569 */
+	{ "ntsc",    65, 263, 65*263, 1022727, 60, 28, 235 },  /* 6567R8 */
+	{ "oldntsc", 64, 262, 64*262, 1022727, 60, 28, 234 },  /* 6567R56A */
+	{ "drean",   65, 312, 65*312, 1023440, 50, 21, 260 }   /* 6572 */
+};
+
+#define MODELS (sizeof(models) / sizeof(models[0]))
+
+machine_timing machine = { "pal", 63, 312, 63*312, 985248, 50, 21, 260 };
+
+int timing_select (const char *name) {
+	int i;
+
+	for (i=0; i<MODELS; i++) {
+		if (strcmp (name, models[i].name)) continue;
+		machine = models[i];
+		return 0;
+	}
+	return -1;
+}
+
+void timing_list (void) {
+	int i;
+
+	for (i=0; i<MODELS; i++)
+		printf ("  %-8s %i cycles x %i lines, %li Hz\n", models[i].name,
+			models[i].cycles_per_line, models[i].lines_per_frame,
+			models[i].clock_hz);
+}
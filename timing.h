@@ -0,0 +1,31 @@
+/* timing.h - machine timing models for c64 emulator */
+
+#ifndef __TIMING_H
+#define __TIMING_H
+
+typedef struct machine_timing_s {
+	const char *name;
+	int cycles_per_line;
+	int lines_per_frame;
+	int cycles_per_frame;
+	long clock_hz;              /* cpu clock */
+	int power_hz;               /* mains frequency, for the TOD clocks */
+	int first_visible_raster;   /* first line on the host screen */
+	int visible_lines;          /* lines shown, at most SCREEN_HEIGHT */
+} machine_timing;
+
+/* the model in use; a copy, so that every lookup is a single load */
+extern machine_timing machine;
+
+#define CYCLES_PER_LINE  (machine.cycles_per_line)
+#define LINES_PER_FRAME  (machine.lines_per_frame)
+#define CYCLES_PER_FRAME (machine.cycles_per_frame)
+
+/* the most lines any model has, for sizing per-line arrays */
+#define MAX_LINES_PER_FRAME 312
+
+/* pick a model by name before anything is started; -1 if unknown */
+int timing_select (const char *name);
+void timing_list (void);
+
+#endif
@@ -0,0 +1,240 @@
+/* via.c - 6522 versatile interface adapter for c64 emulator */
+
+#include <stdio.h>
+#include "via.h"
+
+#undef VIA_DEBUG
+
+#define NEVER ((cycle_t) 1 << 62)
+
+/******************** INTERRUPTS *************************/
+
+static void update_irq (via *v) {
+	v->interrupt (v, (v->ifr & v->ier & 0x7f) != 0);
+}
+
+static void set_flags (via *v, int flags) {
+	v->ifr |= flags;
+	update_irq (v);
+}
+
+static void clear_flags (via *v, int flags) {
+	v->ifr &= ~flags;
+	update_irq (v);
+}
+
+/******************** TIMERS *************************/
+
+/* a counter goes N, N-1, ... 0, $FFFF; free running, it is reloaded
+   on the cycle after that, so it comes round every N + 2 */
+static cycle_t underflow (int value, cycle_t base) {
+	return base + value + 1;
+}
+
+static void schedule (via *v) {
+	cycle_t t1 = NEVER, t2 = NEVER;
+
+	if (v->t1_armed || (v->acr & 0x40))
+		t1 = underflow (v->t1_value, v->t1_base);
+	if (v->t2_armed)
+		t2 = underflow (v->t2_value, v->t2_base);
+	v->next = (t1 < t2) ? t1 : t2;
+}
+
+void via_update (via *v, cycle_t now) {
+	cycle_t u, periods;
+
+	if (now < v->next) return;
+
+	u = underflow (v->t1_value, v->t1_base);
+	if (now >= u && (v->t1_armed || (v->acr & 0x40))) {
+		if (v->acr & 0x40) {
+			/* every reload since, at once */
+			periods = (now - u) / (v->t1_latch + 2);
+			v->t1_base = u + 1 + periods * (v->t1_latch + 2);
+			v->t1_value = v->t1_latch;
+		} else {
+			v->t1_base = u;
+			v->t1_value = 0xffff;
+		}
+		v->t1_armed = 0;
+		set_flags (v, VIA_TIMER1);
+	}
+
+	u = underflow (v->t2_value, v->t2_base);
+	if (now >= u && v->t2_armed) {
+		v->t2_base = u;
+		v->t2_value = 0xffff;
+		v->t2_armed = 0;
+		set_flags (v, VIA_TIMER2);
+	}
+	schedule (v);
+}
+
+static int timer_value (int value, cycle_t base, cycle_t now) {
+	/* between an underflow and the reload */
+	if (now < base) return 0xffff;
+	return (int) ((value - (now - base)) & 0xffff);
+}
+
+/******************** PORTS *************************/
+
+int via_port_output (const via *v, int port) {
+	if (port == 0) return (v->orb | ~v->ddrb) & 0xff;
+	return (v->ora | ~v->ddra) & 0xff;
+}
+
+static int read_port (via *v, int port) {
+	int ddr = port ? v->ddra : v->ddrb;
+	int out = port ? v->ora : v->orb;
+
+	return ((out & ddr) | (v->port_in (v, port) & ~ddr)) & 0xff;
+}
+
+void via_set_ca1 (via *v, int level) {
+	level = (level != 0);
+	if (level == v->ca1) return;
+	v->ca1 = level;
+	/* PCR bit 0: 1 for the rising edge, 0 for the falling one */
+	if (level == (v->pcr & 1)) set_flags (v, VIA_CA1);
+}
+
+/******************** REGISTER ACCESS *************************/
+
+void via_write (via *v, cycle_t now, int address, int value) {
+	via_update (v, now);
+
+	switch (address & 0x0f) {
+	case 0x0:
+		v->orb = value;
+		clear_flags (v, VIA_CB1 | VIA_CB2);
+		v->port_out (v, 0, via_port_output (v, 0));
+		break;
+	case 0x1:
+		clear_flags (v, VIA_CA1 | VIA_CA2);
+		/* fall through */
+	case 0xf:
+		v->ora = value;
+		v->port_out (v, 1, via_port_output (v, 1));
+		break;
+	case 0x2:
+		v->ddrb = value;
+		v->port_out (v, 0, via_port_output (v, 0));
+		break;
+	case 0x3:
+		v->ddra = value;
+		v->port_out (v, 1, via_port_output (v, 1));
+		break;
+	case 0x4: case 0x6:
+		v->t1_latch = (v->t1_latch & 0xff00) | value;
+		break;
+	case 0x7:
+		v->t1_latch = (v->t1_latch & 0x00ff) | (value << 8);
+		clear_flags (v, VIA_TIMER1);
+		break;
+	case 0x5:
+		/* loads the counter from the latch and starts it */
+		v->t1_latch = (v->t1_latch & 0x00ff) | (value << 8);
+		v->t1_value = v->t1_latch;
+		v->t1_base = now + 1;
+		v->t1_armed = 1;
+		clear_flags (v, VIA_TIMER1);
+		break;
+	case 0x8:
+		v->t2_latch = value;
+		break;
+	case 0x9:
+		v->t2_value = v->t2_latch | (value << 8);
+		v->t2_base = now + 1;
+		v->t2_armed = 1;
+		clear_flags (v, VIA_TIMER2);
+		break;
+	case 0xa:
+		v->sr = value;
+		break;
+	case 0xb:
+		v->acr = value;
+		break;
+	case 0xc:
+		v->pcr = value;
+		v->port_out (v, 2, value);
+		break;
+	case 0xd:
+		clear_flags (v, value & 0x7f);
+		break;
+	case 0xe:
+		if (value & 0x80) v->ier |= value & 0x7f;
+		else v->ier &= ~value;
+		update_irq (v);
+		break;
+	}
+	schedule (v);
+}
+
+int via_read (via *v, cycle_t now, int address) {
+	int value;
+
+	via_update (v, now);
+
+	switch (address & 0x0f) {
+	case 0x0:
+		clear_flags (v, VIA_CB1 | VIA_CB2);
+		return read_port (v, 0);
+	case 0x1:
+		clear_flags (v, VIA_CA1 | VIA_CA2);
+		/* fall through */
+	case 0xf:
+		return read_port (v, 1);
+	case 0x2: return v->ddrb;
+	case 0x3: return v->ddra;
+	case 0x4:
+		clear_flags (v, VIA_TIMER1);
+		return timer_value (v->t1_value, v->t1_base, now) & 0xff;
+	case 0x5: return timer_value (v->t1_value, v->t1_base, now) >> 8;
+	case 0x6: return v->t1_latch & 0xff;
+	case 0x7: return v->t1_latch >> 8;
+	case 0x8:
+		clear_flags (v, VIA_TIMER2);
+		return timer_value (v->t2_value, v->t2_base, now) & 0xff;
+	case 0x9: return timer_value (v->t2_value, v->t2_base, now) >> 8;
+	case 0xa: return v->sr;
+	case 0xb: return v->acr;
+	case 0xc: return v->pcr;
+	case 0xd:
+		value = v->ifr & 0x7f;
+		if (value & v->ier) value |= 0x80;
+		return value;
+	case 0xe: return v->ier | 0x80;
+	}
+	return 0xff;
+}
+
+/******************** INITIALIZATION ********************/
+
+void via_reset (via *v, cycle_t now) {
+	v->orb = v->ora = v->ddrb = v->ddra = 0;
+	v->sr = v->acr = v->pcr = 0;
+	v->ifr = v->ier = 0;
+	v->t1_latch = v->t1_value = 0xffff;
+	v->t2_latch = v->t2_value = 0xffff;
+	v->t1_base = v->t2_base = now;
+	v->t1_armed = v->t2_armed = 0;
+	schedule (v);
+	update_irq (v);
+	v->port_out (v, 0, via_port_output (v, 0));
+	v->port_out (v, 1, via_port_output (v, 1));
+	v->port_out (v, 2, v->pcr);
+}
+
+void via_init (via *v, const char *name,
+	int (*port_in)(via *v, int port),
+	void (*port_out)(via *v, int port, int value),
+	void (*interrupt)(via *v, int asserted), void *data) {
+	v->name = name;
+	v->port_in = port_in;
+	v->port_out = port_out;
+	v->interrupt = interrupt;
+	v->data = data;
+	v->ca1 = 0;
+	via_reset (v, 0);
+}
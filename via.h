@@ -0,0 +1,70 @@
+/* via.h - 6522 versatile interface adapter for c64 emulator */
+
+#ifndef __VIA_H
+#define __VIA_H
+
+#include "event.h"
+
+/* interrupt sources, as bits of the interrupt flag register */
+#define VIA_CA2    0x01
+#define VIA_CA1    0x02
+#define VIA_SHIFT  0x04
+#define VIA_CB2    0x08
+#define VIA_CB1    0x10
+#define VIA_TIMER2 0x20
+#define VIA_TIMER1 0x40
+
+typedef struct via_s via;
+
+struct via_s {
+	const char *name;
+	unsigned char orb, ora, ddrb, ddra;
+	unsigned char sr, acr, pcr;
+	int ifr, ier;
+	int ca1;                 /* level on the CA1 pin */
+
+	/* timers count down from 'value' at cycle 'base' */
+	int t1_latch, t1_value, t1_armed;
+	cycle_t t1_base;
+	int t2_latch, t2_value, t2_armed;
+	cycle_t t2_base;
+	cycle_t next;            /* when a timer next sets its flag */
+
+	/* the machine around the chip; 'now' is its own clock */
+	int (*port_in)(via *v, int port);
+	void (*port_out)(via *v, int port, int value);
+	void (*interrupt)(via *v, int asserted);
+	void *data;
+};
+
+void via_init (via *v, const char *name,
+	int (*port_in)(via *v, int port),
+	void (*port_out)(via *v, int port, int value),
+	void (*interrupt)(via *v, int asserted), void *data);
+void via_reset (via *v, cycle_t now);
+
+void via_write (via *v, cycle_t now, int address, int value);
+int via_read (via *v, cycle_t now, int address);
+
+/* set the timer flags that are due; cheap to call when v->next > now */
+void via_update (via *v, cycle_t now);
+
+/* the CA1 input, which flags the edge the PCR asks for */
+void via_set_ca1 (via *v, int level);
+
+/* what the port pins show: outputs, and pulled up inputs */
+int via_port_output (const via *v, int port);
+
+/*
+  Like the CIAs, the timers aren't clocked: a counter is the value it
+  was loaded with less the cycles since, and 'next' says when one of
+  them will next underflow, so whoever runs the processor only has to
+  compare it with the clock between instructions. Catching up over a
+  long stretch is one division, however many times a free running
+  timer went around.
+
+  The shift register and the handshake modes aren't there; the 1541
+  doesn't use them.
+*/
+
+#endif
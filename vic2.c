@@ -8,10 +8,10 @@
 #include "video.h"
 #include "vic2.h"
 #include "vic_redraw.h"
+#include "vic_defer.h"
 #include "mem_c64.h"
 #include "6510.h"
-
-#undef VIC_DEBUG
+#include "log.h"
 
 /* declare list of possible video modes */
 /* (MCM) + 2(BMM) + 4(ECM) */
@@ -20,7 +20,7 @@
 #define ECM (4)
 
 /* list of disconnected addresses */
-const int disconnect[0x40] = {
+const unsigned char disconnect[0x40] = {
 	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
 	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
 	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xc0, 0x00,
@@ -32,11 +32,27 @@ const int disconnect[0x40] = {
 };
 
 /* declare variables to hold register contents, etc */
-static int vic_registers[0x40];
+static unsigned char vic_registers[0x40];
 static int raster_compare;
-static int current_raster;
 static int video_mode;
 
+/*
+  The raster counter is not stepped every line; it is worked out from
+  the cpu clock whenever $d011/$d012 are read. Events are only scheduled
+  for raster compare matches (and every line while the IRQ is held) and
+  for the lines that end up on screen. When drawing is deferred (see
+  vic_defer.c) the only lines left are the bad lines, which still have
+  to stall the cpu as the beam passes them.
+*/
+static cycle_t raster_base;          /* clock at the start of line 0 */
+static event *compare_event, *redraw_event, *badline_event;
+static cycle_t compare_line, redraw_line, badline_line;
+	/* lines counted from raster_base */
+
+static cycle_t line_count (void);
+static void schedule_compare (cycle_t line);
+static void schedule_badline (cycle_t line);
+
 static int border_top, border_bottom;
 
 /********************************************************************/
@@ -66,7 +82,7 @@ void vic_mem_write(int address, int data) {
 		else raster_compare &= 0xff;
 
 		/* set bit 7 to match current raster */
-		if (current_raster & 0x100) data |= 0x80;
+		if (vic_raster() & 0x100) data |= 0x80;
 		else data &= 0x7f;
 
 		/* bit 6: Extended Color Mode */
@@ -85,7 +101,7 @@ void vic_mem_write(int address, int data) {
 	/* Raster Compare (lower 8 bits) */
 	case 0x12:
 		raster_compare = (raster_compare & 0x100) + data;
-		data = current_raster &0xff;
+		data = vic_raster() & 0xff;
 		break;
 
 	/* Multi-purpose register */
@@ -105,44 +121,57 @@ void vic_mem_write(int address, int data) {
 		break;
 	}
 
-#ifdef VIC_DEBUG
-	switch (address) {
+	if (log_enabled(LOG_VIC, LOG_TRACE)) switch (address) {
 	case 0x15: case 0x17:
 		break;
 	case 0x11:
-		printf("video mode = %i\n", video_mode);
-		printf("vertical scroll = %i\n", data & 7);
+		log_msg(LOG_VIC, LOG_TRACE, "video mode = %i, vertical scroll = %i",
+			video_mode, data & 7);
+		/* fall through */
 	case 0x12:
-		printf("raster compare set to %i\tline = %i\n", raster_compare,
-			current_raster);
+		log_msg(LOG_VIC, LOG_TRACE, "raster compare set to %i, line = %i",
+			raster_compare, vic_raster());
 		break;
 	case 0x16:
-		printf("video mode = %i\n", video_mode);
-		printf("h scroll set to %02x\tline = %i\n", data & 7, current_raster);
+		log_msg(LOG_VIC, LOG_TRACE, "video mode = %i, h scroll set to %02x, "
+			"line = %i", video_mode, data & 7, vic_raster());
 		break;
 	case 0x18:
-		printf("memory pointers set to %02x\tline = %i\n", data & 0xfe,
-			current_raster);
+		log_msg(LOG_VIC, LOG_TRACE, "memory pointers set to %02x, line = %i",
+			data & 0xfe, vic_raster());
 		break;
 	case 0x19:
-		printf("interrupt latch set to %02x\tline = %i\n", data, current_raster);
+		log_msg(LOG_VIC, LOG_TRACE, "interrupt latch set to %02x, line = %i",
+			data, vic_raster());
 		break;
 	case 0x1a:
-		printf("interrupt mask set to %02x\tline = %i\n", data, current_raster);
+		log_msg(LOG_VIC, LOG_TRACE, "interrupt mask set to %02x, line = %i",
+			data, vic_raster());
 		break;
 	default:
 		if ( address >= 0x11 && address <= 0x1a)
-			fprintf(stdout, "$d0%02x = $%02x\tline = %i\n",
-				address, data, current_raster);
+			log_msg(LOG_VIC, LOG_TRACE, "$d0%02x = $%02x, line = %i",
+				address, data, vic_raster());
 	}
-#endif
 
 	/* write value into register */
 	vic_registers[address] = data & (~disconnect[address]);
+	if (vic_deferred) vic_defer_register(address, vic_registers[address]);
 
 	/* write 16 copies of registers into io space */
 	data |= disconnect[address];
 	vic_set_register(address, data);
+
+	/* compare line, latch or mask changed: find the next interrupt */
+	switch (address) {
+	case 0x11: case 0x12: case 0x19: case 0x1a:
+		if (compare_event != NULL) schedule_compare (line_count () + 1);
+	}
+
+	/* y scroll or display enable changed: find the next bad line */
+	if (address == 0x11 && badline_event != NULL)
+		schedule_badline ((cpu6510_clock () - raster_base +
+			CYCLES_PER_LINE - 8) / CYCLES_PER_LINE);
 }
 
 /******************** REGISTER MEMORY READ *************************/
@@ -153,12 +182,12 @@ unsigned char vic_mem_read(int address) {
 
 	switch (address) {
 	case 0x11: /* MSB of raster */
-		data = current_raster & 0x100
+		data = vic_raster() & 0x100
 			 ? vic_registers[0x11] | 0x80
 			 : vic_registers[0x11] & 0x7f;
 		return data;
 	case 0x12: /* raster */
-		data = current_raster & 0xff;
+		data = vic_raster() & 0xff;
 		return data;
 	case 0x13: /* light pen x */
 		return 0;
@@ -178,36 +207,52 @@ unsigned char vic_mem_read(int address) {
 void vic_init () {
 	int x;
 	for (x=0; x<0x2f; x++) vic_mem_write(x, 0);
-	current_raster = 0;
 }
 
 
 /****************** RASTER UPDATE *********************/
 
-void vic_update_raster(int value) {
-
-	/* redraw previous line */
-	//vic_redraw_screen_line(value, &video_mode, vic_registers);
+/* number of lines started since raster_base */
+static cycle_t line_count (void) {
+	return (cpu6510_clock() - raster_base) / CYCLES_PER_LINE;
+}
 
-	current_raster = value;
-#ifdef VIC_DEBUG
-	if (value == 0) printf(".");
-#endif
+int vic_raster (void) {
+	return (int) (line_count() % LINES_PER_FRAME);
+}
 
-	/* update register with current raster value */
-	if (current_raster & 0x100)
-		vic_set_register (0x11, vic_registers[0x11] | 0x80);
-	else
-		vic_set_register (0x11, vic_registers[0x11] & 0x7f);
+/* arm the compare event for the first line from 'line' on that can
+   set the latch or raise an IRQ */
+static void schedule_compare (cycle_t line) {
+	int raster;
+
+	/* a line that is already due has not been looked at yet */
+	if (event_pending (compare_event) && compare_line < line)
+		line = compare_line;
+	raster = (int) (line % LINES_PER_FRAME);
+
+	if (vic_registers[0x19] & vic_registers[0x1a] & 0x01) {
+		/* the IRQ is held until it is acknowledged */
+		compare_line = line;
+	} else if (raster_compare < LINES_PER_FRAME) {
+		compare_line = line +
+			(raster_compare - raster + LINES_PER_FRAME) % LINES_PER_FRAME;
+	} else {
+		/* compare value is never reached */
+		event_cancel (compare_event);
+		return;
+	}
+	event_schedule (compare_event,
+		raster_base + compare_line * CYCLES_PER_LINE);
+}
 
-	vic_set_register (0x12, current_raster & 0xff);
+static void callback_compare (void *data) {
+	int raster = (int) (compare_line % LINES_PER_FRAME);
 
 	/* set latch if raster matches compare value */
-	if (current_raster == raster_compare) {
-#ifdef VIC_DEBUG
+	if (raster == raster_compare) {
 		if (!(vic_registers[0x19] & 0x01))
-			printf("latch set at raster = %i\n", current_raster);
-#endif
+			log_msg(LOG_VIC, LOG_TRACE, "latch set at raster = %i", raster);
 		/* set raster compare latch */
 		vic_set_register (0x19, vic_registers[0x19] | 0x01);
 	}
@@ -217,33 +262,93 @@ void vic_update_raster(int value) {
 		(vic_registers[0x1a] & 0x01) ) {
 		/* set IRQ latch */
 		vic_set_register (0x19, vic_registers[0x19] | 0x80);
-#ifdef VIC_DEBUG
-		printf("IRQ generated at raster = %i\n", current_raster);
-#endif
+		log_msg(LOG_VIC, LOG_TRACE, "IRQ generated at raster = %i", raster);
 		cpu6510_irq();
 	}
+
+	schedule_compare (compare_line + 1);
 }
 
-void callback_redraw (void) {
-	vic_redraw_screen_line(current_raster, &video_mode, vic_registers);
+/* lines that are drawn: line 0 restarts the video counter */
+int vic_line_visible (int raster) {
+	return (raster == 0) || (raster >= FIRST_VISIBLE_RASTER &&
+		raster < FIRST_VISIBLE_RASTER + VISIBLE_LINES);
 }
 
-void callback_raster (void) {
-	static int raster = 0, when = 0;
-	
-	vic_update_raster (raster++);
-	if (raster == 312) raster = 0;
-	
+static void callback_redraw (void *data) {
+	int raster = (int) (redraw_line % LINES_PER_FRAME);
+	int bad = vic_bad_line(raster, &video_mode, vic_registers);
+
+	if (bad) cpu6510_bad_line();
+	vic_redraw_screen_line(&vic_render_buffer()[raster], raster, bad,
+		&video_mode, vic_registers, &mem_vic);
+
+	/* skip ahead to the next line that is drawn */
+	do redraw_line++;
+	while (!vic_line_visible ((int) (redraw_line % LINES_PER_FRAME)));
+
 	/* miner 2049'er: offset <  55 */
 	/* outrun       : offset > 4 */
 	/* quest        : offset > 3 */
-	cpu6510_callback (CB_REDRAW, callback_redraw, when+8);
-	when += 63;
-	cpu6510_callback (CB_RASTER, callback_raster, when);
+	event_schedule (redraw_event,
+		raster_base + redraw_line * CYCLES_PER_LINE + 8);
+}
+
+/* line $30 decides whether the display is enabled this frame */
+static int badline_candidate (int raster) {
+	return (raster == 0x30) || (raster > 0x30 && raster <= 0xf7 &&
+		!((raster ^ vic_registers[0x11]) & 0x07));
+}
+
+/* arm the bad line event for the first candidate from 'line' on */
+static void schedule_badline (cycle_t line) {
+	while (!badline_candidate ((int) (line % LINES_PER_FRAME))) line++;
+	badline_line = line;
+	event_schedule (badline_event,
+		raster_base + badline_line * CYCLES_PER_LINE + 8);
+}
+
+static void callback_badline (void *data) {
+	int raster = (int) (badline_line % LINES_PER_FRAME);
+
+	if (vic_bad_line(raster, &video_mode, vic_registers)) cpu6510_bad_line();
+	schedule_badline (badline_line + 1);
+}
+
+/* start the raster beam at the current clock, without drawing: only
+   the raster registers and raster interrupts run */
+void vic_start_raster () {
+	raster_base = cpu6510_clock();
+	compare_event = event_new (callback_compare, NULL);
+	schedule_compare (0);
+}
+
+/* start the raster beam at the current clock */
+void vic_start () {
+	vic_start_raster ();
+
+	if (vic_deferred) {
+		vic_defer_start (vic_registers, video_mode, raster_base);
+		badline_event = event_new (callback_badline, NULL);
+		schedule_badline (0);
+		return;
+	}
+
+	redraw_event = event_new (callback_redraw, NULL);
+	redraw_line = 0;
+	event_schedule (redraw_event, raster_base + 8);
 }
 
 void vic_print_state() {
 }
+
+/* bytes of VIC state, including the per-line render data */
+int vic_footprint() {
+	return sizeof(vic_registers) + sizeof(raster_compare) +
+		sizeof(video_mode) + sizeof(border_top) + sizeof(border_bottom) +
+		sizeof(raster_base) + sizeof(compare_line) + sizeof(redraw_line) +
+		sizeof(badline_line) + vic_redraw_footprint() + vic_defer_footprint();
+}
 /*
 typedef struct {
 	unsigned int pos_y    : 8,
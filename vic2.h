@@ -7,12 +7,17 @@
 #ifndef __VIC2_H
 #define __VIC2_H
 
+#include "timing.h"
+
 void vic_init ();
 void vic_mem_write(int address, int data);
 unsigned char vic_mem_read(int address);
 
-void vic_update_raster(int value);
+int vic_raster(void);
+int vic_line_visible(int raster);
 void vic_print_state();
+int vic_footprint();
 
-void callback_raster (void);
+void vic_start ();
+void vic_start_raster ();
 #endif
@@ -0,0 +1,268 @@
+/* vic_defer.c - deferred screen rendering for c64 emulator */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "vic_defer.h"
+#include "vic2.h"
+#include "mem_c64.h"
+#include "6510.h"
+
+#define LOG_REGISTER 0
+#define LOG_RAM      1
+#define LOG_COLOR    2
+#define LOG_BANK     3   /* address is the number of a 16K snapshot */
+
+#define BANK_SIZE 0x4000
+
+typedef struct log_entry_s {
+	int time;                 /* cycles since the start of the frame */
+	unsigned short address;
+	unsigned char kind;
+	unsigned char value;
+} log_entry;
+
+typedef struct frame_log_s {
+	log_entry *entry;
+	int used, size;
+	unsigned char *bank;      /* new VIC banks, copied when selected */
+	int banks, bank_size;
+} frame_log;
+
+int vic_deferred = VIC_DEFER_OFF;
+
+static frame_log logs[2];
+static frame_log *recording = &logs[0], *closed = NULL;
+static int closed_drawn = 0;
+static cycle_t frame_start;
+
+/* the VIC's copy of memory, as of the last logged write replayed */
+static unsigned char *shadow_ram = NULL, *shadow_color = NULL;
+static unsigned char registers[0x40];
+static int mode, bank;
+static vic_memory view;
+
+/* the threaded mode draws into one frame while the other is shown */
+static render_line *frame[2];
+static int shown = 0, drawing = -1;
+static frame_log *job = NULL;
+static pthread_t worker;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wake = PTHREAD_COND_INITIALIZER;
+
+/******************** LOGGING *************************/
+
+static void append (int kind, int address, int value) {
+	frame_log *log = recording;
+	log_entry *e;
+
+	if (log->used == log->size) {
+		log->size = log->size ? 2 * log->size : 1024;
+		log->entry = realloc (log->entry, log->size * sizeof(log_entry));
+		if (log->entry == NULL) {
+			fprintf (stderr, "couldn't allocate VIC write log\n");
+			exit (1);
+		}
+	}
+	e = &log->entry[log->used++];
+	e->time = (int) (cpu6510_clock () - frame_start);
+	e->address = address;
+	e->kind = kind;
+	e->value = value;
+}
+
+void vic_defer_register (int address, int value) {
+	append (LOG_REGISTER, address, value);
+}
+
+void vic_defer_ram (int address, int value) {
+	append (LOG_RAM, address, value);
+}
+
+void vic_defer_color (int address, int value) {
+	append (LOG_COLOR, address, value);
+}
+
+/* writes to a bank were not logged while the VIC looked elsewhere */
+void vic_defer_bank (int new_bank) {
+	frame_log *log = recording;
+
+	if (log->banks == log->bank_size) {
+		log->bank_size = log->bank_size ? 2 * log->bank_size : 2;
+		log->bank = realloc (log->bank, log->bank_size * BANK_SIZE);
+		if (log->bank == NULL) {
+			fprintf (stderr, "couldn't allocate VIC write log\n");
+			exit (1);
+		}
+	}
+	memcpy (log->bank + log->banks * BANK_SIZE, ram_64k + new_bank, BANK_SIZE);
+	append (LOG_BANK, log->banks++, new_bank >> 14);
+}
+
+/******************** REPLAY *************************/
+
+static void set_view (void) {
+	mem_vic_pointers (&view, shadow_ram, shadow_color, bank, registers[0x18]);
+}
+
+static void apply (const frame_log *log, const log_entry *e) {
+	switch (e->kind) {
+	case LOG_REGISTER:
+		registers[e->address] = e->value;
+		/* keep the idle and disabled bits, which belong to the beam */
+		if (e->address == 0x11 || e->address == 0x16)
+			mode = (mode & ~7) | vic_mode_bits (registers);
+		else if (e->address == 0x18)
+			set_view ();
+		break;
+	case LOG_RAM:
+		shadow_ram[e->address] = e->value;
+		break;
+	case LOG_COLOR:
+		shadow_color[e->address] = e->value;
+		break;
+	case LOG_BANK:
+		bank = e->value << 14;
+		memcpy (shadow_ram + bank, log->bank + e->address * BANK_SIZE,
+			BANK_SIZE);
+		set_view ();
+		break;
+	}
+}
+
+/* bring the copy up to the end of the frame, drawing into 'out' on the
+   way if it isn't NULL; each line sees the writes made before the beam
+   got to it, as it would have when drawn live */
+static void replay (frame_log *log, render_line *out) {
+	int line, next = 0, until;
+
+	for (line = 0; line < LINES_PER_FRAME; line++) {
+		if (!vic_line_visible (line)) continue;
+		until = line * CYCLES_PER_LINE + 8;
+		while (next < log->used && log->entry[next].time < until)
+			apply (log, &log->entry[next++]);
+		vic_redraw_screen_line (out ? &out[line] : NULL, line,
+			vic_bad_line (line, &mode, registers), &mode, registers, &view);
+	}
+	while (next < log->used) apply (log, &log->entry[next++]);
+
+	log->used = 0;
+	log->banks = 0;
+}
+
+/******************** DRAWING THREAD *************************/
+
+static void *worker_main (void *data) {
+	frame_log *log;
+	render_line *out;
+
+	pthread_mutex_lock (&lock);
+	while (1) {
+		while (job == NULL) pthread_cond_wait (&wake, &lock);
+		log = job;
+		out = frame[drawing];
+		pthread_mutex_unlock (&lock);
+
+		replay (log, out);
+
+		pthread_mutex_lock (&lock);
+		job = NULL;
+		pthread_cond_broadcast (&wake);
+	}
+	return NULL;
+}
+
+/******************** FRAMES *************************/
+
+static frame_log *other_log (const frame_log *log) {
+	return (log == &logs[0]) ? &logs[1] : &logs[0];
+}
+
+void vic_frame_end (void) {
+	if (!vic_deferred) return;
+
+	/* no frame has been run since the last one was closed */
+	if (cpu6510_clock () < frame_start + CYCLES_PER_FRAME)
+		return;
+
+	/* later writes are timed from the start of the next frame */
+	frame_start += CYCLES_PER_FRAME;
+
+	if (vic_deferred == VIC_DEFER_THREAD) {
+		pthread_mutex_lock (&lock);
+		while (job != NULL) pthread_cond_wait (&wake, &lock);
+		if (drawing >= 0) shown = drawing;
+		drawing = 1 - shown;
+		job = recording;
+		pthread_cond_broadcast (&wake);
+		pthread_mutex_unlock (&lock);
+	} else {
+		/* nobody looked at the last frame: just step through it */
+		if (closed != NULL && !closed_drawn) replay (closed, NULL);
+		closed = recording;
+		closed_drawn = 0;
+	}
+	recording = other_log (recording);
+}
+
+const render_line *vic_defer_render_data (void) {
+	if (vic_deferred == VIC_DEFER_THREAD) return frame[shown];
+
+	if (closed != NULL && !closed_drawn) {
+		replay (closed, frame[0]);
+		closed_drawn = 1;
+	}
+	return frame[0];
+}
+
+/******************** INITIALIZATION *************************/
+
+int vic_defer_init (int new_mode) {
+	if (new_mode == VIC_DEFER_OFF) return 0;
+
+	shadow_ram = malloc (0x10000);
+	shadow_color = malloc (0x400);
+	if (shadow_ram == NULL || shadow_color == NULL) return -1;
+
+	frame[0] = vic_render_buffer ();
+	if (new_mode == VIC_DEFER_THREAD) {
+		frame[1] = calloc (MAX_LINES_PER_FRAME, sizeof(render_line));
+		if (frame[1] == NULL) return -1;
+	}
+	vic_deferred = new_mode;
+	return 0;
+}
+
+void vic_defer_start (const unsigned char vic_registers[0x40],
+	int video_mode, cycle_t start) {
+
+	if (!vic_deferred) return;
+
+	frame_start = start;
+	memcpy (registers, vic_registers, sizeof(registers));
+	mode = video_mode;
+	memcpy (shadow_ram, ram_64k, 0x10000);
+	memcpy (shadow_color, color_ram, 0x400);
+	bank = mem_vic.video_bank - ram_64k;
+	set_view ();
+	mem_set_vic_logging (1);
+
+	if (vic_deferred == VIC_DEFER_THREAD &&
+		pthread_create (&worker, NULL, worker_main, NULL) != 0) {
+		printf ("couldn't start drawing thread; drawing frames when shown\n");
+		vic_deferred = VIC_DEFER_FRAME;
+	}
+}
+
+int vic_defer_footprint (void) {
+	int bytes = 0, i;
+
+	if (!vic_deferred) return 0;
+	bytes = 0x10000 + 0x400;
+	if (vic_deferred == VIC_DEFER_THREAD)
+		bytes += MAX_LINES_PER_FRAME * sizeof(render_line);
+	for (i=0; i<2; i++)
+		bytes += logs[i].size * sizeof(log_entry) + logs[i].bank_size * BANK_SIZE;
+	return bytes;
+}
@@ -0,0 +1,44 @@
+/* vic_defer.h - deferred screen rendering for c64 emulator */
+
+#ifndef __VIC_DEFER_H
+#define __VIC_DEFER_H
+
+#include "event.h"
+#include "vic_redraw.h"
+
+#define VIC_DEFER_OFF     0   /* draw each line as the beam reaches it */
+#define VIC_DEFER_FRAME   1   /* draw a frame only when it is shown */
+#define VIC_DEFER_THREAD  2   /* draw every frame on a second thread */
+
+extern int vic_deferred;
+
+/* choose a mode before vic_start; returns -1 if it can't be set up */
+int vic_defer_init(int mode);
+void vic_defer_start(const unsigned char vic_registers[0x40],
+	int video_mode, cycle_t frame_start);
+
+/* close the log of the frame that just ended */
+void vic_frame_end(void);
+const render_line *vic_defer_render_data(void);
+int vic_defer_footprint(void);
+
+/* everything the VIC will look at goes through these */
+void vic_defer_register(int address, int value);
+void vic_defer_ram(int address, int value);
+void vic_defer_color(int address, int value);
+void vic_defer_bank(int bank);
+
+/*
+  While the cpu runs, writes to the VIC registers, to color RAM and to
+  the 16K of RAM the VIC can see are logged with the cycle they happen
+  on. At the end of the frame the log is closed, and replayed against a
+  private copy of that memory: lines are drawn from the copy exactly as
+  they would have been with the beam, so the cpu only pays for logging.
+
+  A frame that is skipped is replayed without drawing anything, which
+  is little more than a memcpy per logged write. In the threaded mode
+  every frame is drawn on the second thread while the next one runs,
+  and the screen shows the previous frame (one frame of latency).
+*/
+
+#endif
@@ -3,6 +3,8 @@
 #include "vic_redraw.h"
 #include "6510.h"
 #include "mem_c64.h"
+#include "vic_defer.h"
+#include "timing.h"
 
 #define STANDARD  (0)
 #define MULTI     (1)
@@ -14,12 +16,23 @@
 
 int sprite_collisions( render_line data );
 
-static render_line render_data[312];
+static render_line render_data[MAX_LINES_PER_FRAME];
 
+/* the frame to display; a deferred frame is drawn now if need be */
 const render_line *vic_get_render_data() {
+	if (vic_deferred) return vic_defer_render_data();
 	return (render_data);
 }
 
+/* where the lines are drawn */
+render_line *vic_render_buffer() {
+	return (render_data);
+}
+
+int vic_redraw_footprint() {
+	return sizeof(render_data);
+}
+
 inline static int standard_block (int g, int c0, int c1) {
 	return ( g | (c0<<8) | (c1<<12) );
 }
@@ -28,22 +41,15 @@ inline static int multicolor_block (int g, int c0, int c1, int c2, int c3) {
 	return ( g | (c0<<8) | (c1<<12) | (c2<<16) | (c3<<20) | (1<<31) );
 }
 
-int vic_redraw_screen_line(int raster_line, int *video_mode,
-	int vic_registers[0x40]) {
-
-	static int vc_base, rc, blank;
-	static int c_buffer[40], c_colors[40];
-
-	int bad_line, vmli, i;
-	int c_data, g_data, color0, color1, color2, color3;
-
-	int *block = render_data[raster_line].block_data;
-	int *sprite = render_data[raster_line].sprite_data;
-
-	int border_top, border_bottom;
+/* the mode bits (ECM, BMM, MCM) selected by $d011 and $d016 */
+int vic_mode_bits(const unsigned char vic_registers[0x40]) {
+	return ((vic_registers[0x11] >> 4) & (EXTCOLOR|BITMAP)) |
+		((vic_registers[0x16] >> 4) & MULTI);
+}
 
-	/* reset to top of screen */
-	if (raster_line == 0x00) vc_base=-40;
+/* is this a bad line? updates the display enable latch at line $30 */
+int vic_bad_line(int raster_line, int *video_mode,
+	const unsigned char vic_registers[0x40]) {
 
 	/* set disable flag */
 	if (raster_line == 0x30) {
@@ -51,33 +57,47 @@ int vic_redraw_screen_line(int raster_line, int *video_mode,
 		else *video_mode |= DISABLED;
 	}
 
-	/* is this a bad line? */
-	bad_line = (!((raster_line ^ vic_registers[0x11]) & 0x07)) &&
+	return (!((raster_line ^ vic_registers[0x11]) & 0x07)) &&
 		(raster_line >= 0x30) &&
 		(raster_line <= 0xf7) &&
 		(*video_mode < DISABLED);
+}
+
+/* draw one raster line into 'line' (or just step the beam if it is
+   NULL), fetching through 'mem'; 'bad_line' is what vic_bad_line() said
+   for it, and the caller stalls the cpu for it. returns the sprite
+   collisions */
+int vic_redraw_screen_line(render_line *line, int raster_line,
+	int bad_line, int *video_mode, const unsigned char vic_registers[0x40],
+	const vic_memory *mem) {
+
+	static int vc_base, rc, blank;
+	static int c_buffer[40], c_colors[40];
+
+	int vmli, i;
+	int c_data, g_data, color0, color1, color2, color3;
+
+	int *block, *sprite;
+
+	int border_top, border_bottom;
+
+	/* reset to top of screen */
+	if (raster_line == 0x00) vc_base=-40;
 
 	if (bad_line) {
 		if (rc == 7) vc_base += 40;
 		rc = 0;
 		*video_mode &= ~IDLE;
 		for (vmli = 0; vmli < 40; vmli++) {
-			c_buffer[vmli] = mem_read_video_matrix (vc_base + vmli);
-			c_colors[vmli] = mem_read_color_ram (vc_base + vmli);
+			c_buffer[vmli] = mem->video_matrix[vc_base + vmli];
+			c_colors[vmli] = mem->color_ram[vc_base + vmli];
 		}
-		cpu6510_bad_line();
 	}
 	else {
 		if (rc == 7) *video_mode |= IDLE;
 		else rc++;
 	}
 
-	/* misc. screen settings */
-	render_data[raster_line].border_color = vic_registers[0x20]; //*video_mode;
-	render_data[raster_line].csel_xscroll = vic_registers[0x16] & 0x0f;
-	render_data[raster_line].sprite_color1 = vic_registers[0x25];
-	render_data[raster_line].sprite_color2 = vic_registers[0x26];
-
 	/* vertical border and screen blanking */
 	if (vic_registers[0x11] & 0x08) {
 		border_top = 0x33;
@@ -89,8 +109,19 @@ int vic_redraw_screen_line(int raster_line, int *video_mode,
 	if ((raster_line == border_top) && (*video_mode < DISABLED)) blank = 0;
 	else if (raster_line == border_bottom) blank = 1;
 
+	/* a frame nobody will see only moves the beam along */
+	if (line == NULL) return 0;
+	block = line->block_data;
+	sprite = line->sprite_data;
+
+	/* misc. screen settings */
+	line->border_color = vic_registers[0x20]; //*video_mode;
+	line->csel_xscroll = vic_registers[0x16] & 0x0f;
+	line->sprite_color1 = vic_registers[0x25];
+	line->sprite_color2 = vic_registers[0x26];
+
 	if (blank) {
-		render_data[raster_line].csel_xscroll = -1;
+		line->csel_xscroll = -1;
 		return 0;
 	}
 
@@ -99,7 +130,7 @@ int vic_redraw_screen_line(int raster_line, int *video_mode,
 	case (CHARACTER):
 		for (vmli = 0; vmli < 40; vmli++) {
 			c_data = c_buffer[vmli];
-			g_data = mem_read_character_base ((c_data<<3) | rc);
+			g_data = mem->character_base[(c_data<<3) | rc];
 			color0 = vic_registers[0x21];
 			color1 = c_colors[vmli];
 			block[vmli] = standard_block(g_data, color0, color1);
@@ -109,7 +140,7 @@ int vic_redraw_screen_line(int raster_line, int *video_mode,
 	case (MULTI|CHARACTER):
 		for (vmli = 0; vmli < 40; vmli++) {
 			c_data = c_buffer[vmli];
-			g_data = mem_read_character_base ((c_data<<3) | rc);
+			g_data = mem->character_base[(c_data<<3) | rc];
 			color0 = vic_registers[0x21];
 			color1 = vic_registers[0x22];
 			color2 = vic_registers[0x23];
@@ -124,7 +155,7 @@ int vic_redraw_screen_line(int raster_line, int *video_mode,
 	case (BITMAP):
 		for (vmli = 0; vmli < 40; vmli++) {
 			c_data = c_buffer[vmli];
-			g_data = mem_read_bitmap_base (((vc_base+vmli)<<3) | rc);
+			g_data = mem->bitmap_base[((vc_base+vmli)<<3) | rc];
 			color0 = c_data & 0x0f;
 			color1 = c_data >> 4;
 			block[vmli] = standard_block(g_data, color0, color1);
@@ -134,7 +165,7 @@ int vic_redraw_screen_line(int raster_line, int *video_mode,
 	case (MULTI|BITMAP):
 		for (vmli = 0; vmli < 40; vmli++) {
 			c_data = c_buffer[vmli];
-			g_data = mem_read_bitmap_base (((vc_base+vmli)<<3) | rc);
+			g_data = mem->bitmap_base[((vc_base+vmli)<<3) | rc];
 			color0 = vic_registers[0x21];
 			color1 = (c_data>>4) & 0x0f;
 			color2 = c_data & 0x0f;
@@ -146,7 +177,7 @@ int vic_redraw_screen_line(int raster_line, int *video_mode,
 	case (EXTCOLOR|CHARACTER):
 		for (vmli = 0; vmli < 40; vmli++) {
 			c_data = c_buffer[vmli];
-			g_data = mem_read_character_base (((c_data & 0x3f)<<3) | rc);
+			g_data = mem->character_base[((c_data & 0x3f)<<3) | rc];
 			color0 = vic_registers[0x21 + ((c_data >> 6) & 3)];
 			color1 = c_colors[vmli];
 			block[vmli] = standard_block(g_data, color0, color1);
@@ -156,7 +187,7 @@ int vic_redraw_screen_line(int raster_line, int *video_mode,
 	case (EXTCOLOR|MULTI|CHARACTER):
 		for (vmli = 0; vmli < 40; vmli++) {
 			c_data = c_buffer[vmli];
-			g_data = mem_read_character_base (((c_data & 0x3f)<<3) | rc);
+			g_data = mem->character_base[((c_data & 0x3f)<<3) | rc];
 			if (c_colors[vmli] & 0x08)
 				block[vmli] = multicolor_block(g_data, 0, 0, 0, 0);
 			else
@@ -166,14 +197,14 @@ int vic_redraw_screen_line(int raster_line, int *video_mode,
 
 	case (EXTCOLOR|BITMAP):
 		for (vmli = 0; vmli < 40; vmli++) {
-			g_data = mem_read_bitmap_base ((((vc_base+vmli) & 0x33f)<<3) | rc);
+			g_data = mem->bitmap_base[(((vc_base+vmli) & 0x33f)<<3) | rc];
 			block[vmli] = standard_block(g_data, 0, 0);
 		}
 		break;
 
 	case (EXTCOLOR|MULTI|BITMAP):
 		for (vmli = 0; vmli < 40; vmli++) {
-			g_data = mem_read_bitmap_base ((((vc_base+vmli) & 0x33f)<<3) | rc);
+			g_data = mem->bitmap_base[(((vc_base+vmli) & 0x33f)<<3) | rc];
 			block[vmli] = multicolor_block(g_data, 0, 0, 0, 0);
 		}
 		break;
@@ -182,25 +213,25 @@ int vic_redraw_screen_line(int raster_line, int *video_mode,
 	case (IDLE|MULTI|CHARACTER):
 	case (IDLE|EXTCOLOR|CHARACTER):
 		color0 = vic_registers[0x21];
-		g_data = mem_read_video_bank (0x3fff);
+		g_data = mem->video_bank[0x3fff];
 		for (vmli = 0; vmli < 40; vmli++)
 			block[vmli] = standard_block(g_data, color0, 0);
 		break;
 	case (IDLE|BITMAP):
 	case (IDLE|EXTCOLOR|MULTI|CHARACTER):
 	case (IDLE|EXTCOLOR|BITMAP):
-		g_data = mem_read_video_bank (0x3fff);
+		g_data = mem->video_bank[0x3fff];
 		for (vmli = 0; vmli < 40; vmli++)
 			block[vmli] = standard_block(g_data, 0, 0);
 		break;
 	case (IDLE|MULTI|BITMAP):
 		color0 = vic_registers[0x21];
-		g_data = mem_read_video_bank (0x3fff);
+		g_data = mem->video_bank[0x3fff];
 		for (vmli = 0; vmli < 40; vmli++)
 			block[vmli] = multicolor_block(g_data, color0, 0, 0, 0);
 		break;
 	case (IDLE|EXTCOLOR|MULTI|BITMAP):
-		g_data = mem_read_video_bank (0x3fff);
+		g_data = mem->video_bank[0x3fff];
 		for (vmli = 0; vmli < 40; vmli++)
 			block[vmli] = multicolor_block(g_data, 0, 0, 0, 0);
 		break;
@@ -223,10 +254,10 @@ int vic_redraw_screen_line(int raster_line, int *video_mode,
 		if (vic_registers[0x17] & mask) sprite_y >>= 1;
 		if (sprite_y < 0 || sprite_y >= 21) continue;
 
-		sprite_ptr = (mem_read_video_matrix(0x3f8+i) << 6) + (3 * sprite_y);
-		sprite[i] = (mem_read_video_bank(sprite_ptr + 2) << 0) |
-			(mem_read_video_bank(sprite_ptr + 1) << 8) |
-			(mem_read_video_bank(sprite_ptr + 0) << 16);
+		sprite_ptr = (mem->video_matrix[0x3f8+i] << 6) + (3 * sprite_y);
+		sprite[i] = (mem->video_bank[sprite_ptr + 2] << 0) |
+			(mem->video_bank[sprite_ptr + 1] << 8) |
+			(mem->video_bank[sprite_ptr + 0] << 16);
 		if (!sprite[i]) continue;
 
 		sprite[i] |= (vic_registers[0x27 + i] << 24);          /* sprite color */
@@ -234,11 +265,11 @@ int vic_redraw_screen_line(int raster_line, int *video_mode,
 		if (vic_registers[0x1c] & mask) sprite[i] |= (1<<29);  /* multicolor */
 		if (vic_registers[0x1d] & mask) sprite[i] |= (1<<30);  /* x-expand */
 
-		render_data[raster_line].sprite_xpos[i] =
+		line->sprite_xpos[i] =
 			vic_registers[2*i] | ((vic_registers[0x10] & mask) ? 0x100 : 0);
 	}
 
-	return sprite_collisions(render_data[raster_line]);
+	return sprite_collisions(*line);
 }
 
 /**********************************************************************/
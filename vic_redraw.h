@@ -3,22 +3,30 @@
 #ifndef __VIC_REDRAW_H
 #define __VIC_REDRAW_H
 
-int vic_redraw_screen_line(int raster_line, int *video_mode,
-	int vic_registers[0x40]);
-
-/* structures to hold rendering data */
+/* structures to hold rendering data; only the packed block and
+   sprite words need a full 32 bits */
 typedef struct render_line_s {
 	int block_data[40];
-	int border_color;
-	int csel_xscroll;
 	int sprite_data[8];
-	int sprite_xpos[8];
-	int sprite_color1;
-	int sprite_color2;
+	short sprite_xpos[8];
+	unsigned char border_color;
+	signed char csel_xscroll;    /* -1 if the line is all border */
+	unsigned char sprite_color1;
+	unsigned char sprite_color2;
 } render_line;
 
-void vic_update_raster(int value);
+struct vic_memory_s;
+
+int vic_redraw_screen_line(render_line *line, int raster_line,
+	int bad_line, int *video_mode, const unsigned char vic_registers[0x40],
+	const struct vic_memory_s *mem);
+int vic_bad_line(int raster_line, int *video_mode,
+	const unsigned char vic_registers[0x40]);
+int vic_mode_bits(const unsigned char vic_registers[0x40]);
+
 const render_line *vic_get_render_data();
+render_line *vic_render_buffer();
+int vic_redraw_footprint();
 
 /*
 block data:
@@ -5,19 +5,16 @@
 #include <stdlib.h>
 #include <SDL/SDL.h>
 #include "video.h"
+#include "timing.h"
 #include "mem_c64.h"
 #include "vic_redraw.h"
-
-#define SCREEN_WIDTH 384
-#define SCREEN_HEIGHT 260
-
-/* if screen is 320x200, top-left pixel is (24,51) */
-#define FIRST_VISIBLE_COLUMN (184-(SCREEN_WIDTH>>1))
-#define FIRST_VISIBLE_RASTER (151-(SCREEN_HEIGHT>>1))
+#include "pace.h"
+#include "log.h"
 
 static SDL_Surface *screen, *shadow;
-static Uint8 image[SCREEN_HEIGHT][SCREEN_WIDTH];
-static render_line old_data[SCREEN_HEIGHT];
+
+/* the frame buffer is only allocated once a frame is actually drawn */
+static Uint8 (*image)[SCREEN_WIDTH] = NULL;
 
 static SDL_Color palette[16] =
 	{ { 0x00, 0x00, 0x00, 0 }
@@ -48,6 +45,16 @@ void video_init () {
 		exit(1);
 	}
 
+	SDL_WM_SetCaption("BC64: Commodore 64 emulator", NULL);
+}
+
+static void video_alloc_frame () {
+	image = malloc(SCREEN_HEIGHT * SCREEN_WIDTH);
+	if ( image == NULL ) {
+		fprintf(stderr, "Couldn't allocate frame buffer\n");
+		exit(1);
+	}
+
 	/* Initialize the shadow surface, in 8-bit palettized mode */
 	shadow = SDL_CreateRGBSurfaceFrom( image, SCREEN_WIDTH, SCREEN_HEIGHT, 8,
 		SCREEN_WIDTH, 0, 0, 0, 0);
@@ -58,8 +65,11 @@ void video_init () {
 	}
 	/* set the palette for the shadow surface */
 	SDL_SetColors(shadow, palette, 0, 16);
+}
 
-	SDL_WM_SetCaption("BC64: Commodore 64 emulator", NULL);
+/* bytes of frame buffer, whether or not it has been allocated yet */
+int video_footprint () {
+	return SCREEN_HEIGHT * SCREEN_WIDTH;
 }
 
 void video_screenshot() {
@@ -241,9 +251,12 @@ void video_draw_sdl_screen() {
 	int i;
 	const render_line *render_data = vic_get_render_data();
 
-	for (i=0; i<SCREEN_HEIGHT; i++) {
+	if (image == NULL) video_alloc_frame();
+
+	for (i=0; i<VISIBLE_LINES; i++) {
 		video_redraw_line(i, render_data[FIRST_VISIBLE_RASTER + i]);
 	}
+	for (; i<SCREEN_HEIGHT; i++) video_fill_line(i, 0);
 
 	SDL_BlitSurface(shadow, NULL, screen, NULL);
 	SDL_UpdateRect(screen, 0, 0, SCREEN_WIDTH, SCREEN_HEIGHT);
@@ -255,7 +268,7 @@ static int time_left(void) {
 
 	now = SDL_GetTicks();
 	if ( next_time <= now - 100 ) {
-		printf("%i ms slow!\n", now-next_time);
+		log_msg(LOG_VIDEO, LOG_WARN, "%i ms slow!", now-next_time);
 		next_time = now+20;
 		return(0);
 	}
@@ -269,28 +282,77 @@ static int time_left(void) {
 	return (next_time - now - 20);
 }
 
-void callback_frame (void) {
-	static int skips_left = 0, skip_frames = 9, skip_auto = 1;
-	static int total_frames = 0, total_drawn = 0, total_delayed = 0;
-	static int next_time = 0;
-	int now, remaining;
+/******************** WARP MODE *************************/
+
+/* in warp mode nothing waits for the wall clock; a frame is shown every
+   'warp_frames' frames, or when 'warp_interval' ms have passed since
+   the last one was shown if that is 0 */
+static int warp = 0;
+static int warp_frames = 0, warp_interval = 40;
+
+void video_set_warp (int on) {
+	if (warp == on) return;
+	warp = on;
+	printf ("warp mode %s\n", warp ? "on" : "off");
+
+	/* start pacing again from now, rather than catching up */
+	pace_enable(!warp);
+}
+
+int video_warp (void) {
+	return warp;
+}
+
+void video_warp_frames (int frames) {
+	warp_frames = frames > 0 ? frames : 0;
+}
+
+void video_warp_rate (int hz) {
+	if (hz > 0) warp_interval = 1000 / hz;
+	warp_frames = 0;
+}
 
+static void warp_frame (void) {
+	static int frames = 0, last_shown = 0;
+	static int total_frames = 0, total_drawn = 0, last_report = 0;
+	int now = SDL_GetTicks();
 
-	/* wait for next 50th of a second */
-	remaining = next_time - SDL_GetTicks();
-	if (remaining < -100) {
-		printf("%i ms slow!\n", -remaining);
-		next_time -= remaining;
-		remaining = 0;
+	if (warp_frames ? ++frames >= warp_frames :
+		now - last_shown >= warp_interval) {
+		video_draw_sdl_screen();
+		total_drawn++;
+		frames = 0;
+		last_shown = now;
 	}
-	next_time += 20;
 
-	if (remaining > 40) {
-		now = SDL_GetTicks();
-		SDL_Delay (remaining - 20);
-		total_delayed += SDL_GetTicks() - now;
+	/* print speed statistics once a second */
+	total_frames++;
+	if (now - last_report >= 1000) {
+		log_msg(LOG_VIDEO, LOG_INFO, "warp: %i frames/sec (%i%% speed), %i shown",
+			total_frames, (int) (100.0 * total_frames * CYCLES_PER_FRAME /
+			machine.clock_hz), total_drawn);
+		total_frames = 0;
+		total_drawn = 0;
+		last_report = now;
+	}
+}
+
+/******************** FRAME PACING *************************/
+
+void callback_frame (void) {
+	static int skips_left = 0, skip_frames = 9, skip_auto = 1;
+	static int total_frames = 0, total_drawn = 0;
+	pace_stats stats;
+	int late;
+
+	if (warp) {
+		warp_frame();
+		return;
 	}
-	if (remaining >= 0 && skip_auto) skips_left = 0;
+
+	/* wait until the frame is due */
+	late = pace_frame();
+	if (late <= 0 && skip_auto) skips_left = 0;
 
 	/* draw the screen, if there is time */
 	if (skips_left-- <= 0) {
@@ -301,10 +363,13 @@ void callback_frame (void) {
 	
 	/* print framerate statistics */	
 	if (++total_frames == 50) {
-		printf("%i frames/sec, ", total_drawn);
-		printf("%i percent idle\n", total_delayed/10);
+		pace_get_stats(&stats);
+		log_msg(LOG_VIDEO, LOG_INFO, "%i frames/sec, %i percent idle, "
+			"frame %.2f ms +/- %.2f (%.2f-%.2f), %i late", total_drawn,
+			(int) (stats.idle * 100), stats.mean_ms, stats.jitter_ms,
+			stats.min_ms, stats.max_ms, stats.late);
+		pace_reset_stats();
 		total_drawn = 0;
-		total_delayed = 0;
 		total_frames = 0;
 	}
-}
\ No newline at end of file
+}
@@ -1,8 +1,25 @@
 /* video.h - video functions for c64 emulator */
 /* by Brian Huffman 12-1-00 */
 
+#define SCREEN_WIDTH 384
+#define SCREEN_HEIGHT 260
+
+/* if screen is 320x200, top-left pixel is (24,51) */
+#define FIRST_VISIBLE_COLUMN (184-(SCREEN_WIDTH>>1))
+
+/* the lines shown depend on the machine (see timing.h) */
+#define FIRST_VISIBLE_RASTER (machine.first_visible_raster)
+#define VISIBLE_LINES (machine.visible_lines)
+
 void video_init (void);
 void video_draw_sdl_screen (void);
 void video_screenshot (void);
+int video_footprint (void);
+
+void callback_frame (void);
 
-void callback_frame (void);
\ No newline at end of file
+/* warp mode: no pacing, and only some frames are shown */
+void video_set_warp (int on);
+int video_warp (void);
+void video_warp_frames (int frames);
+void video_warp_rate (int hz);
@@ -0,0 +1,159 @@
+/* watch.c - memory watchpoints and breakpoints for c64 emulator */
+
+/*
+  Watchpoints never slow down ordinary memory accesses. Each watched
+  page is flagged in the page flag table of mem_c64.c; only accesses to
+  flagged pages leave the fast path and end up in watch_hit().
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "watch.h"
+#include "mem_c64.h"
+#include "6510.h"
+
+typedef struct {
+	int type;           /* WATCH_READ | WATCH_WRITE | WATCH_EXEC | WATCH_STOP */
+	int start, end;     /* inclusive address range */
+	int mask, value;    /* hit only if (data & mask) == value */
+	int count;          /* number of hits before the watchpoint fires */
+	int hits;
+} watchpoint;
+
+static watchpoint watch[WATCH_MAX];
+static int watch_used[WATCH_MAX];
+
+/* recompute the watch flags of every page covered by a watchpoint */
+static void update_pages (int start, int end) {
+	int page, i, flags;
+
+	for (page = start >> 8; page <= end >> 8; page++) {
+		flags = 0;
+		for (i=0; i<WATCH_MAX; i++) {
+			if (!watch_used[i]) continue;
+			if ((watch[i].start >> 8) > page || (watch[i].end >> 8) < page)
+				continue;
+			if (watch[i].type & WATCH_READ)  flags |= PAGE_WATCH_READ;
+			if (watch[i].type & WATCH_WRITE) flags |= PAGE_WATCH_WRITE;
+			if (watch[i].type & WATCH_EXEC)  flags |= PAGE_WATCH_EXEC;
+		}
+		mem_set_page_watch (page, flags);
+	}
+}
+
+int watch_add (int type, int start, int end, int mask, int value, int count) {
+	int id;
+
+	if (start < 0 || end > 0xffff || start > end) return -1;
+	if (!(type & (WATCH_READ | WATCH_WRITE | WATCH_EXEC))) return -1;
+
+	for (id=0; id<WATCH_MAX; id++) if (!watch_used[id]) break;
+	if (id == WATCH_MAX) return -1;
+
+	watch[id].type = type;
+	watch[id].start = start;
+	watch[id].end = end;
+	watch[id].mask = mask & 0xff;
+	watch[id].value = value & mask & 0xff;
+	watch[id].count = (count > 0) ? count : 1;
+	watch[id].hits = 0;
+	watch_used[id] = 1;
+
+	update_pages (start, end);
+	return id;
+}
+
+int watch_remove (int id) {
+	if (id < 0 || id >= WATCH_MAX || !watch_used[id]) return -1;
+	watch_used[id] = 0;
+	update_pages (watch[id].start, watch[id].end);
+	return 0;
+}
+
+void watch_clear (void) {
+	int id;
+	for (id=0; id<WATCH_MAX; id++) watch_remove (id);
+}
+
+static int parse_hex (const char **s, int *result) {
+	char *end;
+	if (**s == '$') (*s)++;
+	*result = strtol (*s, &end, 16);
+	if (end == *s) return -1;
+	*s = end;
+	return 0;
+}
+
+int watch_parse (const char *spec) {
+	int type = 0, start, end, mask = 0, value = 0, count = 1;
+	const char *s = spec;
+
+	/* access type */
+	for (; *s && *s != ':'; s++) {
+		switch (*s) {
+		case 'r': type |= WATCH_READ; break;
+		case 'w': type |= WATCH_WRITE; break;
+		case 'x': type |= WATCH_EXEC; break;
+		default: return -1;
+		}
+	}
+	if (*s++ != ':') return -1;
+
+	/* address range */
+	if (parse_hex (&s, &start)) return -1;
+	end = start;
+	if (*s == '-' && (s++, parse_hex (&s, &end))) return -1;
+
+	/* value condition */
+	if (*s == '=') {
+		s++;
+		if (parse_hex (&s, &value)) return -1;
+		mask = 0xff;
+		if (*s == '&' && (s++, parse_hex (&s, &mask))) return -1;
+	}
+
+	/* hit count */
+	if (*s == '#' && (s++, parse_hex (&s, &count))) return -1;
+
+	/* stop flag */
+	if (*s == '!') { type |= WATCH_STOP; s++; }
+
+	if (*s != 0) return -1;
+	return watch_add (type, start, end, mask, value, count);
+}
+
+void watch_list (void) {
+	int i;
+	for (i=0; i<WATCH_MAX; i++) {
+		if (!watch_used[i]) continue;
+		printf ("watchpoint %i: %s%s%s $%04x-$%04x (data & $%02x) == $%02x, "
+			"%i/%i hits%s\n", i,
+			watch[i].type & WATCH_READ ? "r" : "",
+			watch[i].type & WATCH_WRITE ? "w" : "",
+			watch[i].type & WATCH_EXEC ? "x" : "",
+			watch[i].start, watch[i].end, watch[i].mask, watch[i].value,
+			watch[i].hits, watch[i].count,
+			watch[i].type & WATCH_STOP ? ", stop" : "");
+	}
+}
+
+void watch_hit (int type, int address, int value) {
+	const char *kind;
+	int i;
+
+	for (i=0; i<WATCH_MAX; i++) {
+		if (!watch_used[i] || !(watch[i].type & type)) continue;
+		if (address < watch[i].start || address > watch[i].end) continue;
+		if ((value & watch[i].mask) != watch[i].value) continue;
+		if (++watch[i].hits < watch[i].count) continue;
+
+		kind = (type == WATCH_READ) ? "read" :
+			(type == WATCH_WRITE) ? "write" : "exec";
+		printf ("watchpoint %i: %s $%04x = $%02x (hit %i) at clock %lld\n",
+			i, kind, address, value & 0xff, watch[i].hits, cpu6510_clock());
+		print_state ();
+
+		if (watch[i].type & WATCH_STOP) exit (WATCH_EXIT_STATUS);
+	}
+}
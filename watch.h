@@ -0,0 +1,44 @@
+/* watch.h - memory watchpoints and breakpoints for c64 emulator */
+
+#ifndef __WATCH_H
+#define __WATCH_H
+
+/* kinds of access that can be watched */
+#define WATCH_READ   (1<<0)
+#define WATCH_WRITE  (1<<1)
+#define WATCH_EXEC   (1<<2)
+/* stop the emulator when the watchpoint fires */
+#define WATCH_STOP   (1<<3)
+
+#define WATCH_MAX 16
+
+/* exit status used when a WATCH_STOP watchpoint fires */
+#define WATCH_EXIT_STATUS 3
+
+int watch_add (int type, int start, int end, int mask, int value, int count);
+int watch_remove (int id);
+void watch_clear (void);
+int watch_parse (const char *spec);
+void watch_list (void);
+
+/* called from the memory slow paths for flagged pages only */
+void watch_hit (int type, int address, int value);
+
+/*
+watchpoint specifications (all numbers in hex, '$' is optional):
+
+  TYPE:START[-END][=VALUE[&MASK]][#COUNT][!]
+
+  TYPE   any combination of r (read), w (write), x (execute)
+  VALUE  only accesses where (data & MASK) == VALUE count as hits;
+         MASK defaults to ff when VALUE is given
+  COUNT  the watchpoint fires on the COUNT'th hit and every hit after
+  !      stop the emulator (exit status 3) when it fires
+
+examples:
+  x:e5cd#a!     stop the 10th time the keyboard wait loop is entered
+  w:d020=06     report every write of 6 to the border color
+  rw:c000-c0ff  report every access to page $c0
+*/
+
+#endif